@@ -1,31 +1,230 @@
 /**
  * @file server.c
  * @brief This program is the server in a client-server application that uses shared memory for inter-process communication.
- * The server generates random strings and puts them in a shared memory segment. It then waits for a worker process to
- * process the string and put the result back in the shared memory.
+ * The server generates random strings and puts them in a ring of task slots in a shared memory segment. Any number of
+ * worker processes claim the tasks, process the strings and report them back through a completion ring. The strings
+ * themselves, of any length, live in a payload arena in the same segment and are processed in place.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/wait.h>
 #include <signal.h>
 #include <time.h>
+#include <limits.h>
+
+#define RING_SLOTS 64       /**< The number of task slots, and of completion ring entries. */
+#define SPIN_TRIES 100      /**< How many times the server looks for finished tasks before it sleeps. */
+#define MAX_WORKERS 64      /**< The most workers the benchmark starts. */
+#define ARENA_SIZE (64UL << 20) /**< The size of the payload arena: room for RING_SLOTS payloads of 1 MiB. */
+#define ARENA_ALIGN 64      /**< Payloads start on their own cache line. */
+#define ALLOC_ENTRIES (16 * RING_SLOTS) /**< The most payloads, live or freed but not yet reclaimed, the arena tracks. */
+#define STALL_MS 200        /**< How long a stalling worker holds its first task in the stress test. */
 
 /**
- * @brief A structure to hold the data that will be shared between the server and worker processes.
+ * @brief The states of a task slot.
+ * Only the server moves a slot from free to available and from complete (or failed) to free. The workers move it
+ * from available to taken with a compare-and-swap, so exactly one worker gets each task. A worker that
+ * cannot process a task, because its payload lies outside the arena, reports it as failed.
+ */
+enum { SLOT_FREE = 0, SLOT_AVAILABLE = 1, SLOT_TAKEN = 2, SLOT_COMPLETE = 3, SLOT_FAILED = 4 };
+
+/**
+ * @brief A task slot.
  */
 struct task {
-    char data[100];     /**< The string to be processed. */
-    pid_t worker_pid;   /**< The PID of the worker process. */
-    int status;         /**< The status of the task. 0: idle, 1: task available, 2: task taken, 3: task complete, 4: result consumed, -1: terminate */
+    size_t offset;          /**< Where the payload to be processed starts in the arena. */
+    size_t length;          /**< The length of the payload in bytes. */
+    pid_t worker_pid;       /**< The PID of the worker process. */
+    unsigned id;            /**< The number of the task. */
+    _Atomic int status;     /**< The state of the slot: one of SLOT_FREE ... SLOT_FAILED. */
 };
 
+/*
+ * Memory ordering. offset, length, worker_pid, id and the payload bytes in the arena are plain
+ * data. At any moment exactly one process owns a task and its payload, and ownership is handed over through an atomic word with release/acquire ordering:
+ *
+ *  - The server fills a free slot, then stores SLOT_AVAILABLE with release.
+ *  - A worker claims the slot with a compare-and-swap from SLOT_AVAILABLE to SLOT_TAKEN with
+ *    acquire, so it sees everything the server wrote. Only one swap can succeed, so each task
+ *    is processed by exactly one worker. A worker reads the task only after its swap succeeded,
+ *    so a slot that was refilled in between (ABA) simply hands it the newer task.
+ *  - The worker writes the result, stores SLOT_COMPLETE (or SLOT_FAILED), and then stores the slot number in the
+ *    completion ring with release. The server reads the entry with acquire and sees the result.
+ *  - The server reads the result before it makes the slot free again and refills it, and the
+ *    next worker's acquire claim orders those writes after the previous worker's.
+ *
+ * Everything else (freeing a slot, clearing a completion entry, reserving one) only needs
+ * relaxed ordering, because one of the handovers above orders it already.
+ */
+
+/**
+ * @brief A structure to hold the data that will be shared between the server and worker processes.
+ * It must be the same in worker.c.
+ */
+struct ring {
+    _Atomic int terminate;                  /**< Set to 1 when the server exits; the workers then exit too. */
+    _Atomic unsigned long processed;        /**< The tasks processed by workers that have exited. */
+    _Alignas(64) _Atomic unsigned task_seq; /**< Futex word the idle workers sleep on; bumped when tasks are posted. */
+    _Atomic int task_waiters;               /**< The number of workers sleeping (or about to sleep) on task_seq. */
+    _Alignas(64) _Atomic unsigned done_seq; /**< Futex word the idle server sleeps on; bumped when a task completes. */
+    _Atomic int done_waiters;               /**< 1 while the server sleeps (or is about to sleep) on done_seq. */
+    _Alignas(64) _Atomic unsigned done_tail; /**< The next completion ring entry a worker fills. */
+    _Atomic unsigned done[RING_SLOTS];      /**< The completion ring: slot number + 1 of each finished task, 0 if empty. */
+    struct task slots[RING_SLOTS];          /**< The task slots. */
+    size_t arena_size;                      /**< The size of the payload arena that follows this structure. */
+};
+
+/**
+ * @brief Returns the payload arena, which directly follows the ring in the shared segment.
+ * Payloads are found by their offset into it, so the segment may be attached at any address.
+ */
+static char *arena(struct ring *ring) {
+    return (char *)(ring + 1);
+}
+
+/*
+ * Waiting. A process that finds nothing to do checks a few more times and then sleeps on a
+ * futex word in the shared segment (a shared futex, not FUTEX_PRIVATE, so it works across
+ * processes). It first counts itself as a waiter and reads the word, then checks for work
+ * once more, and only then sleeps; the other side bumps the word and wakes it only when the
+ * waiter count is non-zero. A sequentially consistent fence on both sides, between publishing
+ * (work or waiter) and checking the other, makes sure that either the waiter sees the new
+ * work or the other side sees the waiter, so no wakeup is lost.
+ */
+
+static void futex_wait(_Atomic unsigned *word, unsigned seq) {
+    syscall(SYS_futex, word, FUTEX_WAIT, seq, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic unsigned *word, int n) {
+    syscall(SYS_futex, word, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
 int shmid;              /**< The ID of the shared memory segment. */
-struct task *solve;     /**< A pointer to the shared memory segment. */
+struct ring *ring;      /**< A pointer to the shared memory segment. */
+unsigned done_head;     /**< The next completion ring entry the server reads. */
+
+/*
+ * The payload arena. Only the server allocates and frees payloads, so the allocator's state is
+ * private to the server; the workers only see offsets and lengths. It is a ring allocator: new
+ * payloads go after the newest one, wrapping to the start of the arena when the end is reached,
+ * and space is reclaimed from the oldest payload on. Tasks finish out of order, so a freed
+ * payload only gives its space back once every older payload is freed too. So while one task
+ * lags, the payloads of the tasks that finished after it stay in the queue, and the queue can
+ * hold more entries than there are slots. When it is full, arena_alloc() refuses like it does
+ * when the arena is full, and the server waits until the lagging task finishes.
+ */
+
+struct allocation {
+    size_t start, end;  /**< The bytes of the arena the payload occupies. */
+    int freed;          /**< The task is done, but an older payload still holds the space before it. */
+};
+
+struct allocation allocs[ALLOC_ENTRIES]; /**< The payloads not yet reclaimed, oldest first, from alloc_first on. */
+unsigned alloc_first, alloc_count;      /**< The oldest payload and the number of payloads not yet reclaimed. */
+size_t arena_head;                      /**< Where the next payload goes. */
+unsigned alloc_peak;                    /**< The most payloads not yet reclaimed at once. */
+unsigned slot_alloc[RING_SLOTS];        /**< The allocs[] entry holding each slot's payload. */
+
+/**
+ * @brief Allocates space for a payload.
+ * @param length The length of the payload.
+ * @param slot The task slot the payload is for.
+ * @return The offset of the payload in the arena, or -1 if there is no room until older tasks finish.
+ */
+static long arena_alloc(size_t length, int slot) {
+    size_t size = (length + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1), start;
+
+    if (alloc_count == ALLOC_ENTRIES) {
+        return -1; // every entry is taken until the oldest payload is freed
+    } else if (alloc_count == 0) {
+        arena_head = 0;
+        start = 0;
+    } else {
+        size_t tail = allocs[alloc_first].start;
+        if (arena_head > tail) {
+            // The free space is after the newest payload and before the oldest.
+            if (arena_head + size <= ring->arena_size) {
+                start = arena_head;
+            } else if (size <= tail) {
+                start = 0;
+            } else {
+                return -1;
+            }
+        } else if (arena_head + size <= tail) {
+            start = arena_head; // wrapped: the free space lies between the newest and the oldest
+        } else {
+            return -1;
+        }
+    }
+    if (start + size > ring->arena_size) {
+        return -1; // only possible when the arena is empty and the payload is larger than it
+    }
+
+    unsigned a = (alloc_first + alloc_count++) % ALLOC_ENTRIES;
+    allocs[a].start = start;
+    allocs[a].end = start + size;
+    allocs[a].freed = 0;
+    slot_alloc[slot] = a;
+    if (alloc_count > alloc_peak) {
+        alloc_peak = alloc_count;
+    }
+    arena_head = start + size;
+    return (long)start;
+}
+
+/**
+ * @brief Frees the payload of a task slot.
+ */
+static void arena_free(int slot) {
+    allocs[slot_alloc[slot]].freed = 1;
+    while (alloc_count > 0 && allocs[alloc_first].freed) {
+        alloc_first = (alloc_first + 1) % ALLOC_ENTRIES;
+        alloc_count--;
+    }
+}
+
+/**
+ * @brief Wakes up to n sleeping workers after new tasks were posted.
+ */
+static void wake_workers(int n) {
+    atomic_thread_fence(memory_order_seq_cst); // order the posted tasks before reading the waiter count
+    if (atomic_load_explicit(&ring->task_waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&ring->task_seq, 1);
+        futex_wake(&ring->task_seq, n);
+    }
+}
+
+/**
+ * @brief Sleeps until a worker reports a finished task.
+ */
+static void wait_for_done(void) {
+    atomic_store_explicit(&ring->done_waiters, 1, memory_order_relaxed);
+    unsigned seq = atomic_load_explicit(&ring->done_seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst); // publish the waiter before checking the completion ring
+    if (atomic_load_explicit(&ring->done[done_head % RING_SLOTS], memory_order_relaxed) == 0) {
+        futex_wait(&ring->done_seq, seq);
+    }
+    atomic_store_explicit(&ring->done_waiters, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Tells the workers to exit, and wakes those that sleep.
+ */
+static void stop_all_workers(void) {
+    atomic_store_explicit(&ring->terminate, 1, memory_order_release);
+    atomic_fetch_add(&ring->task_seq, 1);
+    futex_wake(&ring->task_seq, INT_MAX);
+}
 
 /**
  * @brief A signal handler for the SIGINT signal (Ctrl+C).
@@ -34,18 +233,359 @@ struct task *solve;     /**< A pointer to the shared memory segment. */
  */
 void cleanup(int sig) {
     printf("Received signal is %d .Cleaning up and exiting on Ctrl+C...\n", sig);
-    // Set the status to -1 to signal the worker to terminate.
-    solve->status = -1;
+    // Set the terminate flag to signal the workers to terminate.
+    stop_all_workers();
     // Detach the shared memory segment.
-    shmdt(solve);
+    shmdt(ring);
     // Remove the shared memory segment.
     shmctl(shmid, IPC_RMID, NULL);
     exit(0);
 }
 
+#define LETTERS_SIZE (26 * 160) /**< The length of the letter pattern large payloads are copied from: whole alphabets. */
+char letters[LETTERS_SIZE + 26]; /**< The alphabet over and over; a payload starts at a letter chosen by its task number. */
+
 /**
- * @brief The main function. It creates a shared memory segment, and then enters a loop where it generates random strings,
- * puts them in the shared memory, and waits for a worker process to process them.
+ * @brief Fills the letter pattern that large payloads are copied from.
+ */
+static void make_letters(void) {
+    for (size_t i = 0; i < sizeof(letters); i++) {
+        letters[i] = 'a' + i % 26;
+    }
+}
+
+/**
+ * @brief Puts a payload in the arena for a task: a random string of 1 to 20 letters, or size letters.
+ * A payload of size letters starts at a letter chosen by the task number, so a payload that was
+ * overwritten by another task's is noticed even after the worker converted it.
+ * @param t The task; its id must be set.
+ * @param slot The number of the task's slot.
+ * @param size The length of the payload, or 0 for a short random string.
+ * @return 1 on success, 0 if the arena has no room for it yet.
+ */
+static int make_task(struct task *t, int slot, size_t size) {
+    size_t len = size ? size : (size_t)(rand() % 20) + 1;
+    long offset = arena_alloc(len, slot);
+    if (offset == -1) {
+        return 0;
+    }
+    t->offset = (size_t)offset;
+    t->length = len;
+    char *p = arena(ring) + offset;
+    if (size == 0) {
+        for (size_t i = 0; i < len; i++) {
+            p[i] = 'a' + (rand() % 26);
+        }
+    } else {
+        // Copying prepared letters keeps rand() out of the measurement.
+        const char *from = letters + t->id % 26;
+        for (size_t i = 0; i < len; i += LETTERS_SIZE) {
+            memcpy(p + i, from, len - i < LETTERS_SIZE ? len - i : LETTERS_SIZE);
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Checks that a worker converted the payload to uppercase.
+ * @param t The task.
+ * @param size The length make_task() was given, so a payload of size letters is checked letter by letter.
+ * @return 1 if it did, 0 otherwise.
+ */
+static int check_task(const struct task *t, size_t size) {
+    const char *p = arena(ring) + t->offset;
+    for (size_t i = 0; i < t->length; i++) {
+        if (size ? p[i] != (char)('A' + (t->id + i) % 26) : p[i] < 'A' || p[i] > 'Z') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Hands out tasks and collects the results.
+ * The server keeps every free slot filled with a new task, so the workers always find work,
+ * and takes finished tasks off the completion ring in the order they finished.
+ * @param tasks The number of tasks to run, or -1 to run until Ctrl+C.
+ * @param window The most tasks handed out at a time (RING_SLOTS to keep the ring full).
+ * @param size The length of every payload, or 0 for short random strings.
+ * @param verbose 1 to print every string.
+ * @param latency If not NULL, the round trip time of every task in seconds is stored here.
+ * @return The number of results that were wrong. It stops at the first task reported twice.
+ */
+static long serve(long tasks, int window, size_t size, int verbose, double *latency) {
+    int free_slots[RING_SLOTS];     // only the server hands out slots, so it keeps the free ones in a plain stack
+    double posted[RING_SLOTS];      // when the task in each slot was posted
+    unsigned posted_id[RING_SLOTS]; // and its number
+    int nfree = 0, spins = 0;
+    long issued = 0, finished = 0, wrong = 0;
+
+    for (int i = RING_SLOTS - 1; i >= 0; i--) {
+        if (atomic_load_explicit(&ring->slots[i].status, memory_order_relaxed) == SLOT_FREE) {
+            free_slots[nfree++] = i;
+        }
+    }
+
+    while (tasks < 0 || finished < tasks) {
+        int posted_now = 0, progress = 0;
+
+        // Keep the ring full, as far as the arena has room.
+        while (nfree > 0 && issued - finished < window && (tasks < 0 || issued < tasks)) {
+            int slot = free_slots[nfree - 1];
+            struct task *t = &ring->slots[slot];
+            t->id = (unsigned)issued;
+            if (!make_task(t, slot, size)) {
+                break;
+            }
+            nfree--;
+            posted_id[slot] = (unsigned)issued++;
+            if (verbose) {
+                printf("Generated string: %.*s\n", (int)t->length, arena(ring) + t->offset);
+            }
+            if (latency) {
+                posted[slot] = seconds();
+            }
+            // Set the status to available to let a worker take the task.
+            atomic_store_explicit(&t->status, SLOT_AVAILABLE, memory_order_release);
+            posted_now++;
+        }
+        if (posted_now > 0) {
+            wake_workers(posted_now);
+            progress = 1;
+        }
+
+        // Collect the finished tasks.
+        unsigned slot;
+        while ((slot = atomic_load_explicit(&ring->done[done_head % RING_SLOTS], memory_order_acquire)) != 0) {
+            atomic_store_explicit(&ring->done[done_head % RING_SLOTS], 0, memory_order_relaxed);
+            done_head++;
+            struct task *t = &ring->slots[slot - 1];
+            if (latency) {
+                latency[finished] = seconds() - posted[slot - 1];
+            }
+            if (verbose) {
+                printf("Worker PID %d processed string: %.*s\n", t->worker_pid, (int)t->length, arena(ring) + t->offset);
+            }
+            // A task reported twice finds its slot free, or holding another task. Recycling the
+            // slot again would hand it out twice, so the server gives up instead.
+            int status = atomic_load_explicit(&t->status, memory_order_relaxed);
+            if ((status != SLOT_COMPLETE && status != SLOT_FAILED) || t->id != posted_id[slot - 1]) {
+                printf("Server: slot %u was reported complete but holds no finished task.\n", slot - 1);
+                return wrong + 1;
+            }
+            if (status == SLOT_FAILED) {
+                printf("Server: worker PID %d could not process task %u.\n", t->worker_pid, t->id);
+                wrong++;
+            } else {
+                wrong += !check_task(t, size);
+            }
+            // Set the status to free; the slot gets the next task.
+            arena_free(slot - 1);
+            atomic_store_explicit(&t->status, SLOT_FREE, memory_order_relaxed);
+            free_slots[nfree++] = slot - 1;
+            finished++;
+            progress = 1;
+        }
+
+        // Nothing to do: look again a few times, then sleep until a task completes.
+        if (progress) {
+            spins = 0;
+        } else if (++spins >= SPIN_TRIES) {
+            wait_for_done();
+            spins = 0;
+        }
+    }
+    return wrong;
+}
+
+/**
+ * @brief Starts worker processes running worker.out in quiet mode.
+ * @param worker_path The path of worker.out.
+ * @param pids Where the PIDs of the workers are stored.
+ * @param n The number of workers.
+ * @param stalled How many of them hold their first task for STALL_MS milliseconds.
+ */
+static void start_workers(const char *worker_path, pid_t *pids, int n, int stalled) {
+    char stall_ms[16];
+    snprintf(stall_ms, sizeof(stall_ms), "%d", STALL_MS);
+    for (int i = 0; i < n; i++) {
+        pids[i] = fork();
+        if (pids[i] == -1) {
+            perror("fork failed");
+            cleanup(0);
+        }
+        if (pids[i] == 0) {
+            if (i < stalled) {
+                execl(worker_path, worker_path, "-q", "-s", stall_ms, (char *)NULL);
+            } else {
+                execl(worker_path, worker_path, "-q", (char *)NULL);
+            }
+            perror("Server: cannot run worker");
+            _exit(1);
+        }
+    }
+}
+
+/**
+ * @brief Stops the workers started by start_workers() and waits for them.
+ */
+static void stop_workers(pid_t *pids, int n) {
+    stop_all_workers();
+    for (int i = 0; i < n; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+    atomic_store_explicit(&ring->terminate, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Measures how many tasks per second 1, 2, 4, ... workers get through.
+ * @param tasks The number of tasks in each run.
+ * @param max_workers The most workers to run.
+ * @param worker_path The path of worker.out.
+ */
+static void bench(long tasks, int max_workers, const char *worker_path) {
+    pid_t pids[MAX_WORKERS];
+
+    printf("%ld tasks per run, %d slots\n", tasks, RING_SLOTS);
+    printf("%8s %14s\n", "workers", "tasks/s");
+    for (int n = 1; n <= max_workers; n *= 2) {
+        start_workers(worker_path, pids, n, 0);
+        double start = seconds();
+        long wrong = serve(tasks, RING_SLOTS, 0, 0, NULL);
+        double elapsed = seconds() - start;
+        stop_workers(pids, n);
+        printf("%8d %14.0f%s\n", n, tasks / elapsed, wrong ? "  WRONG RESULTS" : "");
+    }
+}
+
+/**
+ * @brief Measures the throughput for payloads of 100 bytes, 4 KiB and 1 MiB.
+ * The payloads are written once into the arena by the server and converted in place by the workers.
+ * @param workers The number of workers.
+ * @param worker_path The path of worker.out.
+ */
+static void payload_bench(int workers, const char *worker_path) {
+    static const size_t sizes[] = {100, 4096, 1 << 20};
+    pid_t pids[MAX_WORKERS];
+
+    printf("%d worker%s, %lu MiB arena\n", workers, workers > 1 ? "s" : "", ARENA_SIZE >> 20);
+    printf("%10s %8s %12s %10s\n", "payload", "tasks", "tasks/s", "MB/s");
+    start_workers(worker_path, pids, workers, 0);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        long tasks = (256L << 20) / sizes[i] < 100000 ? (long)((256L << 20) / sizes[i]) : 100000;
+        double start = seconds();
+        long wrong = serve(tasks, RING_SLOTS, sizes[i], 0, NULL);
+        double elapsed = seconds() - start;
+        printf("%10zu %8ld %12.0f %10.0f%s\n", sizes[i], tasks, tasks / elapsed,
+               tasks * (double)sizes[i] / elapsed / 1e6, wrong ? "  WRONG RESULTS" : "");
+    }
+    stop_workers(pids, workers);
+}
+
+/**
+ * @brief Runs many workers at full speed and checks that every task was processed exactly once.
+ * serve() checks each reported task against the one the server put in that slot. After the
+ * workers exit, the number of tasks they say they processed must match, and no stray
+ * completion may be left in the ring.
+ * With a stalled worker, the other workers finish many tasks while it holds its first one, so
+ * the payloads behind the lagging task pile up in the arena allocator. Payloads of size letters
+ * are checked letter by letter, so one placed on top of a payload still in use is noticed.
+ * @param tasks The number of tasks.
+ * @param workers The number of workers.
+ * @param stalled How many of the workers stall on their first task.
+ * @param size The length of every payload, or 0 for short random strings.
+ * @param worker_path The path of worker.out.
+ * @return 1 if the check passed, 0 otherwise.
+ */
+static int stress(long tasks, int workers, int stalled, size_t size, const char *worker_path) {
+    pid_t pids[MAX_WORKERS];
+
+    atomic_store_explicit(&ring->processed, 0, memory_order_relaxed);
+    alloc_peak = 0;
+    start_workers(worker_path, pids, workers, stalled);
+    double start = seconds();
+    long wrong = serve(tasks, RING_SLOTS, size, 0, NULL);
+    double elapsed = seconds() - start;
+    stop_workers(pids, workers);
+
+    unsigned long processed = atomic_load_explicit(&ring->processed, memory_order_relaxed);
+    int stray = atomic_load_explicit(&ring->done[done_head % RING_SLOTS], memory_order_acquire) != 0;
+    int ok = wrong == 0 && processed == (unsigned long)tasks && !stray;
+    if (size) {
+        printf("%ld tasks of %zu bytes, %d workers (%d stalled), %.0f tasks/s\n", tasks, size, workers, stalled, tasks / elapsed);
+    } else {
+        printf("%ld tasks, %d workers (%d stalled), %.0f tasks/s\n", tasks, workers, stalled, tasks / elapsed);
+    }
+    printf("wrong or duplicated results: %ld, processed by the workers: %lu, stray completions: %s\n",
+           wrong, processed, stray ? "yes" : "no");
+    printf("most payloads held back at once: %u (%d slots, %d allocator entries)\n", alloc_peak, RING_SLOTS, ALLOC_ENTRIES);
+    printf("%s\n", ok ? "Every task was processed exactly once." : "EXACTLY-ONCE CHECK FAILED");
+    return ok;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Measures the round trip time of single tasks: from the moment the server posts a task
+ * until it sees the task completed. Only one task is handed out at a time.
+ * @param tasks The number of round trips.
+ * @param workers The number of workers.
+ * @param worker_path The path of worker.out.
+ */
+static void latency_bench(long tasks, int workers, const char *worker_path) {
+    pid_t pids[MAX_WORKERS];
+    long buckets[32] = {0}, most = 1;
+    double *latency = malloc(tasks * sizeof(double));
+
+    if (latency == NULL) {
+        perror("malloc failed");
+        cleanup(0);
+    }
+    start_workers(worker_path, pids, workers, 0);
+    long wrong = serve(tasks, 1, 0, 0, latency);
+    stop_workers(pids, workers);
+
+    qsort(latency, tasks, sizeof(double), compare_doubles);
+    printf("%ld round trips, %d worker%s%s\n", tasks, workers, workers > 1 ? "s" : "", wrong ? ", WRONG RESULTS" : "");
+    printf("p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n", latency[tasks / 2] * 1e6,
+           latency[tasks * 9 / 10] * 1e6, latency[tasks * 99 / 100] * 1e6, latency[tasks - 1] * 1e6);
+
+    // Bucket b holds the round trips of 2^(b-1) to 2^b microseconds.
+    for (long i = 0; i < tasks; i++) {
+        int b = 0;
+        while (b < 31 && latency[i] * 1e6 >= (double)(1L << b)) {
+            b++;
+        }
+        buckets[b]++;
+        if (buckets[b] > most) {
+            most = buckets[b];
+        }
+    }
+    for (int b = 0; b < 32; b++) {
+        if (buckets[b] > 0) {
+            printf("%8ld - %8ld us %9ld %.*s\n", b ? 1L << (b - 1) : 0L, 1L << b, buckets[b],
+                   (int)(50 * buckets[b] / most), "##################################################");
+        }
+    }
+    free(latency);
+}
+
+/**
+ * @brief The main function. It creates a shared memory segment, and then keeps generating random strings,
+ * putting them in the task ring, and collecting the strings processed by the workers.
+ * "bench [tasks [workers]]" starts the workers itself and measures the throughput instead, and
+ * "latency [tasks [workers]]" measures the round trip time of single tasks, and "stress [tasks [workers]]"
+ * checks that many workers process every task exactly once. "payload [workers]" measures the throughput
+ * for payloads of 100 bytes, 4 KiB and 1 MiB.
  * @param argc The number of command-line arguments.
  * @param argv An array of command-line arguments.
  * @return 0 on success, 1 on failure.
@@ -67,61 +607,73 @@ int main(int argc, char* argv[]) {
         exit(1);
     }
 
+    // A segment left behind by an older server may have a different size, so remove it first.
+    shmid = shmget(shmkey, 0, 0666);
+    if (shmid != -1) {
+        shmctl(shmid, IPC_RMID, NULL);
+    }
+
     // shmget() creates a new shared memory segment.
-    shmid = shmget(shmkey, sizeof(struct task), IPC_CREAT | 0666);
+    shmid = shmget(shmkey, sizeof(struct ring) + ARENA_SIZE, IPC_CREAT | 0666);
     if (shmid == -1) {
         perror("Server: shmget failed");
         exit(1);
     }
 
     // shmat() attaches the shared memory segment to the address space of the process.
-    solve = (struct task *)shmat(shmid, NULL, 0);
-    if (solve == (struct task *)-1) {
+    ring = (struct ring *)shmat(shmid, NULL, 0);
+    if (ring == (struct ring *)-1) {
         perror("shmat failed");
         exit(1);
     }
 
-    // Initialize the shared memory.
-    solve->status = 0;
+    // A new segment is zero-filled: all slots are free and the completion ring is empty.
+    ring->arena_size = ARENA_SIZE;
+    make_letters();
     printf("Shared memory initialized.\n");
 
-    while (1) {
-        // Wait until the worker is ready for a new task.
-        while(solve->status != 0 && solve->status != 4) {
-            sleep(1);
-            if(solve->status == -1) break;
+    if (argc > 1 && (strcmp(argv[1], "bench") == 0 || strcmp(argv[1], "latency") == 0
+                     || strcmp(argv[1], "stress") == 0 || strcmp(argv[1], "payload") == 0)) {
+        int latency = strcmp(argv[1], "latency") == 0, check = strcmp(argv[1], "stress") == 0;
+        int payload = strcmp(argv[1], "payload") == 0;
+        long tasks = payload ? 1 : argc > 2 ? atol(argv[2]) : (latency ? 10000 : check ? 1000000 : 100000);
+        int workers = payload ? (argc > 2 ? atoi(argv[2]) : 4) : argc > 3 ? atoi(argv[3]) : (latency ? 1 : check ? 32 : 8);
+        if (tasks < 1 || workers < 1 || workers > MAX_WORKERS) {
+            if (payload) {
+                fprintf(stderr, "Usage: %s payload [workers (1 to %d)]\n", argv[0], MAX_WORKERS);
+            } else {
+                fprintf(stderr, "Usage: %s %s [tasks [workers (1 to %d)]]\n", argv[0], argv[1], MAX_WORKERS);
+            }
+            cleanup(0);
         }
-        if(solve->status == -1) break;
-
-        // Generate a random string.
-        int len = (rand() % 20) + 1;
-        for (int i = 0; i < len; i++) {
-            solve->data[i] = 'a' + (rand() % 26);
-        }
-        solve->data[len] = '\0';
-
-        printf("Generated string: %s\n", solve->data);
-        // Set the status to 1 to indicate that a new task is available.
-        solve->status = 1;
 
-        // Wait for the worker to process the string.
-        while (solve->status != 3 && solve->status != -1) {
-            sleep(1);
+        // worker.out is expected next to server.out.
+        char worker_path[4096];
+        const char *slash = strrchr(argv[0], '/');
+        snprintf(worker_path, sizeof(worker_path), "%.*sworker.out", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+        if (latency) {
+            latency_bench(tasks, workers, worker_path);
+        } else if (payload) {
+            payload_bench(workers, worker_path);
+        } else if (check) {
+            // The second run has one worker stall, if there is another to carry on. Its 4 KiB
+            // payloads wrap around the arena while the stalled task holds its place.
+            if (!stress(tasks, workers, 0, 0, worker_path)
+                || (workers > 1 && !stress(tasks < 100000 ? tasks : 100000, workers, 1, 4096, worker_path))) {
+                atomic_store_explicit(&ring->terminate, 1, memory_order_release);
+                shmdt(ring);
+                shmctl(shmid, IPC_RMID, NULL);
+                return 1;
+            }
+        } else {
+            bench(tasks, workers, worker_path);
         }
-
-        if (solve->status == -1) break; // Exit if the server is terminating.
-
-        // The worker has processed the string and put the result in solve->data.
-        // In this example, the worker converts the string to uppercase.
-        printf("Worker PID %d processed string: %s\n", solve->worker_pid, solve->data);
-        // Set the status to 4 to indicate that the result has been consumed.
-        solve->status = 4;
-
-        sleep(2); // Wait before generating the next string.
+    } else {
+        serve(-1, RING_SLOTS, 0, 1, NULL);
     }
 
     printf("Server: Exiting main loop.\n");
     cleanup(0);
 
     return 0;
-}
\ No newline at end of file
+}
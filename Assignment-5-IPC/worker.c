@@ -1,37 +1,188 @@
 /**
  * @file worker.c
  * @brief This program is the worker in a client-server application that uses shared memory for inter-process communication.
- * The worker waits for the server to put a string in a shared memory segment, processes the string (in this case, by converting it to uppercase),
- * and then puts the result back in the shared memory.
+ * The worker claims tasks from the ring of task slots the server fills, processes the strings in place in the shared payload
+ * arena (in this case, by converting them to uppercase), and reports each finished task to the server through the completion ring. Any number of workers
+ * can run at the same time.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <ctype.h>
 
+#define RING_SLOTS 64       /**< The number of task slots, and of completion ring entries. */
+#define SPIN_TRIES 100      /**< How many times the worker looks for a task before it sleeps. */
+
 /**
- * @brief A structure to hold the data that will be shared between the server and worker processes.
+ * @brief The states of a task slot. See server.c.
+ */
+enum { SLOT_FREE = 0, SLOT_AVAILABLE = 1, SLOT_TAKEN = 2, SLOT_COMPLETE = 3, SLOT_FAILED = 4 };
+
+/**
+ * @brief A task slot.
  */
 struct task {
-    char data[100];     /**< The string to be processed. */
-    pid_t worker_pid;   /**< The PID of the worker process. */
-    int status;         /**< The status of the task. 0: idle, 1: task available, 2: task taken, 3: task complete, 4: result consumed, -1: terminate */
+    size_t offset;          /**< Where the payload to be processed starts in the arena. */
+    size_t length;          /**< The length of the payload in bytes. */
+    pid_t worker_pid;       /**< The PID of the worker process. */
+    unsigned id;            /**< The number of the task. */
+    _Atomic int status;     /**< The state of the slot: one of SLOT_FREE ... SLOT_FAILED. */
+};
+
+/*
+ * Memory ordering. offset, length, worker_pid, id and the payload bytes in the arena are plain
+ * data. At any moment exactly one process owns a task and its payload, and ownership is handed over through an atomic word with release/acquire ordering:
+ *
+ *  - The server fills a free slot, then stores SLOT_AVAILABLE with release.
+ *  - A worker claims the slot with a compare-and-swap from SLOT_AVAILABLE to SLOT_TAKEN with
+ *    acquire, so it sees everything the server wrote. Only one swap can succeed, so each task
+ *    is processed by exactly one worker. A worker reads the task only after its swap succeeded,
+ *    so a slot that was refilled in between (ABA) simply hands it the newer task.
+ *  - The worker writes the result, stores SLOT_COMPLETE (or SLOT_FAILED), and then stores the slot number in the
+ *    completion ring with release. The server reads the entry with acquire and sees the result.
+ *  - The server reads the result before it makes the slot free again and refills it, and the
+ *    next worker's acquire claim orders those writes after the previous worker's.
+ *
+ * Everything else (freeing a slot, clearing a completion entry, reserving one) only needs
+ * relaxed ordering, because one of the handovers above orders it already.
+ */
+
+/**
+ * @brief A structure to hold the data that will be shared between the server and worker processes.
+ * It must be the same in server.c.
+ */
+struct ring {
+    _Atomic int terminate;                  /**< Set to 1 when the server exits; the workers then exit too. */
+    _Atomic unsigned long processed;        /**< The tasks processed by workers that have exited. */
+    _Alignas(64) _Atomic unsigned task_seq; /**< Futex word the idle workers sleep on; bumped when tasks are posted. */
+    _Atomic int task_waiters;               /**< The number of workers sleeping (or about to sleep) on task_seq. */
+    _Alignas(64) _Atomic unsigned done_seq; /**< Futex word the idle server sleeps on; bumped when a task completes. */
+    _Atomic int done_waiters;               /**< 1 while the server sleeps (or is about to sleep) on done_seq. */
+    _Alignas(64) _Atomic unsigned done_tail; /**< The next completion ring entry a worker fills. */
+    _Atomic unsigned done[RING_SLOTS];      /**< The completion ring: slot number + 1 of each finished task, 0 if empty. */
+    struct task slots[RING_SLOTS];          /**< The task slots. */
+    size_t arena_size;                      /**< The size of the payload arena that follows this structure. */
 };
 
+/**
+ * @brief Returns the payload arena, which directly follows the ring in the shared segment.
+ * Payloads are found by their offset into it, so the segment may be attached at any address.
+ */
+static char *arena(struct ring *ring) {
+    return (char *)(ring + 1);
+}
+
+/*
+ * Waiting. A process that finds nothing to do checks a few more times and then sleeps on a
+ * futex word in the shared segment (a shared futex, not FUTEX_PRIVATE, so it works across
+ * processes). It first counts itself as a waiter and reads the word, then checks for work
+ * once more, and only then sleeps; the other side bumps the word and wakes it only when the
+ * waiter count is non-zero. A sequentially consistent fence on both sides, between publishing
+ * (work or waiter) and checking the other, makes sure that either the waiter sees the new
+ * work or the other side sees the waiter, so no wakeup is lost.
+ */
+
+static void futex_wait(_Atomic unsigned *word, unsigned seq) {
+    syscall(SYS_futex, word, FUTEX_WAIT, seq, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic unsigned *word, int n) {
+    syscall(SYS_futex, word, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+/**
+ * @brief Claims an available task.
+ * The worker looks at the slots starting where it last found a task, and claims one by changing its
+ * status from available to taken with a compare-and-swap. If another worker claimed it first, the
+ * swap fails and the search goes on.
+ * @param ring The shared ring.
+ * @param cursor Where to start looking; moved past the claimed slot.
+ * @return The claimed task, or NULL if no task is available.
+ */
+static struct task *claim_task(struct ring *ring, unsigned *cursor) {
+    for (unsigned n = 0; n < RING_SLOTS; n++) {
+        unsigned i = (*cursor + n) % RING_SLOTS;
+        struct task *t = &ring->slots[i];
+        int expected = SLOT_AVAILABLE;
+        // A plain load first, so busy slots are skipped without writing to their cache line.
+        if (atomic_load_explicit(&t->status, memory_order_relaxed) == SLOT_AVAILABLE
+            && atomic_compare_exchange_strong_explicit(&t->status, &expected, SLOT_TAKEN,
+                                                       memory_order_acquire, memory_order_relaxed)) {
+            *cursor = i + 1;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reports a finished task to the server.
+ * Each worker reserves the next completion ring entry with an atomic increment. At most RING_SLOTS
+ * tasks are unfinished at any time, so the entry has always been read by the server already.
+ * @param ring The shared ring.
+ * @param t The finished task.
+ * @param status SLOT_COMPLETE, or SLOT_FAILED if the task could not be processed.
+ */
+static void complete_task(struct ring *ring, struct task *t, int status) {
+    atomic_store_explicit(&t->status, status, memory_order_relaxed);
+    unsigned pos = atomic_fetch_add_explicit(&ring->done_tail, 1, memory_order_relaxed);
+    atomic_store_explicit(&ring->done[pos % RING_SLOTS], (unsigned)(t - ring->slots) + 1, memory_order_release);
+
+    // Wake the server if it sleeps waiting for finished tasks.
+    atomic_thread_fence(memory_order_seq_cst); // order the completion before reading the waiter flag
+    if (atomic_load_explicit(&ring->done_waiters, memory_order_relaxed)) {
+        atomic_fetch_add(&ring->done_seq, 1);
+        futex_wake(&ring->done_seq, 1);
+    }
+}
+
+/**
+ * @brief Sleeps until the server posts new tasks, unless a task can be claimed right away.
+ * @return The claimed task, or NULL after sleeping.
+ */
+static struct task *wait_for_task(struct ring *ring, unsigned *cursor) {
+    atomic_fetch_add_explicit(&ring->task_waiters, 1, memory_order_relaxed);
+    unsigned seq = atomic_load_explicit(&ring->task_seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst); // publish the waiter before looking for tasks
+    struct task *t = claim_task(ring, cursor);
+    if (t == NULL && !atomic_load_explicit(&ring->terminate, memory_order_acquire)) {
+        futex_wait(&ring->task_seq, seq);
+    }
+    atomic_fetch_sub_explicit(&ring->task_waiters, 1, memory_order_relaxed);
+    return t;
+}
+
 /**
  * @brief The main function. It attaches to the shared memory segment created by the server, and then enters a loop
- * where it waits for tasks from the server, processes them, and puts the results back in the shared memory.
+ * where it claims tasks from the server, processes them, and puts the results back in the shared memory.
+ * "-q" processes the tasks without printing them, and "-s ms" holds the first task for ms milliseconds,
+ * as a slow worker would.
  * @return 0 on success, 1 on failure.
  */
-int main() {
+int main(int argc, char *argv[]) {
     key_t shmkey;
     int shmid;
-    struct task *solve;
+    struct ring *ring;
+    int quiet = 0, stall_ms = 0;
+    unsigned cursor = getpid() % RING_SLOTS; // workers start looking at different slots
+    int spins = 0;
+    unsigned long processed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
+            quiet = 1;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            stall_ms = atoi(argv[++i]);
+        }
+    }
 
     // ftok() generates a key for the shared memory segment.
     // It must use the same file path and project ID as the server to get the same key.
@@ -42,46 +193,73 @@ int main() {
     }
 
     // shmget() gets the ID of the existing shared memory segment created by the server.
-    shmid = shmget(shmkey, sizeof(struct task), 0666);
+    // Size 0 accepts the segment whatever the size of its payload arena.
+    shmid = shmget(shmkey, 0, 0666);
     if (shmid == -1) {
         perror("Worker: shmget failed");
         exit(1);
     }
 
-    printf("Worker: Shared memory ID: %d\n", shmid);
+    if (!quiet) {
+        printf("Worker: Shared memory ID: %d\n", shmid);
+    }
 
     // shmat() attaches the shared memory segment to the address space of the process.
-    solve = (struct task *)shmat(shmid, NULL, 0);
-    if (solve == (struct task *)-1) {
+    ring = (struct ring *)shmat(shmid, NULL, 0);
+    if (ring == (struct ring *)-1) {
         perror("Worker: shmat failed");
         exit(1);
     }
 
-    printf("Worker: Attached to shared memory.\n");
+    if (!quiet) {
+        printf("Worker: Attached to shared memory.\n");
+    }
 
-    while (solve->status != -1) {
-        // Wait for the server to put data in the shared memory.
-        while (solve->status != 1 && solve->status != -1) {
-            sleep(1);
+    while (!atomic_load_explicit(&ring->terminate, memory_order_acquire)) {
+        // Claim a task the server put in the ring.
+        struct task *t = claim_task(ring, &cursor);
+        if (t == NULL) {
+            // No task: look again a few times, then sleep until the server posts one.
+            if (++spins < SPIN_TRIES || (t = wait_for_task(ring, &cursor)) == NULL) {
+                continue;
+            }
+        }
+        spins = 0;
+        if (stall_ms > 0) {
+            usleep(stall_ms * 1000);
+            stall_ms = 0;
         }
 
-        if (solve->status == -1) break; // Exit if the server is terminating.
-
-        // Process the string. In this case, convert it to uppercase.
-        solve->status = 2;
-        solve->worker_pid = getpid();
-        printf("Worker PID %d: Processing string: %s\n", solve->worker_pid, solve->data);
+        // Process the string in place in the arena. In this case, convert it to uppercase.
+        t->worker_pid = getpid();
+        if (t->offset > ring->arena_size || t->length > ring->arena_size - t->offset) {
+            // Leave the payload alone and let the server know the task failed.
+            fprintf(stderr, "Worker PID %d: task %u lies outside the arena.\n", getpid(), t->id);
+            complete_task(ring, t, SLOT_FAILED);
+            processed++;
+            continue;
+        }
+        char *data = arena(ring) + t->offset;
+        if (!quiet) {
+            printf("Worker PID %d: Processing string: %.*s\n", t->worker_pid, (int)t->length, data);
+        }
 
-        for (int i = 0; i < strlen(solve->data); i++) {
-            solve->data[i] = toupper(solve->data[i]);
+        for (size_t i = 0; i < t->length; i++) {
+            data[i] = toupper((unsigned char)data[i]);
         }
 
-        // Set the status to 3 to indicate that the task is complete.
-        solve->status = 3;
-        printf("Worker PID %d: String processing done.\n", solve->worker_pid);
+        // Report the task as complete.
+        complete_task(ring, t, SLOT_COMPLETE);
+        processed++;
+        if (!quiet) {
+            printf("Worker PID %d: String processing done.\n", getpid());
+        }
     }
 
-    printf("Worker PID %d: Exiting.\n", getpid());
-    shmdt(solve); // Detach the shared memory segment.
+    atomic_fetch_add_explicit(&ring->processed, processed, memory_order_relaxed);
+    if (!quiet) {
+        printf("Worker PID %d: Exiting.\n", getpid());
+    }
+    shmdt(ring); // Detach the shared memory segment.
     return 0;
-}
\ No newline at end of file
+}
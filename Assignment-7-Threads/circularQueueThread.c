@@ -6,35 +6,56 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
-#define MAX_QUEUE_SIZE 10
+#define DEFAULT_QUEUE_SIZE 16 // capacity of the manager's queue until it is changed from the menu
+#define MAX_QUEUE_SIZE (1 << 20)
+#define MAX_ITEMS 9 // items a producer makes or a consumer takes in one round
 #define MAX_PRODUCER_THREADS 10
 #define MAX_CONSUMER_THREADS 10
 #define MAX_SLEEP_TIME 5
+#define CACHE_LINE 64
+#define SPIN_TRIES 100 // failed attempts before a blocking call parks on the futex
 
 /**
  * @struct CircularQueue
  * @brief A thread-safe circular queue.
+ *
+ * The capacity is a power of two chosen at run time. front and rear count up forever and
+ * are masked into the heap-allocated items array, so every slot can be used and rear - front
+ * is the number of items. rear is written by producers and front by consumers, so they are
+ * kept on separate cache lines, away from the mutex.
  */
 typedef struct {
-    int items[MAX_QUEUE_SIZE];
-    int front, rear;
+    int *items;
+    unsigned mask; // capacity - 1
     pthread_mutex_t mutex;
     pthread_cond_t empty, full;
+    _Alignas(CACHE_LINE) unsigned rear;  // producers' index
+    _Alignas(CACHE_LINE) unsigned front; // consumers' index
 } CircularQueue;
 
 // Function prototypes
-void initQueue(CircularQueue *q);
+int initQueue(CircularQueue *q, unsigned capacity);
+void destroyQueue(CircularQueue *q);
 void enQ(CircularQueue *q, int item);
 int deQ(CircularQueue *q);
+int enQBatch(CircularQueue *q, const int *items, int n);
+int deQBatch(CircularQueue *q, int *items, int n);
 int isFull(CircularQueue *q);
 int isEmpty(CircularQueue *q);
 void clearResources();
 void deleteProducer();
 void deleteConsumer();
+void setCapacity();
 
 // Global variables
 CircularQueue queue;
@@ -43,15 +64,55 @@ pthread_t consumerThreads[MAX_CONSUMER_THREADS];
 pthread_t managerThread;
 int numProducers = 0, numConsumers = 0;
 
+/**
+ * @brief Rounds a capacity up to a power of two (at least 2).
+ */
+static size_t roundCapacity(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
 /**
  * @brief Initializes the circular queue.
  * @param q A pointer to the circular queue.
+ * @param capacity The number of items it can hold, rounded up to a power of two.
+ * @return 0 on success, -1 if the items cannot be allocated.
  */
-void initQueue(CircularQueue *q) {
+int initQueue(CircularQueue *q, unsigned capacity) {
+    size_t size = roundCapacity(capacity);
+    q->items = malloc(size * sizeof(int));
+    if (q->items == NULL) {
+        return -1;
+    }
+    q->mask = size - 1;
     q->front = q->rear = 0;
     pthread_mutex_init(&q->mutex, NULL);
     pthread_cond_init(&q->empty, NULL);
     pthread_cond_init(&q->full, NULL);
+    return 0;
+}
+
+/**
+ * @brief Frees the items and the synchronization objects of the circular queue.
+ * @param q A pointer to the circular queue.
+ */
+void destroyQueue(CircularQueue *q) {
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->empty);
+    pthread_cond_destroy(&q->full);
+    free(q->items);
+    q->items = NULL;
+}
+
+/**
+ * @brief Releases a mutex; the cancellation cleanup handler of the waits below.
+ * @param mutex The mutex to release.
+ */
+static void unlockMutex(void *mutex) {
+    pthread_mutex_unlock((pthread_mutex_t *)mutex);
 }
 
 /**
@@ -61,11 +122,13 @@ void initQueue(CircularQueue *q) {
  */
 void enQ(CircularQueue *q, int item) {
     pthread_mutex_lock(&q->mutex);
+    pthread_cleanup_push(unlockMutex, &q->mutex); // a thread cancelled while waiting must not keep the lock
     while (isFull(q)) {
         pthread_cond_wait(&q->full, &q->mutex);
     }
-    q->items[q->rear] = item;
-    q->rear = (q->rear + 1) % MAX_QUEUE_SIZE;
+    pthread_cleanup_pop(0);
+    q->items[q->rear & q->mask] = item;
+    q->rear++;
     pthread_cond_signal(&q->empty);
     pthread_mutex_unlock(&q->mutex);
 }
@@ -77,23 +140,103 @@ void enQ(CircularQueue *q, int item) {
  */
 int deQ(CircularQueue *q) {
     pthread_mutex_lock(&q->mutex);
+    pthread_cleanup_push(unlockMutex, &q->mutex); // a thread cancelled while waiting must not keep the lock
     while (isEmpty(q)) {
         pthread_cond_wait(&q->empty, &q->mutex);
     }
-    int item = q->items[q->front];
-    q->front = (q->front + 1) % MAX_QUEUE_SIZE;
+    pthread_cleanup_pop(0);
+    int item = q->items[q->front & q->mask];
+    q->front++;
     pthread_cond_signal(&q->full);
     pthread_mutex_unlock(&q->mutex);
     return item;
 }
 
+/**
+ * @brief Adds up to n items under one lock acquisition, waiting only while the queue is full.
+ * The items are copied with at most two memcpy calls (before and after the wrap point),
+ * and waiting consumers are woken once for the whole batch.
+ * @param q A pointer to the circular queue.
+ * @param items The items to add.
+ * @param n The number of items.
+ * @return The number of items added (at least 1 when n > 0); the caller retries with the rest.
+ */
+int enQBatch(CircularQueue *q, const int *items, int n) {
+    if (n <= 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&q->mutex);
+    pthread_cleanup_push(unlockMutex, &q->mutex); // a thread cancelled while waiting must not keep the lock
+    while (isFull(q)) {
+        pthread_cond_wait(&q->full, &q->mutex);
+    }
+    pthread_cleanup_pop(0);
+    unsigned start = q->rear & q->mask;
+    int count = q->mask + 1 - (q->rear - q->front); // free slots
+    if (count > n) {
+        count = n;
+    }
+    int first = q->mask + 1 - start; // slots before the wrap point
+    if (first > count) {
+        first = count;
+    }
+    memcpy(&q->items[start], items, first * sizeof(int));
+    memcpy(q->items, items + first, (count - first) * sizeof(int));
+    q->rear += count;
+    if (count == 1) {
+        pthread_cond_signal(&q->empty);
+    } else {
+        pthread_cond_broadcast(&q->empty); // there may be work for several consumers
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return count;
+}
+
+/**
+ * @brief Removes up to n items under one lock acquisition, waiting only while the queue is empty.
+ * @param q A pointer to the circular queue.
+ * @param items Where to store the items removed.
+ * @param n The most items to remove.
+ * @return The number of items removed (at least 1 when n > 0).
+ */
+int deQBatch(CircularQueue *q, int *items, int n) {
+    if (n <= 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&q->mutex);
+    pthread_cleanup_push(unlockMutex, &q->mutex); // a thread cancelled while waiting must not keep the lock
+    while (isEmpty(q)) {
+        pthread_cond_wait(&q->empty, &q->mutex);
+    }
+    pthread_cleanup_pop(0);
+    unsigned start = q->front & q->mask;
+    int count = q->rear - q->front; // items present
+    if (count > n) {
+        count = n;
+    }
+    int first = q->mask + 1 - start;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(items, &q->items[start], first * sizeof(int));
+    memcpy(items + first, q->items, (count - first) * sizeof(int));
+    q->front += count;
+    if (count == 1) {
+        pthread_cond_signal(&q->full);
+    } else {
+        pthread_cond_broadcast(&q->full);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return count;
+}
+
 /**
  * @brief Checks if the queue is full.
  * @param q A pointer to the circular queue.
  * @return 1 if the queue is full, 0 otherwise.
  */
 int isFull(CircularQueue *q) {
-    return ((q->rear + 1) % MAX_QUEUE_SIZE == q->front);
+    return q->rear - q->front == q->mask + 1;
 }
 
 /**
@@ -105,6 +248,345 @@ int isEmpty(CircularQueue *q) {
     return (q->front == q->rear);
 }
 
+/*
+ * Lock-free ring buffers.
+ *
+ * LockFreeQueue is a bounded multi-producer/multi-consumer ring after Dmitry Vyukov's design.
+ * Every slot carries a sequence number that says whose turn it is: a slot at position pos is
+ * free for the producer of pos when seq == pos and holds an item for the consumer of pos when
+ * seq == pos + 1. Producers and consumers claim positions with one CAS on enqPos/deqPos and
+ * hand the slot over with a release store of seq, so no lock is ever taken.
+ *
+ * SpscQueue is the single-producer/single-consumer special case: no CAS at all, each side
+ * owns its own index and keeps a cached copy of the other one to avoid touching its line.
+ *
+ * The try functions never block. The blocking ones spin for SPIN_TRIES attempts and then
+ * park on a futex, only when the queue is really empty or full.
+ */
+
+/**
+ * @struct FutexWait
+ * @brief An event count: waiters sleep on seq, notifiers bump it, but only when someone waits.
+ */
+typedef struct {
+    atomic_uint seq;
+    atomic_int waiters;
+} FutexWait;
+
+/**
+ * @struct LFCell
+ * @brief One slot of a LockFreeQueue.
+ */
+typedef struct {
+    atomic_size_t seq;
+    int item;
+} LFCell;
+
+/**
+ * @struct LockFreeQueue
+ * @brief A lock-free MPMC circular queue with a power-of-two capacity.
+ */
+typedef struct {
+    LFCell *cells;
+    size_t mask;
+    _Alignas(CACHE_LINE) atomic_size_t enqPos; // producers' line
+    _Alignas(CACHE_LINE) atomic_size_t deqPos; // consumers' line
+    _Alignas(CACHE_LINE) FutexWait notEmpty;
+    _Alignas(CACHE_LINE) FutexWait notFull;
+} LockFreeQueue;
+
+/**
+ * @struct SpscQueue
+ * @brief A lock-free circular queue for exactly one producer and one consumer.
+ */
+typedef struct {
+    int *items;
+    size_t mask;
+    _Alignas(CACHE_LINE) atomic_size_t head; // written by the consumer
+    size_t cachedTail;
+    _Alignas(CACHE_LINE) atomic_size_t tail; // written by the producer
+    size_t cachedHead;
+    _Alignas(CACHE_LINE) FutexWait notEmpty;
+    _Alignas(CACHE_LINE) FutexWait notFull;
+} SpscQueue;
+
+static inline void cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    sched_yield();
+#endif
+}
+
+/**
+ * @brief Announces a waiter; the caller must recheck its condition before waitCommit().
+ * @return The sequence to pass to waitCommit().
+ */
+static unsigned waitBegin(FutexWait *w) {
+    atomic_fetch_add(&w->waiters, 1);
+    return atomic_load(&w->seq);
+}
+
+/**
+ * @brief Sleeps unless a notification arrived after waitBegin(), then withdraws the waiter.
+ */
+static void waitCommit(FutexWait *w, unsigned seq) {
+    syscall(SYS_futex, &w->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+    atomic_fetch_sub(&w->waiters, 1);
+}
+
+/**
+ * @brief Withdraws a waiter whose condition became true after waitBegin().
+ */
+static void waitCancel(FutexWait *w) {
+    atomic_fetch_sub(&w->waiters, 1);
+}
+
+/**
+ * @brief Wakes one waiter, if any. Costs one shared load when nobody waits.
+ */
+static void notify(FutexWait *w) {
+    atomic_thread_fence(memory_order_seq_cst); // order the queue update before reading waiters
+    if (atomic_load_explicit(&w->waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&w->seq, 1);
+        syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * @brief Initializes a lock-free MPMC queue.
+ * @param q A pointer to the queue.
+ * @param capacity The requested capacity, rounded up to a power of two.
+ * @return 0 on success, -1 if the slots cannot be allocated.
+ */
+int initLFQueue(LockFreeQueue *q, size_t capacity) {
+    size_t size = roundCapacity(capacity);
+    q->cells = malloc(size * sizeof(LFCell));
+    if (q->cells == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+    }
+    q->mask = size - 1;
+    atomic_init(&q->enqPos, 0);
+    atomic_init(&q->deqPos, 0);
+    atomic_init(&q->notEmpty.seq, 0);
+    atomic_init(&q->notEmpty.waiters, 0);
+    atomic_init(&q->notFull.seq, 0);
+    atomic_init(&q->notFull.waiters, 0);
+    return 0;
+}
+
+/**
+ * @brief Frees the slots of a lock-free MPMC queue.
+ */
+void destroyLFQueue(LockFreeQueue *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+/**
+ * @brief Adds an item unless the queue is full.
+ * @return 1 if the item was added, 0 if the queue is full.
+ */
+int lfTryEnQ(LockFreeQueue *q, int item) {
+    size_t pos = atomic_load_explicit(&q->enqPos, memory_order_relaxed);
+    LFCell *cell;
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqPos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0; // the slot still holds the item of the previous lap
+        } else {
+            pos = atomic_load_explicit(&q->enqPos, memory_order_relaxed);
+        }
+    }
+    cell->item = item;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * @brief Removes an item unless the queue is empty.
+ * @return 1 if an item was removed into *item, 0 if the queue is empty.
+ */
+int lfTryDeQ(LockFreeQueue *q, int *item) {
+    size_t pos = atomic_load_explicit(&q->deqPos, memory_order_relaxed);
+    LFCell *cell;
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->deqPos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0; // the producer of this position has not finished yet
+        } else {
+            pos = atomic_load_explicit(&q->deqPos, memory_order_relaxed);
+        }
+    }
+    *item = cell->item;
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * @brief Adds an item, waiting while the queue is full.
+ */
+void lfEnQ(LockFreeQueue *q, int item) {
+    for (int spins = 0; !lfTryEnQ(q, item); spins++) {
+        if (spins < SPIN_TRIES) {
+            cpuRelax();
+            continue;
+        }
+        unsigned seq = waitBegin(&q->notFull);
+        if (lfTryEnQ(q, item)) {
+            waitCancel(&q->notFull);
+            break;
+        }
+        waitCommit(&q->notFull, seq);
+    }
+    notify(&q->notEmpty);
+}
+
+/**
+ * @brief Removes an item, waiting while the queue is empty.
+ * @return The item removed from the queue.
+ */
+int lfDeQ(LockFreeQueue *q) {
+    int item;
+    for (int spins = 0; !lfTryDeQ(q, &item); spins++) {
+        if (spins < SPIN_TRIES) {
+            cpuRelax();
+            continue;
+        }
+        unsigned seq = waitBegin(&q->notEmpty);
+        if (lfTryDeQ(q, &item)) {
+            waitCancel(&q->notEmpty);
+            break;
+        }
+        waitCommit(&q->notEmpty, seq);
+    }
+    notify(&q->notFull);
+    return item;
+}
+
+/**
+ * @brief Initializes a single-producer/single-consumer queue.
+ * @param q A pointer to the queue.
+ * @param capacity The requested capacity, rounded up to a power of two.
+ * @return 0 on success, -1 if the buffer cannot be allocated.
+ */
+int initSpscQueue(SpscQueue *q, size_t capacity) {
+    size_t size = roundCapacity(capacity);
+    q->items = malloc(size * sizeof(int));
+    if (q->items == NULL) {
+        return -1;
+    }
+    q->mask = size - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->cachedHead = q->cachedTail = 0;
+    atomic_init(&q->notEmpty.seq, 0);
+    atomic_init(&q->notEmpty.waiters, 0);
+    atomic_init(&q->notFull.seq, 0);
+    atomic_init(&q->notFull.waiters, 0);
+    return 0;
+}
+
+/**
+ * @brief Frees the buffer of a single-producer/single-consumer queue.
+ */
+void destroySpscQueue(SpscQueue *q) {
+    free(q->items);
+    q->items = NULL;
+}
+
+/**
+ * @brief Adds an item unless the queue is full. Only the producer thread may call this.
+ * @return 1 if the item was added, 0 if the queue is full.
+ */
+int spscTryEnQ(SpscQueue *q, int item) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - q->cachedHead > q->mask) {
+        q->cachedHead = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail - q->cachedHead > q->mask) {
+            return 0;
+        }
+    }
+    q->items[tail & q->mask] = item;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * @brief Removes an item unless the queue is empty. Only the consumer thread may call this.
+ * @return 1 if an item was removed into *item, 0 if the queue is empty.
+ */
+int spscTryDeQ(SpscQueue *q, int *item) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == q->cachedTail) {
+        q->cachedTail = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (head == q->cachedTail) {
+            return 0;
+        }
+    }
+    *item = q->items[head & q->mask];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * @brief Adds an item, waiting while the queue is full.
+ */
+void spscEnQ(SpscQueue *q, int item) {
+    for (int spins = 0; !spscTryEnQ(q, item); spins++) {
+        if (spins < SPIN_TRIES) {
+            cpuRelax();
+            continue;
+        }
+        unsigned seq = waitBegin(&q->notFull);
+        if (spscTryEnQ(q, item)) {
+            waitCancel(&q->notFull);
+            break;
+        }
+        waitCommit(&q->notFull, seq);
+    }
+    notify(&q->notEmpty);
+}
+
+/**
+ * @brief Removes an item, waiting while the queue is empty.
+ * @return The item removed from the queue.
+ */
+int spscDeQ(SpscQueue *q) {
+    int item;
+    for (int spins = 0; !spscTryDeQ(q, &item); spins++) {
+        if (spins < SPIN_TRIES) {
+            cpuRelax();
+            continue;
+        }
+        unsigned seq = waitBegin(&q->notEmpty);
+        if (spscTryDeQ(q, &item)) {
+            waitCancel(&q->notEmpty);
+            break;
+        }
+        waitCommit(&q->notEmpty, seq);
+    }
+    notify(&q->notFull);
+    return item;
+}
+
 /**
  * @brief The producer thread function. It produces random items and adds them to the queue.
  * @param data A pointer to the producer's ID.
@@ -112,14 +594,20 @@ int isEmpty(CircularQueue *q) {
  */
 void *producer(void *data) {
     int producerId = *((int *)data);
+    int items[MAX_ITEMS];
     while (1) {
         srand(time(NULL));
-        int numItems = rand() % (MAX_QUEUE_SIZE - 1) + 1;
+        int numItems = rand() % MAX_ITEMS + 1;
         printf("\n");
         for (int i = 0; i < numItems; ++i) {
-            int item = rand() % 100;
-            enQ(&queue, item);
-            printf("Producer %d produced %d/%d item: %d\n", producerId, i + 1, numItems, item);
+            items[i] = rand() % 100;
+        }
+        for (int done = 0; done < numItems;) {
+            int added = enQBatch(&queue, items + done, numItems - done);
+            for (int i = done; i < done + added; ++i) {
+                printf("Producer %d produced %d/%d item: %d\n", producerId, i + 1, numItems, items[i]);
+            }
+            done += added;
         }
         sleep(rand() % MAX_SLEEP_TIME + 1);
     }
@@ -134,12 +622,16 @@ void *producer(void *data) {
 void *consumer(void *data) {
     srand(time(NULL));
     int consumerId = *((int *)data);
+    int items[MAX_ITEMS];
     while (1) {
-        int numItems = rand() % (MAX_QUEUE_SIZE - 1) + 1;
+        int numItems = rand() % MAX_ITEMS + 1;
         printf("\n");
-        for (int i = 0; i < numItems; ++i) {
-            int item = deQ(&queue);
-            printf("Consumer %d consumed %d/%d item: %d\n", consumerId, i + 1, numItems, item);
+        for (int done = 0; done < numItems;) {
+            int removed = deQBatch(&queue, items, numItems - done);
+            for (int i = 0; i < removed; ++i) {
+                printf("Consumer %d consumed %d/%d item: %d\n", consumerId, done + i + 1, numItems, items[i]);
+            }
+            done += removed;
         }
         sleep(rand() % MAX_SLEEP_TIME + 1);
     }
@@ -156,9 +648,14 @@ void clearResources() {
     for (int i = 0; i < numConsumers; ++i) {
         pthread_cancel(consumerThreads[i]);
     }
-    pthread_mutex_destroy(&queue.mutex);
-    pthread_cond_destroy(&queue.empty);
-    pthread_cond_destroy(&queue.full);
+    // Wait for them to exit, so that none of them still uses the queue or holds its lock.
+    for (int i = 0; i < numProducers; ++i) {
+        pthread_join(producerThreads[i], NULL);
+    }
+    for (int i = 0; i < numConsumers; ++i) {
+        pthread_join(consumerThreads[i], NULL);
+    }
+    destroyQueue(&queue);
     printf("All threads and resources cleared.\n");
     numProducers = 0;
     numConsumers = 0;
@@ -170,6 +667,7 @@ void clearResources() {
 void deleteProducer() {
     if (numProducers > 0) {
         pthread_cancel(producerThreads[numProducers - 1]);
+        pthread_join(producerThreads[numProducers - 1], NULL);
         printf("Producer thread %d deleted.\n", numProducers);
         numProducers--;
     } else {
@@ -183,6 +681,7 @@ void deleteProducer() {
 void deleteConsumer() {
     if (numConsumers > 0) {
         pthread_cancel(consumerThreads[numConsumers - 1]);
+        pthread_join(consumerThreads[numConsumers - 1], NULL);
         printf("Consumer thread %d deleted.\n", numConsumers);
         numConsumers--;
     } else {
@@ -190,6 +689,30 @@ void deleteConsumer() {
     }
 }
 
+/**
+ * @brief Replaces the queue with an empty one of a new capacity. Only allowed while no
+ * producer or consumer thread is using it; deleted threads have already been joined.
+ */
+void setCapacity() {
+    unsigned capacity;
+    if (numProducers > 0 || numConsumers > 0) {
+        printf("Delete all producer and consumer threads before changing the capacity.\n");
+        return;
+    }
+    printf("Enter the new capacity (rounded up to a power of two, at most %d): ", MAX_QUEUE_SIZE);
+    if (scanf("%u", &capacity) != 1 || capacity < 1 || capacity > MAX_QUEUE_SIZE) {
+        printf("Invalid capacity!\n");
+        return;
+    }
+    destroyQueue(&queue);
+    if (initQueue(&queue, capacity) == -1) {
+        printf("Cannot allocate a queue of %u items, keeping %d.\n", capacity, DEFAULT_QUEUE_SIZE);
+        initQueue(&queue, DEFAULT_QUEUE_SIZE);
+        return;
+    }
+    printf("The queue now holds %u items.\n", queue.mask + 1);
+}
+
 /**
  * @brief The manager thread function. It provides a menu-driven interface to add, remove, and clear producer and consumer threads.
  * @param data Not used.
@@ -205,6 +728,7 @@ void *manager(void *data) {
         printf("3. Delete Producer\n");
         printf("4. Delete Consumer\n");
         printf("5. Clear All Threads, Resources and Exit.\n");
+        printf("6. Set Queue Capacity (currently %u)\n", queue.mask + 1);
         printf("Enter your choice: ");
         scanf(" %c", &choice);
 
@@ -231,6 +755,9 @@ void *manager(void *data) {
         case '4':
             deleteConsumer();
             break;
+        case '6':
+            setCapacity();
+            break;
         case '5':
             clearResources();
             printf("Exiting manager thread.\n");
@@ -243,12 +770,363 @@ void *manager(void *data) {
     return NULL;
 }
 
+/*
+ * Benchmark: P producers push the numbers 1..items between them and C consumers pop them,
+ * through each kind of queue. The consumers' sums are checked against the expected total.
+ */
+
+/**
+ * @struct BenchQueue
+ * @brief One queue under test, seen through its blocking operations.
+ */
+typedef struct {
+    const char *name;
+    void *q;
+    void (*enq)(void *q, int item);
+    int (*deq)(void *q);
+} BenchQueue;
+
+/**
+ * @struct BenchArg
+ * @brief The share of the work given to one benchmark thread.
+ */
+typedef struct {
+    BenchQueue *bq;
+    long first, count; // producers push first, first + 1, ..., consumers pop count items
+    long long sum;
+} BenchArg;
+
+static void mutexEnQ(void *q, int item) { enQ(q, item); }
+static int mutexDeQ(void *q) { return deQ(q); }
+static void mpmcEnQ(void *q, int item) { lfEnQ(q, item); }
+static int mpmcDeQ(void *q) { return lfDeQ(q); }
+static void spscEnQItem(void *q, int item) { spscEnQ(q, item); }
+static int spscDeQItem(void *q) { return spscDeQ(q); }
+
+static void *benchProducer(void *data) {
+    BenchArg *a = data;
+    for (long i = 0; i < a->count; i++) {
+        a->bq->enq(a->bq->q, (int)(a->first + i));
+    }
+    return NULL;
+}
+
+static void *benchConsumer(void *data) {
+    BenchArg *a = data;
+    a->sum = 0;
+    for (long i = 0; i < a->count; i++) {
+        a->sum += a->bq->deq(a->bq->q);
+    }
+    return NULL;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Runs one queue with the given numbers of producers and consumers and prints ops/sec.
+ * @return 0 if every item was consumed exactly once, -1 otherwise.
+ */
+static int runBench(BenchQueue *bq, int producers, int consumers, long items) {
+    pthread_t threads[MAX_PRODUCER_THREADS + MAX_CONSUMER_THREADS];
+    BenchArg args[MAX_PRODUCER_THREADS + MAX_CONSUMER_THREADS];
+    long long sum = 0, expected = (long long)items * (items + 1) / 2;
+    double start = seconds();
+
+    for (int i = 0; i < producers; i++) {
+        args[i].bq = bq;
+        args[i].first = 1 + items / producers * i;
+        args[i].count = i == producers - 1 ? items - items / producers * i : items / producers;
+        pthread_create(&threads[i], NULL, benchProducer, &args[i]);
+    }
+    for (int i = 0; i < consumers; i++) {
+        BenchArg *a = &args[producers + i];
+        a->bq = bq;
+        a->count = i == consumers - 1 ? items - items / consumers * i : items / consumers;
+        pthread_create(&threads[producers + i], NULL, benchConsumer, a);
+    }
+    for (int i = 0; i < producers + consumers; i++) {
+        pthread_join(threads[i], NULL);
+        if (i >= producers) {
+            sum += args[i].sum;
+        }
+    }
+    double elapsed = seconds() - start;
+
+    printf("%-16s %4d %4d %14.0f%s\n", bq->name, producers, consumers, items / elapsed,
+           sum == expected ? "" : "  LOST OR DUPLICATED ITEMS");
+    return sum == expected ? 0 : -1;
+}
+
+/**
+ * @brief Compares the mutex CircularQueue with the lock-free queues.
+ * @param producers Producer threads (0 runs 1x1, 2x2 and 4x4).
+ * @param consumers Consumer threads.
+ * @param items Items pushed through each queue.
+ * @param capacity Capacity of every queue.
+ * @return 0 on success, -1 if a queue lost or duplicated items.
+ */
+static int benchQueues(int producers, int consumers, long items, size_t capacity) {
+    CircularQueue cq;
+    LockFreeQueue *mpmc = aligned_alloc(CACHE_LINE, sizeof(LockFreeQueue));
+    SpscQueue *spsc = aligned_alloc(CACHE_LINE, sizeof(SpscQueue));
+    int config[][2] = {{1, 1}, {2, 2}, {4, 4}};
+    int nconfig = 3, status = 0;
+
+    if (mpmc == NULL || spsc == NULL || initLFQueue(mpmc, capacity) == -1 ||
+        initSpscQueue(spsc, capacity) == -1 || initQueue(&cq, capacity) == -1) {
+        perror("benchQueues");
+        return -1;
+    }
+    if (producers > 0) {
+        config[0][0] = producers;
+        config[0][1] = consumers;
+        nconfig = 1;
+    }
+
+    BenchQueue mutexQ = {"mutex+condvar", &cq, mutexEnQ, mutexDeQ};
+    BenchQueue mpmcQ = {"lock-free MPMC", mpmc, mpmcEnQ, mpmcDeQ};
+    BenchQueue spscQ = {"lock-free SPSC", spsc, spscEnQItem, spscDeQItem};
+
+    printf("%ld items, every queue holds %u\n", items, cq.mask + 1);
+    printf("%-16s %4s %4s %14s\n", "queue", "prod", "cons", "ops/sec");
+    for (int i = 0; i < nconfig; i++) {
+        status |= runBench(&mutexQ, config[i][0], config[i][1], items);
+        status |= runBench(&mpmcQ, config[i][0], config[i][1], items);
+        if (config[i][0] == 1 && config[i][1] == 1) {
+            status |= runBench(&spscQ, 1, 1, items);
+        }
+    }
+
+    destroyQueue(&cq);
+    destroyLFQueue(mpmc);
+    destroySpscQueue(spsc);
+    free(mpmc);
+    free(spsc);
+    return status;
+}
+
+/**
+ * @struct BatchArg
+ * @brief The share of the work given to one thread of the batch benchmark.
+ */
+typedef struct {
+    CircularQueue *q;
+    long first, count;
+    int batch;
+    long long sum;
+} BatchArg;
+
+static void *batchProducer(void *data) {
+    BatchArg *a = data;
+    int *items = malloc(a->batch * sizeof(int));
+    for (long i = 0; i < a->count;) {
+        int n = a->count - i < a->batch ? (int)(a->count - i) : a->batch;
+        for (int j = 0; j < n; j++) {
+            items[j] = (int)(a->first + i + j);
+        }
+        for (int done = 0; done < n;) {
+            done += enQBatch(a->q, items + done, n - done);
+        }
+        i += n;
+    }
+    free(items);
+    return NULL;
+}
+
+static void *batchConsumer(void *data) {
+    BatchArg *a = data;
+    int *items = malloc(a->batch * sizeof(int));
+    a->sum = 0;
+    for (long i = 0; i < a->count;) {
+        int want = a->count - i < a->batch ? (int)(a->count - i) : a->batch;
+        int got = deQBatch(a->q, items, want);
+        for (int j = 0; j < got; j++) {
+            a->sum += items[j];
+        }
+        i += got;
+    }
+    free(items);
+    return NULL;
+}
+
+/**
+ * @brief Moves items through a CircularQueue with batches of 1, 2, 4, ..., 256 and prints ops/sec.
+ * @return 0 on success, -1 if items were lost or duplicated.
+ */
+static int benchBatches(int producers, int consumers, long items, unsigned capacity) {
+    pthread_t threads[MAX_PRODUCER_THREADS + MAX_CONSUMER_THREADS];
+    BatchArg args[MAX_PRODUCER_THREADS + MAX_CONSUMER_THREADS];
+    long long expected = (long long)items * (items + 1) / 2;
+    double base = 0;
+    int status = 0;
+
+    printf("%ld items, %d producers, %d consumers, CircularQueue holds %zu\n",
+           items, producers, consumers, roundCapacity(capacity));
+    printf("%6s %14s %8s\n", "batch", "ops/sec", "speedup");
+    for (int batch = 1; batch <= 256; batch *= 2) {
+        CircularQueue cq;
+        long long sum = 0;
+        if (initQueue(&cq, capacity) == -1) {
+            perror("benchBatches");
+            return -1;
+        }
+        double start = seconds();
+        for (int i = 0; i < producers + consumers; i++) {
+            int isProducer = i < producers;
+            int k = isProducer ? i : i - producers, n = isProducer ? producers : consumers;
+            args[i].q = &cq;
+            args[i].batch = batch;
+            args[i].first = 1 + items / n * k;
+            args[i].count = k == n - 1 ? items - items / n * k : items / n;
+            pthread_create(&threads[i], NULL, isProducer ? batchProducer : batchConsumer, &args[i]);
+        }
+        for (int i = 0; i < producers + consumers; i++) {
+            pthread_join(threads[i], NULL);
+            if (i >= producers) {
+                sum += args[i].sum;
+            }
+        }
+        double rate = items / (seconds() - start);
+        if (batch == 1) {
+            base = rate;
+        }
+        printf("%6d %14.0f %7.1fx%s\n", batch, rate, rate / base,
+               sum == expected ? "" : "  LOST OR DUPLICATED ITEMS");
+        status |= sum == expected ? 0 : -1;
+        destroyQueue(&cq);
+    }
+    return status;
+}
+
+/*
+ * False-sharing microbenchmark: two threads each advance their own index, like a producer
+ * moving rear and a consumer moving front, first with both indices in one cache line (the
+ * old CircularQueue layout) and then with each index on its own line (the current one).
+ * On a machine with several cores the shared line bounces between them on every write.
+ */
+
+/**
+ * @struct PackedIndices
+ * @brief rear and front side by side in one cache line.
+ */
+typedef struct {
+    atomic_ulong rear, front;
+} PackedIndices;
+
+/**
+ * @struct PaddedIndices
+ * @brief rear and front on separate cache lines, as in CircularQueue.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_ulong rear;
+    _Alignas(CACHE_LINE) atomic_ulong front;
+} PaddedIndices;
+
+/**
+ * @struct IndexArg
+ * @brief The index one thread of the false-sharing benchmark advances.
+ */
+typedef struct {
+    atomic_ulong *index;
+    long iterations;
+} IndexArg;
+
+static void *advanceIndex(void *data) {
+    IndexArg *a = data;
+    for (long i = 0; i < a->iterations; i++) {
+        // a single writer: a plain load and store, as a queue index is updated
+        unsigned long v = atomic_load_explicit(a->index, memory_order_relaxed);
+        atomic_store_explicit(a->index, v + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Times two threads advancing rear and front, and returns nanoseconds per update.
+ */
+static double timeIndices(atomic_ulong *rear, atomic_ulong *front, long iterations) {
+    pthread_t producerIndex, consumerIndex;
+    IndexArg a = {rear, iterations}, b = {front, iterations};
+    atomic_store(rear, 0);
+    atomic_store(front, 0);
+    double start = seconds();
+    pthread_create(&producerIndex, NULL, advanceIndex, &a);
+    pthread_create(&consumerIndex, NULL, advanceIndex, &b);
+    pthread_join(producerIndex, NULL);
+    pthread_join(consumerIndex, NULL);
+    return (seconds() - start) * 1e9 / iterations;
+}
+
+/**
+ * @brief Compares the packed and the padded index layouts.
+ * @param iterations Updates made by each of the two threads.
+ */
+static void benchFalseSharing(long iterations) {
+    PackedIndices *packed = aligned_alloc(CACHE_LINE, sizeof(PackedIndices));
+    PaddedIndices *padded = aligned_alloc(CACHE_LINE, sizeof(PaddedIndices));
+    if (packed == NULL || padded == NULL) {
+        perror("benchFalseSharing");
+        free(packed);
+        free(padded);
+        return;
+    }
+    double shared = timeIndices(&packed->rear, &packed->front, iterations);
+    double separate = timeIndices(&padded->rear, &padded->front, iterations);
+    printf("%ld updates per thread, %ld CPUs online\n", iterations, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-28s %10s\n", "layout", "ns/update");
+    printf("%-28s %10.2f\n", "rear/front in one line", shared);
+    printf("%-28s %10.2f\n", "rear/front on separate lines", separate);
+    printf("speedup from padding: %.2fx\n", shared / separate);
+    free(packed);
+    free(padded);
+}
+
 /**
  * @brief The main function. It initializes the queue and creates the manager thread.
+ *        "bench [producers consumers [items [capacity]]]" runs the queue benchmark instead,
+ *        "batchbench [producers consumers [items [capacity]]]" the enQBatch/deQBatch benchmark
+ *        and "sharebench [iterations]" the false-sharing benchmark.
  * @return 0 on success.
  */
-int main() {
-    initQueue(&queue);
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        int producers = argc > 3 ? atoi(argv[2]) : 0;
+        int consumers = argc > 3 ? atoi(argv[3]) : 0;
+        long items = argc > 4 ? atol(argv[4]) : 1000000;
+        long capacity = argc > 5 ? atol(argv[5]) : DEFAULT_QUEUE_SIZE;
+        if (producers < 0 || producers > MAX_PRODUCER_THREADS || consumers > MAX_CONSUMER_THREADS ||
+            (producers > 0 && consumers < 1) || items < 1 || capacity < 1 || capacity > MAX_QUEUE_SIZE) {
+            printf("Usage: %s bench [producers consumers [items [capacity]]]\n", argv[0]);
+            return 1;
+        }
+        return benchQueues(producers, consumers, items, capacity) == 0 ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "batchbench") == 0) {
+        int producers = argc > 3 ? atoi(argv[2]) : 1;
+        int consumers = argc > 3 ? atoi(argv[3]) : 1;
+        long items = argc > 4 ? atol(argv[4]) : 1000000;
+        long capacity = argc > 5 ? atol(argv[5]) : 1024;
+        if (producers < 1 || producers > MAX_PRODUCER_THREADS || consumers < 1 ||
+            consumers > MAX_CONSUMER_THREADS || items < 1 || capacity < 1 || capacity > MAX_QUEUE_SIZE) {
+            printf("Usage: %s batchbench [producers consumers [items [capacity]]]\n", argv[0]);
+            return 1;
+        }
+        return benchBatches(producers, consumers, items, capacity) == 0 ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "sharebench") == 0) {
+        long iterations = argc > 2 ? atol(argv[2]) : 100000000;
+        benchFalseSharing(iterations > 0 ? iterations : 100000000);
+        return 0;
+    }
+
+    if (initQueue(&queue, DEFAULT_QUEUE_SIZE) == -1) {
+        perror("initQueue");
+        return 1;
+    }
     pthread_create(&managerThread, NULL, manager, NULL);
     pthread_join(managerThread, NULL); // Wait for manager thread to finish
     return 0;
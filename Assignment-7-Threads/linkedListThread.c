@@ -6,14 +6,27 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #define MAX_LIST_SIZE 10
 #define MAX_PRODUCER_THREADS 10
 #define MAX_CONSUMER_THREADS 10
 #define MAX_SLEEP_TIME 5
+#define NODE_BATCH 64   // nodes moved between a thread's cache and the shared pool at a time
+#define SLAB_NODES 1024 // nodes carved out of one malloc by the shared pool
+#define CACHE_LINE 64
+#define HP_MAX_THREADS 128 // threads that may use a lock-free list at the same time
+#define HP_PER_THREAD 2    // hazard pointers each thread needs
+#define RETIRE_SCAN 64     // retired nodes a thread collects before it tries to free them
+#define SPIN_TRIES 100     // failed removes before a waiting consumer sleeps on the futex
 
 /**
  * @struct Node
@@ -33,9 +46,95 @@ typedef struct {
     int size;
     pthread_mutex_t mutex;
     pthread_cond_t empty, full;
+    int pooled;      // take nodes from the node pool outside the mutex instead of malloc/free inside it
+    int timed;       // measure how long the mutex is held (for the benchmark)
+    double holdTime; // total seconds the mutex was held
+    long holds;      // number of insertNode/removeNode calls measured
 } LinkedList;
 
+/*
+ * Node pool.
+ *
+ * Every thread keeps its own cache of free nodes, so allocNode and freeNode normally touch
+ * no lock and make no heap call. A thread whose cache runs dry takes a whole batch of
+ * NODE_BATCH nodes from the shared pool; a thread whose cache grows past two batches (a
+ * consumer, which frees what producers allocate) gives one batch back. Batches are kept as
+ * ready-made chains, so either move is O(1) under the pool mutex. Only when the shared pool
+ * has no batch left does it malloc a slab of SLAB_NODES nodes.
+ */
+
+/**
+ * @struct Slab
+ * @brief A block of nodes allocated at once by the shared pool.
+ */
+typedef struct Slab {
+    struct Slab *next;
+    Node nodes[SLAB_NODES];
+} Slab;
+
+/**
+ * @struct NodePool
+ * @brief The shared pool: a stack of free node chains, each NODE_BATCH long.
+ */
+typedef struct {
+    Node **batches;
+    int numBatches, maxBatches;
+    Slab *slabs;
+    long numSlabs;
+    pthread_mutex_t mutex;
+} NodePool;
+
+/**
+ * @struct NodeCache
+ * @brief A thread's own free nodes.
+ */
+typedef struct {
+    Node *free;
+    int count;
+} NodeCache;
+
+/**
+ * @struct LFNode
+ * @brief A node of the lock-free list.
+ */
+typedef struct LFNode {
+    int data;
+    _Atomic(struct LFNode *) next;
+} LFNode;
+
+/**
+ * @struct LockFreeList
+ * @brief A lock-free FIFO list (Michael-Scott queue). head always points to a dummy node
+ * whose successor holds the front item; tail points to the last node or lags one behind.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic(LFNode *) head; // consumers' end
+    _Alignas(CACHE_LINE) _Atomic(LFNode *) tail; // producers' end
+    _Alignas(CACHE_LINE) atomic_uint wakeSeq;    // futex word consumers sleep on while the list is empty
+    atomic_int waiters;
+} LockFreeList;
+
+/**
+ * @struct HazardRecord
+ * @brief The hazard pointers and retired nodes of one thread.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic(LFNode *) hp[HP_PER_THREAD];
+    atomic_int active; // 1 while a thread owns the record
+    LFNode **retired;  // nodes removed from a list but maybe still read by other threads
+    int numRetired, maxRetired;
+} HazardRecord;
+
 // Function prototypes
+int initLFList(LockFreeList *list);
+void destroyLFList(LockFreeList *list);
+void lfInsertNode(LockFreeList *list, int item);
+int lfTryRemoveNode(LockFreeList *list, int *item);
+int lfRemoveNode(LockFreeList *list);
+void lfWakeAll(LockFreeList *list);
+Node *allocNode(void);
+void freeNode(Node *node);
+void destroyPool(void);
 void initList(LinkedList *list);
 void insertNode(LinkedList *list, int item);
 int removeNode(LinkedList *list);
@@ -45,13 +144,138 @@ void clearResources();
 void deleteProducer();
 void deleteConsumer();
 
+static double seconds(void);
+
 // Global variables
+NodePool pool = {NULL, 0, 0, NULL, 0, PTHREAD_MUTEX_INITIALIZER};
+static _Thread_local NodeCache cache;
 LinkedList list;
+LockFreeList lfList;
+int useLockFree = 0; // the producers and consumers use lfList instead of list
+HazardRecord hazards[HP_MAX_THREADS];
+atomic_int numHazards; // records in use so far (they are never given back to the array)
+static _Thread_local HazardRecord *myHazards;
+static pthread_key_t hazardKey;
+static pthread_once_t hazardOnce = PTHREAD_ONCE_INIT;
 pthread_t producerThreads[MAX_PRODUCER_THREADS];
 pthread_t consumerThreads[MAX_CONSUMER_THREADS];
 pthread_t managerThread;
 int numProducers = 0, numConsumers = 0;
 
+/**
+ * @brief Pushes a chain of NODE_BATCH free nodes onto the shared pool. Called with pool.mutex held.
+ * @return 0 on success, -1 if the stack of chains cannot grow.
+ */
+static int pushBatch(Node *chain) {
+    if (pool.numBatches == pool.maxBatches) {
+        int max = pool.maxBatches ? pool.maxBatches * 2 : SLAB_NODES / NODE_BATCH;
+        Node **batches = realloc(pool.batches, max * sizeof(Node *));
+        if (batches == NULL) {
+            return -1;
+        }
+        pool.batches = batches;
+        pool.maxBatches = max;
+    }
+    pool.batches[pool.numBatches++] = chain;
+    return 0;
+}
+
+/**
+ * @brief Refills the calling thread's cache with one batch from the shared pool,
+ * carving a new slab into batches if the pool is empty.
+ * @return 0 on success, -1 if no memory is left.
+ */
+static int refillCache(void) {
+    pthread_mutex_lock(&pool.mutex);
+    if (pool.numBatches == 0) {
+        Slab *slab = malloc(sizeof(Slab));
+        if (slab == NULL) {
+            pthread_mutex_unlock(&pool.mutex);
+            return -1;
+        }
+        slab->next = pool.slabs;
+        pool.slabs = slab;
+        pool.numSlabs++;
+        for (int i = 0; i < SLAB_NODES; i++) {
+            slab->nodes[i].next = (i + 1) % NODE_BATCH ? &slab->nodes[i + 1] : NULL;
+        }
+        for (int i = 0; i < SLAB_NODES; i += NODE_BATCH) {
+            if (pushBatch(&slab->nodes[i]) == -1) {
+                break; // the nodes not pushed stay in the slab until destroyPool
+            }
+        }
+        if (pool.numBatches == 0) {
+            pthread_mutex_unlock(&pool.mutex);
+            return -1;
+        }
+    }
+    cache.free = pool.batches[--pool.numBatches];
+    cache.count = NODE_BATCH;
+    pthread_mutex_unlock(&pool.mutex);
+    return 0;
+}
+
+/**
+ * @brief Takes a node from the calling thread's cache.
+ * @return The node, or NULL if no memory is left.
+ */
+Node *allocNode(void) {
+    if (cache.count == 0 && refillCache() == -1) {
+        return NULL;
+    }
+    Node *node = cache.free;
+    cache.free = node->next;
+    cache.count--;
+    return node;
+}
+
+/**
+ * @brief Gives a node back to the calling thread's cache; a full cache hands one batch to the shared pool.
+ * @param node The node, which must have come from allocNode.
+ */
+void freeNode(Node *node) {
+    node->next = cache.free;
+    cache.free = node;
+    cache.count++;
+    if (cache.count >= 2 * NODE_BATCH) {
+        // the first NODE_BATCH nodes become a chain of their own, walked outside the pool mutex
+        Node *last = cache.free;
+        for (int i = 1; i < NODE_BATCH; i++) {
+            last = last->next;
+        }
+        Node *chain = cache.free;
+        cache.free = last->next;
+        last->next = NULL;
+        pthread_mutex_lock(&pool.mutex);
+        if (pushBatch(chain) == 0) {
+            cache.count -= NODE_BATCH;
+        } else {
+            last->next = cache.free; // keep the nodes in the cache
+            cache.free = chain;
+        }
+        pthread_mutex_unlock(&pool.mutex);
+    }
+}
+
+/**
+ * @brief Frees every slab of the shared pool. No node may be in use any more.
+ */
+void destroyPool(void) {
+    pthread_mutex_lock(&pool.mutex);
+    while (pool.slabs != NULL) {
+        Slab *slab = pool.slabs;
+        pool.slabs = slab->next;
+        free(slab);
+    }
+    free(pool.batches);
+    pool.batches = NULL;
+    pool.numBatches = pool.maxBatches = 0;
+    pool.numSlabs = 0;
+    pthread_mutex_unlock(&pool.mutex);
+    cache.free = NULL; // only the calling thread's cache can be reset here
+    cache.count = 0;
+}
+
 /**
  * @brief Initializes the linked list.
  * @param list A pointer to the linked list.
@@ -59,6 +283,10 @@ int numProducers = 0, numConsumers = 0;
 void initList(LinkedList *list) {
     list->head = NULL;
     list->size = 0;
+    list->pooled = 1;
+    list->timed = 0;
+    list->holdTime = 0;
+    list->holds = 0;
     pthread_mutex_init(&list->mutex, NULL);
     pthread_cond_init(&list->empty, NULL);
     pthread_cond_init(&list->full, NULL);
@@ -70,13 +298,25 @@ void initList(LinkedList *list) {
  * @param item The item to insert.
  */
 void insertNode(LinkedList *list, int item) {
+    Node* newNode = NULL;
+    if (list->pooled) {
+        newNode = allocNode(); // outside the mutex
+    }
+
     pthread_mutex_lock(&list->mutex);
     
     while (isFull(list)) {
         pthread_cond_wait(&list->full, &list->mutex);
     }
+    double start = list->timed ? seconds() : 0;
 
-    Node* newNode = (Node*)malloc(sizeof(Node));
+    if (!list->pooled) {
+        newNode = (Node*)malloc(sizeof(Node));
+    }
+    if (newNode == NULL) {
+        perror("insertNode");
+        exit(1);
+    }
     newNode->data = item;
     newNode->next = NULL;
 
@@ -91,6 +331,10 @@ void insertNode(LinkedList *list, int item) {
     }
     list->size++;
 
+    if (list->timed) {
+        list->holdTime += seconds() - start;
+        list->holds++;
+    }
     pthread_cond_signal(&list->empty);
     pthread_mutex_unlock(&list->mutex);
 }
@@ -106,15 +350,25 @@ int removeNode(LinkedList *list) {
     while (isEmpty(list)) {
         pthread_cond_wait(&list->empty, &list->mutex);
     }
+    double start = list->timed ? seconds() : 0;
 
     Node* temp = list->head;
     int item = temp->data;
     list->head = list->head->next;
-    free(temp);
+    if (!list->pooled) {
+        free(temp);
+    }
     list->size--;
 
+    if (list->timed) {
+        list->holdTime += seconds() - start;
+        list->holds++;
+    }
     pthread_cond_signal(&list->full);
     pthread_mutex_unlock(&list->mutex);
+    if (list->pooled) {
+        freeNode(temp); // outside the mutex
+    }
     return item;
 }
 
@@ -136,6 +390,300 @@ int isEmpty(LinkedList *list) {
     return (list->size == 0);
 }
 
+/*
+ * Lock-free list.
+ *
+ * LockFreeList is the Michael-Scott queue: producers link a node after the tail with one CAS
+ * and swing tail forward, consumers swing head to the next node with one CAS, and any thread
+ * that finds tail lagging helps move it. No thread ever waits for another to leave a critical
+ * section.
+ *
+ * A removed node cannot be freed at once, because another thread may have just read the
+ * pointer and be about to look at it. Every thread therefore publishes the nodes it is about
+ * to dereference in its hazard pointers, and re-reads the shared pointer to make sure the
+ * node was still in the list when it was published. Removed nodes are retired to a per-thread
+ * list, and every RETIRE_SCAN retirements the thread frees the ones no hazard pointer names.
+ *
+ * The list is unbounded. A consumer that finds it empty spins for a while and then sleeps on
+ * a futex; a producer only makes the wake-up system call when a consumer sleeps.
+ */
+
+static void releaseHazards(void *data) {
+    // runs when a thread that used a lock-free list exits or is cancelled
+    HazardRecord *rec = data;
+    for (int i = 0; i < HP_PER_THREAD; i++) {
+        atomic_store(&rec->hp[i], NULL);
+    }
+    atomic_store_explicit(&rec->active, 0, memory_order_release); // its retired nodes go to the next owner
+}
+
+static void makeHazardKey(void) {
+    pthread_key_create(&hazardKey, releaseHazards);
+}
+
+/**
+ * @brief Returns the calling thread's hazard record, claiming a free one on first use.
+ */
+static HazardRecord *hazardRecord(void) {
+    if (myHazards != NULL) {
+        return myHazards;
+    }
+    pthread_once(&hazardOnce, makeHazardKey);
+    for (int i = 0; i < HP_MAX_THREADS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&hazards[i].active, &expected, 1)) {
+            int n = atomic_load(&numHazards);
+            while (n <= i && !atomic_compare_exchange_weak(&numHazards, &n, i + 1)) {
+            }
+            myHazards = &hazards[i];
+            pthread_setspecific(hazardKey, myHazards);
+            return myHazards;
+        }
+    }
+    fprintf(stderr, "More than %d threads use lock-free lists.\n", HP_MAX_THREADS);
+    exit(1);
+}
+
+/**
+ * @brief Publishes the node *src points to in hazard pointer i and returns it; the node
+ * cannot be freed until the hazard pointer is cleared.
+ */
+static LFNode *protect(HazardRecord *rec, int i, _Atomic(LFNode *) *src) {
+    LFNode *node = atomic_load(src);
+    for (;;) {
+        atomic_store(&rec->hp[i], node);
+        LFNode *again = atomic_load(src); // still reachable after the hazard became visible?
+        if (again == node) {
+            return node;
+        }
+        node = again;
+    }
+}
+
+static int comparePointers(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(LFNode *const *)a, y = (uintptr_t)*(LFNode *const *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Frees the retired nodes of rec that no thread's hazard pointer names.
+ */
+static void scanRetired(HazardRecord *rec) {
+    LFNode *hp[HP_MAX_THREADS * HP_PER_THREAD];
+    int numHp = 0, n = atomic_load(&numHazards), kept = 0;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < HP_PER_THREAD; j++) {
+            LFNode *node = atomic_load(&hazards[i].hp[j]);
+            if (node != NULL) {
+                hp[numHp++] = node;
+            }
+        }
+    }
+    qsort(hp, numHp, sizeof(LFNode *), comparePointers);
+    for (int i = 0; i < rec->numRetired; i++) {
+        LFNode *node = rec->retired[i];
+        if (bsearch(&node, hp, numHp, sizeof(LFNode *), comparePointers) != NULL) {
+            rec->retired[kept++] = node; // still in use, try again next time
+        } else {
+            free(node);
+        }
+    }
+    rec->numRetired = kept;
+}
+
+/**
+ * @brief Hands a node removed from a list to the reclamation scheme.
+ */
+static void retireNode(HazardRecord *rec, LFNode *node) {
+    if (rec->numRetired == rec->maxRetired) {
+        int max = rec->maxRetired ? rec->maxRetired * 2 : 2 * RETIRE_SCAN;
+        LFNode **retired = realloc(rec->retired, max * sizeof(LFNode *));
+        if (retired == NULL) {
+            perror("retireNode");
+            exit(1);
+        }
+        rec->retired = retired;
+        rec->maxRetired = max;
+    }
+    rec->retired[rec->numRetired++] = node;
+    if (rec->numRetired % RETIRE_SCAN == 0) {
+        scanRetired(rec);
+    }
+}
+
+/**
+ * @brief Initializes the lock-free list with its dummy node.
+ * @param list A pointer to the lock-free list.
+ * @return 0 on success, -1 if the dummy node cannot be allocated.
+ */
+int initLFList(LockFreeList *list) {
+    LFNode *dummy = malloc(sizeof(LFNode));
+    if (dummy == NULL) {
+        return -1;
+    }
+    atomic_init(&dummy->next, NULL);
+    atomic_init(&list->head, dummy);
+    atomic_init(&list->tail, dummy);
+    atomic_init(&list->wakeSeq, 0);
+    atomic_init(&list->waiters, 0);
+    return 0;
+}
+
+/**
+ * @brief Frees the nodes of the lock-free list and every thread's retired nodes.
+ * No other thread may use a lock-free list any more.
+ * @param list A pointer to the lock-free list.
+ */
+void destroyLFList(LockFreeList *list) {
+    LFNode *node = atomic_load(&list->head);
+    while (node != NULL) {
+        LFNode *next = atomic_load(&node->next);
+        free(node);
+        node = next;
+    }
+    atomic_store(&list->head, NULL);
+    atomic_store(&list->tail, NULL);
+    for (int i = 0; i < atomic_load(&numHazards); i++) {
+        for (int j = 0; j < hazards[i].numRetired; j++) {
+            free(hazards[i].retired[j]);
+        }
+        hazards[i].numRetired = 0;
+    }
+}
+
+/**
+ * @brief Inserts a node at the end of the lock-free list. This is the producer's operation.
+ * @param list A pointer to the lock-free list.
+ * @param item The item to insert.
+ */
+void lfInsertNode(LockFreeList *list, int item) {
+    HazardRecord *rec = hazardRecord();
+    LFNode *newNode = malloc(sizeof(LFNode));
+    if (newNode == NULL) {
+        perror("lfInsertNode");
+        exit(1);
+    }
+    newNode->data = item;
+    atomic_init(&newNode->next, NULL);
+
+    for (;;) {
+        LFNode *tail = protect(rec, 0, &list->tail);
+        LFNode *next = atomic_load(&tail->next);
+        if (tail != atomic_load(&list->tail)) {
+            continue;
+        }
+        if (next != NULL) {
+            atomic_compare_exchange_strong(&list->tail, &tail, next); // help a slow producer
+            continue;
+        }
+        LFNode *expected = NULL;
+        if (atomic_compare_exchange_strong(&tail->next, &expected, newNode)) {
+            atomic_compare_exchange_strong(&list->tail, &tail, newNode); // others help if this fails
+            break;
+        }
+    }
+    atomic_store(&rec->hp[0], NULL);
+
+    // wake a sleeping consumer; the fence orders the insert before the check
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&list->waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&list->wakeSeq, 1);
+        syscall(SYS_futex, &list->wakeSeq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * @brief Removes the front node of the lock-free list unless the list is empty.
+ * @param list A pointer to the lock-free list.
+ * @param item Where to store the item removed.
+ * @return 1 if an item was removed, 0 if the list is empty.
+ */
+int lfTryRemoveNode(LockFreeList *list, int *item) {
+    HazardRecord *rec = hazardRecord();
+    LFNode *head;
+
+    for (;;) {
+        head = protect(rec, 0, &list->head);
+        LFNode *tail = atomic_load(&list->tail);
+        LFNode *next = protect(rec, 1, &head->next);
+        if (head != atomic_load(&list->head)) {
+            continue;
+        }
+        if (next == NULL) {
+            atomic_store(&rec->hp[0], NULL);
+            atomic_store(&rec->hp[1], NULL);
+            return 0;
+        }
+        if (head == tail) {
+            atomic_compare_exchange_strong(&list->tail, &tail, next); // tail lags behind, help it
+            continue;
+        }
+        *item = next->data; // next becomes the new dummy node
+        if (atomic_compare_exchange_strong(&list->head, &head, next)) {
+            break;
+        }
+    }
+    atomic_store(&rec->hp[0], NULL);
+    atomic_store(&rec->hp[1], NULL);
+    retireNode(rec, head);
+    return 1;
+}
+
+/**
+ * @brief Removes the front node of the lock-free list, waiting while the list is empty.
+ * This is the consumer's operation.
+ * @param list A pointer to the lock-free list.
+ * @return The item removed from the list.
+ */
+int lfRemoveNode(LockFreeList *list) {
+    int item;
+    for (int spins = 0; !lfTryRemoveNode(list, &item); spins++) {
+        if (spins < SPIN_TRIES) {
+            continue;
+        }
+        atomic_fetch_add(&list->waiters, 1);
+        unsigned seq = atomic_load(&list->wakeSeq);
+        if (lfTryRemoveNode(list, &item)) { // an item may have arrived before waiters was raised
+            atomic_fetch_sub(&list->waiters, 1);
+            break;
+        }
+        syscall(SYS_futex, &list->wakeSeq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+        atomic_fetch_sub(&list->waiters, 1);
+        pthread_testcancel(); // the raw futex wait is not a cancellation point
+    }
+    return item;
+}
+
+/**
+ * @brief Wakes every consumer sleeping on the lock-free list, so that a cancelled one
+ * reaches its cancellation point instead of sleeping until the next insert.
+ * @param list A pointer to the lock-free list.
+ */
+void lfWakeAll(LockFreeList *list) {
+    atomic_fetch_add(&list->wakeSeq, 1);
+    syscall(SYS_futex, &list->wakeSeq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * @brief Adds an item to the list picked on the command line.
+ */
+static void listInsert(int item) {
+    if (useLockFree) {
+        lfInsertNode(&lfList, item);
+    } else {
+        insertNode(&list, item);
+    }
+}
+
+/**
+ * @brief Removes an item from the list picked on the command line.
+ */
+static int listRemove(void) {
+    return useLockFree ? lfRemoveNode(&lfList) : removeNode(&list);
+}
+
 /**
  * @brief The producer thread function. It produces random items and adds them to the list.
  * @param data A pointer to the producer's ID.
@@ -149,7 +697,7 @@ void *producer(void *data) {
         printf("\n");
         for (int i = 0; i < numItems; ++i) {
             int item = rand() % 100;
-            insertNode(&list, item);
+            listInsert(item);
             printf("Producer %d produced %d/%d item: %d\n",
                    producerId, i+1, numItems, item);
         }
@@ -170,7 +718,7 @@ void *consumer(void *data) {
         int numItems = rand() % (MAX_LIST_SIZE - 1) + 1;
         printf("\n");
         for (int i = 0; i < numItems; ++i) {
-            int item = removeNode(&list);
+            int item = listRemove();
             printf("Consumer %d consumed %d/%d item: %d\n",
                    consumerId, i+1, numItems, item);
         }
@@ -189,11 +737,21 @@ void clearResources() {
     for (int i = 0; i < numConsumers; ++i) {
         pthread_cancel(consumerThreads[i]);
     }
-    Node* current = list.head;
-    while (current != NULL) {
-        Node* temp = current;
-        current = current->next;
-        free(temp);
+    if (useLockFree) {
+        // The lock-free threads never block holding a lock, so they can be joined
+        // before the list and the pool are freed under them.
+        lfWakeAll(&lfList);
+        for (int i = 0; i < numProducers; ++i) {
+            pthread_join(producerThreads[i], NULL);
+        }
+        for (int i = 0; i < numConsumers; ++i) {
+            pthread_join(consumerThreads[i], NULL);
+        }
+    }
+    list.head = NULL; // the nodes go with the pool's slabs
+    destroyPool();
+    if (useLockFree) {
+        destroyLFList(&lfList);
     }
     pthread_mutex_destroy(&list.mutex);
     pthread_cond_destroy(&list.empty);
@@ -222,6 +780,10 @@ void deleteProducer() {
 void deleteConsumer() {
     if (numConsumers > 0) {
         pthread_cancel(consumerThreads[numConsumers - 1]);
+        if (useLockFree) {
+            lfWakeAll(&lfList); // it may be asleep on the empty list
+            pthread_join(consumerThreads[numConsumers - 1], NULL);
+        }
         printf("Consumer thread %d deleted.\n", numConsumers);
         numConsumers--;
     } else {
@@ -284,11 +846,210 @@ void *manager(void *data) {
     return NULL;
 }
 
+/*
+ * Benchmark: pairs of producers and consumers pass items through a list that either
+ * mallocs and frees its nodes inside the mutex or takes them from the node pool.
+ */
+
+/**
+ * @struct BenchArg
+ * @brief The share of the work given to one benchmark thread.
+ */
+typedef struct {
+    LinkedList *list;
+    long count;
+    long long sum;
+} BenchArg;
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *benchProducer(void *data) {
+    BenchArg *a = data;
+    for (long i = 1; i <= a->count; i++) {
+        insertNode(a->list, (int)i);
+    }
+    return NULL;
+}
+
+static void *benchConsumer(void *data) {
+    BenchArg *a = data;
+    a->sum = 0;
+    for (long i = 0; i < a->count; i++) {
+        a->sum += removeNode(a->list);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs the list once with and once without the node pool, printing throughput,
+ * lock hold time and how many slabs the pool had to allocate.
+ * @param pairs Producer threads, and as many consumer threads.
+ * @param items Items passed through the list in each run.
+ */
+static void benchLists(int pairs, long items) {
+    pthread_t tids[2 * MAX_PRODUCER_THREADS];
+    BenchArg args[2 * MAX_PRODUCER_THREADS];
+    long perThread = items / pairs;
+    long long expected = (long long)pairs * perThread * (perThread + 1) / 2;
+
+    printf("%ld items, %d producers and %d consumers, list limit %d\n", pairs * perThread, pairs, pairs, MAX_LIST_SIZE);
+    printf("%-7s %14s %14s %8s\n", "nodes", "ops/sec", "hold ns/op", "slabs");
+    for (int pooled = 0; pooled <= 1; pooled++) {
+        LinkedList l;
+        long long sum = 0;
+        initList(&l);
+        l.pooled = pooled;
+        l.timed = 1;
+        double start = seconds();
+        for (int i = 0; i < 2 * pairs; i++) {
+            args[i].list = &l;
+            args[i].count = perThread;
+            pthread_create(&tids[i], NULL, i < pairs ? benchProducer : benchConsumer, &args[i]);
+        }
+        for (int i = 0; i < 2 * pairs; i++) {
+            pthread_join(tids[i], NULL);
+            if (i >= pairs) {
+                sum += args[i].sum;
+            }
+        }
+        double elapsed = seconds() - start;
+        printf("%-7s %14.0f %14.1f %8ld%s\n", pooled ? "pool" : "malloc", pairs * perThread / elapsed,
+               l.holdTime / l.holds * 1e9, pooled ? pool.numSlabs : 0L,
+               sum == expected ? "" : "  LOST OR DUPLICATED ITEMS");
+        pthread_mutex_destroy(&l.mutex);
+        pthread_cond_destroy(&l.empty);
+        pthread_cond_destroy(&l.full);
+    }
+    destroyPool();
+}
+
+/*
+ * Scaling benchmark: each thread repeatedly inserts an item and then removes one (so it never
+ * finds the list empty), on the mutex list and on the lock-free list, for 1 to 32 threads.
+ */
+
+/**
+ * @struct ScaleArg
+ * @brief The work of one thread of the scaling benchmark.
+ */
+typedef struct {
+    LinkedList *list;     // the mutex list ...
+    LockFreeList *lfList; // ... or the lock-free one
+    long pairs;           // insert/remove pairs to do
+    int first;            // the first item this thread inserts
+    long long sum;        // of the items it removed
+} ScaleArg;
+
+static void *scaleWorker(void *data) {
+    ScaleArg *a = data;
+    a->sum = 0;
+    for (long i = 0; i < a->pairs; i++) {
+        if (a->lfList) {
+            lfInsertNode(a->lfList, a->first + (int)i);
+            a->sum += lfRemoveNode(a->lfList);
+        } else {
+            insertNode(a->list, a->first + (int)i);
+            a->sum += removeNode(a->list);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs one list with the given number of threads and returns operations per second.
+ */
+static double runScale(LinkedList *l, LockFreeList *lf, int threads, long pairs, int *ok) {
+    pthread_t tids[32];
+    ScaleArg args[32];
+    long long sum = 0, expected = 0;
+
+    double start = seconds();
+    for (int i = 0; i < threads; i++) {
+        args[i].list = l;
+        args[i].lfList = lf;
+        args[i].pairs = pairs / threads;
+        args[i].first = (int)(i * (pairs / threads));
+        pthread_create(&tids[i], NULL, scaleWorker, &args[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        sum += args[i].sum;
+        for (long j = 0; j < args[i].pairs; j++) {
+            expected += args[i].first + j;
+        }
+    }
+    double elapsed = seconds() - start;
+    *ok = *ok && sum == expected;
+    return 2.0 * (pairs / threads) * threads / elapsed;
+}
+
+/**
+ * @brief Compares the mutex list (with the node pool) and the lock-free list from 1 to 32 threads.
+ * @param pairs Insert/remove pairs done in each run, shared among the threads.
+ */
+static void benchScaling(long pairs) {
+    int ok = 1;
+
+    printf("%ld insert/remove pairs per run\n", pairs);
+    printf("%8s %16s %16s\n", "threads", "mutex ops/sec", "lock-free ops/sec");
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        LinkedList l;
+        LockFreeList lf;
+        initList(&l);
+        if (initLFList(&lf) == -1) {
+            perror("initLFList");
+            return;
+        }
+        double mutexRate = runScale(&l, NULL, threads, pairs, &ok);
+        double lockFreeRate = runScale(NULL, &lf, threads, pairs, &ok);
+        printf("%8d %16.0f %16.0f\n", threads, mutexRate, lockFreeRate);
+        pthread_mutex_destroy(&l.mutex);
+        pthread_cond_destroy(&l.empty);
+        pthread_cond_destroy(&l.full);
+        destroyLFList(&lf);
+    }
+    destroyPool();
+    if (!ok) {
+        printf("LOST OR DUPLICATED ITEMS\n");
+    }
+}
+
 /**
  * @brief The main function. It initializes the list and creates the manager thread.
+ *        "lockfree" makes the producers and consumers use the lock-free list,
+ *        "bench [pairs [items]]" runs the node pool benchmark and
+ *        "scalebench [pairs]" the mutex against lock-free scaling benchmark.
  * @return 0 on success.
  */
-int main() {
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        int pairs = argc > 2 ? atoi(argv[2]) : 1;
+        long items = argc > 3 ? atol(argv[3]) : 1000000;
+        if (pairs < 1 || pairs > MAX_PRODUCER_THREADS || items < pairs) {
+            printf("Usage: %s bench [producer/consumer pairs [items]]\n", argv[0]);
+            return 1;
+        }
+        benchLists(pairs, items);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "scalebench") == 0) {
+        long pairs = argc > 2 ? atol(argv[2]) : 1000000;
+        benchScaling(pairs >= 32 ? pairs : 32);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "lockfree") == 0) {
+        useLockFree = 1;
+        if (initLFList(&lfList) == -1) {
+            perror("initLFList");
+            return 1;
+        }
+        printf("Using the lock-free list.\n");
+    }
+
     initList(&list);
     pthread_create(&managerThread, NULL, manager, NULL);
     pthread_join(managerThread, NULL); // Wait for manager thread to finish
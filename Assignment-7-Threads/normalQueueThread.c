@@ -6,11 +6,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
 
-#define MAX_QUEUE_SIZE 10
+#define MAX_QUEUE_SIZE 10 // the most items the manager's queue may hold
+#define INITIAL_CAPACITY 4 // slots allocated at first; the ring doubles when it fills up
 #define MAX_PRODUCER_THREADS 10
 #define MAX_CONSUMER_THREADS 10
 #define MAX_SLEEP_TIME 5
@@ -18,16 +20,28 @@
 /**
  * @struct Queue
  * @brief A thread-safe normal queue.
+ *
+ * The items are kept in a ring: head is the index of the front item and the rest follow it,
+ * wrapping at the end of the array. Dequeuing just moves head, so it takes constant time
+ * instead of shifting every remaining item. The array starts small and doubles when it is
+ * full, up to limit items; producers wait only when the queue holds limit items.
  */
 typedef struct {
-    int items[MAX_QUEUE_SIZE];
-    int size;  // Current size of queue
+    int *items;
+    int capacity; // slots allocated, a power of two
+    int head;     // index of the front item
+    int size;     // Current size of queue
+    int limit;    // the most items the queue may hold, 0 for no limit
     pthread_mutex_t mutex;
     pthread_cond_t empty, full;
+    int timed;       // measure how long the mutex is held (for the benchmark)
+    double holdTime; // total seconds the mutex was held
+    long holds;      // number of enQ/deQ calls measured
 } Queue;
 
 // Function prototypes
-void initQueue(Queue *q);
+int initQueue(Queue *q, int limit);
+void destroyQueue(Queue *q);
 void enQ(Queue *q, int item);
 int deQ(Queue *q);
 int isFull(Queue *q);
@@ -36,6 +50,8 @@ void clearResources();
 void deleteProducer();
 void deleteConsumer();
 
+static double seconds(void);
+
 // Global variables
 Queue queue;
 pthread_t producerThreads[MAX_PRODUCER_THREADS];
@@ -46,12 +62,59 @@ int numProducers = 0, numConsumers = 0;
 /**
  * @brief Initializes the queue.
  * @param q A pointer to the queue.
+ * @param limit The most items the queue may hold, 0 for no limit.
+ * @return 0 on success, -1 if the items cannot be allocated.
  */
-void initQueue(Queue *q) {
+int initQueue(Queue *q, int limit) {
+    q->capacity = INITIAL_CAPACITY;
+    q->items = malloc(q->capacity * sizeof(int));
+    if (q->items == NULL) {
+        return -1;
+    }
+    q->head = 0;
     q->size = 0;
+    q->limit = limit;
+    q->timed = 0;
+    q->holdTime = 0;
+    q->holds = 0;
     pthread_mutex_init(&q->mutex, NULL);
     pthread_cond_init(&q->empty, NULL);
     pthread_cond_init(&q->full, NULL);
+    return 0;
+}
+
+/**
+ * @brief Frees the items and the synchronization objects of the queue.
+ * @param q A pointer to the queue.
+ */
+void destroyQueue(Queue *q) {
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->empty);
+    pthread_cond_destroy(&q->full);
+    free(q->items);
+    q->items = NULL;
+}
+
+/**
+ * @brief Doubles the ring. The items are unwrapped so that head becomes 0 again.
+ * Called with the mutex held when size == capacity; amortized over the enQ calls that filled it.
+ * @param q A pointer to the queue.
+ * @return 0 on success, -1 if the memory cannot be allocated.
+ */
+static int growQueue(Queue *q) {
+    int newCapacity = q->capacity * 2;
+    int *items = malloc(newCapacity * sizeof(int));
+    if (items == NULL) {
+        return -1;
+    }
+    int first = q->capacity - q->head; // items from head to the end of the old array
+    memcpy(items, &q->items[q->head], first * sizeof(int));
+    memcpy(items + first, q->items, q->head * sizeof(int));
+    free(q->items);
+    q->items = items;
+    q->capacity = newCapacity;
+    q->head = 0;
+    return 0;
 }
 
 /**
@@ -62,13 +125,25 @@ void initQueue(Queue *q) {
 void enQ(Queue *q, int item) {
     pthread_mutex_lock(&q->mutex);
     
-    while (isFull(q)) {
-        pthread_cond_wait(&q->full, &q->mutex);
+    double start;
+    for (;;) {
+        while (isFull(q)) {
+            pthread_cond_wait(&q->full, &q->mutex);
+        }
+        start = q->timed ? seconds() : 0;
+        if (q->size < q->capacity || growQueue(q) == 0) {
+            break;
+        }
+        pthread_cond_wait(&q->full, &q->mutex); // the ring cannot grow: wait for a consumer
     }
     
-    q->items[q->size] = item;
+    q->items[(q->head + q->size) & (q->capacity - 1)] = item;
     q->size++;
     
+    if (q->timed) {
+        q->holdTime += seconds() - start;
+        q->holds++;
+    }
     pthread_cond_signal(&q->empty);
     pthread_mutex_unlock(&q->mutex);
 }
@@ -85,14 +160,17 @@ int deQ(Queue *q) {
         pthread_cond_wait(&q->empty, &q->mutex);
     }
     
-    int item = q->items[0];
+    double start = q->timed ? seconds() : 0;
     
-    // Shift all elements one position to the left.
-    for (int i = 0; i < q->size - 1; i++) {
-        q->items[i] = q->items[i + 1];
-    }
+    // No shifting: the next item simply becomes the front.
+    int item = q->items[q->head];
+    q->head = (q->head + 1) & (q->capacity - 1);
     q->size--;
     
+    if (q->timed) {
+        q->holdTime += seconds() - start;
+        q->holds++;
+    }
     pthread_cond_signal(&q->full);
     pthread_mutex_unlock(&q->mutex);
     return item;
@@ -104,7 +182,7 @@ int deQ(Queue *q) {
  * @return 1 if the queue is full, 0 otherwise.
  */
 int isFull(Queue *q) {
-    return (q->size >= MAX_QUEUE_SIZE);
+    return (q->limit > 0 && q->size >= q->limit);
 }
 
 /**
@@ -169,9 +247,7 @@ void clearResources() {
     for (int i = 0; i < numConsumers; ++i) {
         pthread_cancel(consumerThreads[i]);
     }
-    pthread_mutex_destroy(&queue.mutex);
-    pthread_cond_destroy(&queue.empty);
-    pthread_cond_destroy(&queue.full);
+    destroyQueue(&queue);
     printf("All threads and resources cleared.\n");
     numProducers = 0;
     numConsumers = 0;
@@ -258,12 +334,183 @@ void *manager(void *data) {
     return NULL;
 }
 
+/*
+ * Benchmark: lock hold time of the ring queue against the original array queue, whose deQ
+ * shifted every remaining item one place to the left while holding the mutex.
+ */
+
+/**
+ * @struct ShiftQueue
+ * @brief The original array queue, kept only for comparison.
+ */
+typedef struct {
+    int *items;
+    int size;
+    int limit;
+    pthread_mutex_t mutex;
+    pthread_cond_t empty, full;
+    double holdTime;
+    long holds;
+} ShiftQueue;
+
+static void shiftEnQ(ShiftQueue *q, int item) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->size >= q->limit) {
+        pthread_cond_wait(&q->full, &q->mutex);
+    }
+    double start = seconds();
+    q->items[q->size] = item;
+    q->size++;
+    q->holdTime += seconds() - start;
+    q->holds++;
+    pthread_cond_signal(&q->empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static int shiftDeQ(ShiftQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->size == 0) {
+        pthread_cond_wait(&q->empty, &q->mutex);
+    }
+    double start = seconds();
+    int item = q->items[0];
+    for (int i = 0; i < q->size - 1; i++) {
+        q->items[i] = q->items[i + 1];
+    }
+    q->size--;
+    q->holdTime += seconds() - start;
+    q->holds++;
+    pthread_cond_signal(&q->full);
+    pthread_mutex_unlock(&q->mutex);
+    return item;
+}
+
+/**
+ * @struct BenchArg
+ * @brief The share of the work given to one benchmark thread.
+ */
+typedef struct {
+    Queue *ring;       // the queue under test: ring ...
+    ShiftQueue *array; // ... or array
+    long count;
+    long long sum;
+} BenchArg;
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *benchProducer(void *data) {
+    BenchArg *a = data;
+    for (long i = 1; i <= a->count; i++) {
+        if (a->ring) {
+            enQ(a->ring, (int)i);
+        } else {
+            shiftEnQ(a->array, (int)i);
+        }
+    }
+    return NULL;
+}
+
+static void *benchConsumer(void *data) {
+    BenchArg *a = data;
+    a->sum = 0;
+    for (long i = 0; i < a->count; i++) {
+        a->sum += a->ring ? deQ(a->ring) : shiftDeQ(a->array);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs producers and consumers on one queue and prints throughput and lock hold time.
+ */
+static void runBench(const char *name, Queue *ring, ShiftQueue *array, int threads, long items, int limit) {
+    pthread_t tids[2 * MAX_PRODUCER_THREADS];
+    BenchArg args[2 * MAX_PRODUCER_THREADS];
+    long perThread = items / threads;
+    long long sum = 0, expected = (long long)threads * perThread * (perThread + 1) / 2;
+
+    double start = seconds();
+    for (int i = 0; i < 2 * threads; i++) {
+        args[i].ring = ring;
+        args[i].array = array;
+        args[i].count = perThread;
+        pthread_create(&tids[i], NULL, i < threads ? benchProducer : benchConsumer, &args[i]);
+    }
+    for (int i = 0; i < 2 * threads; i++) {
+        pthread_join(tids[i], NULL);
+        if (i >= threads) {
+            sum += args[i].sum;
+        }
+    }
+    double elapsed = seconds() - start;
+    double hold = ring ? ring->holdTime / ring->holds : array->holdTime / array->holds;
+
+    printf("%-6s %8d %6d %14.0f %14.1f%s\n", name, limit, threads, threads * perThread / elapsed,
+           hold * 1e9, sum == expected ? "" : "  LOST OR DUPLICATED ITEMS");
+}
+
+/**
+ * @brief Compares the array queue and the ring queue at several queue limits.
+ * @param threads Producer threads, and as many consumer threads.
+ * @param items Items pushed through each queue.
+ */
+static void benchQueues(int threads, long items) {
+    int limits[] = {10, 100, 1000, 10000};
+
+    printf("%ld items, %d producers and %d consumers\n", items, threads, threads);
+    printf("%-6s %8s %6s %14s %14s\n", "queue", "limit", "pairs", "ops/sec", "hold ns/op");
+    for (int i = 0; i < 4; i++) {
+        ShiftQueue array;
+        Queue ring;
+
+        array.items = malloc(limits[i] * sizeof(int));
+        array.size = 0;
+        array.limit = limits[i];
+        array.holdTime = 0;
+        array.holds = 0;
+        pthread_mutex_init(&array.mutex, NULL);
+        pthread_cond_init(&array.empty, NULL);
+        pthread_cond_init(&array.full, NULL);
+        runBench("array", NULL, &array, threads, items, limits[i]);
+        pthread_mutex_destroy(&array.mutex);
+        pthread_cond_destroy(&array.empty);
+        pthread_cond_destroy(&array.full);
+        free(array.items);
+
+        if (initQueue(&ring, limits[i]) == -1) {
+            perror("initQueue");
+            return;
+        }
+        ring.timed = 1;
+        runBench("ring", &ring, NULL, threads, items, limits[i]);
+        destroyQueue(&ring);
+    }
+}
+
 /**
  * @brief The main function. It initializes the queue and creates the manager thread.
+ *        "bench [pairs [items]]" runs the lock hold time benchmark instead.
  * @return 0 on success.
  */
-int main() {
-    initQueue(&queue);
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        int threads = argc > 2 ? atoi(argv[2]) : 1;
+        long items = argc > 3 ? atol(argv[3]) : 200000;
+        if (threads < 1 || threads > MAX_PRODUCER_THREADS || items < threads) {
+            printf("Usage: %s bench [producer/consumer pairs [items]]\n", argv[0]);
+            return 1;
+        }
+        benchQueues(threads, items);
+        return 0;
+    }
+
+    if (initQueue(&queue, MAX_QUEUE_SIZE) == -1) {
+        perror("initQueue");
+        return 1;
+    }
     pthread_create(&managerThread, NULL, manager, NULL);
     pthread_join(managerThread, NULL); // Wait for manager thread to finish
     return 0;
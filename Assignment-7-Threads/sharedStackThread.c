@@ -6,14 +6,27 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <sched.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #define MAX_STACK_SIZE 10
 #define MAX_PRODUCER_THREADS 10
 #define MAX_CONSUMER_THREADS 10
 #define MAX_SLEEP_TIME 5
+#define CACHE_LINE 64
+#define CHUNK_NODES 4096 // nodes the lock-free stack allocates at a time
+#define MAX_CHUNKS 4096  // so it holds at most CHUNK_NODES * MAX_CHUNKS - 1 items
+#define ELIM_SLOTS 8     // cells of the elimination array
+#define ELIM_SPINS 64    // how long a push waits in the elimination array for a pop
+#define SPIN_TRIES 100   // failed attempts before a blocking push or pop sleeps on the futex
 
 /**
  * @struct SharedStack
@@ -26,7 +39,49 @@ typedef struct {
     pthread_cond_t empty, full;
 } SharedStack;
 
+/**
+ * @struct FutexWait
+ * @brief An event count: waiters sleep on seq, notifiers bump it, but only when someone waits.
+ */
+typedef struct {
+    atomic_uint seq;
+    atomic_int waiters;
+} FutexWait;
+
+/**
+ * @struct TNode
+ * @brief A node of the lock-free stack; next is the index of the node below it.
+ */
+typedef struct {
+    int value;
+    atomic_uint next;
+} TNode;
+
+/**
+ * @struct LockFreeStack
+ * @brief A lock-free (Treiber) stack with an elimination array.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_ullong top;     // tag << 32 | index of the top node, index 0 = empty
+    _Alignas(CACHE_LINE) atomic_ullong freeTop; // the same for the stack of free nodes
+    _Alignas(CACHE_LINE) atomic_ullong elim[ELIM_SLOTS];
+    _Alignas(CACHE_LINE) FutexWait notEmpty;
+    _Alignas(CACHE_LINE) FutexWait notFull;
+    _Alignas(CACHE_LINE) atomic_long eliminated; // pushes handed straight to a pop
+    _Atomic(TNode *) chunks[MAX_CHUNKS];
+    unsigned numNodes;  // node indices handed out so far (under growLock)
+    unsigned capacity;  // the most items the stack may hold, 0 for no limit
+    int eliminate;      // try the elimination array when the top is contended
+    pthread_mutex_t growLock;
+} LockFreeStack;
+
 // Function prototypes
+int initLFStack(LockFreeStack *s, unsigned capacity, int eliminate);
+void destroyLFStack(LockFreeStack *s);
+int lfTryPush(LockFreeStack *s, int item);
+int lfTryPop(LockFreeStack *s, int *item);
+void lfPush(LockFreeStack *s, int item);
+int lfPop(LockFreeStack *s);
 void initStack(SharedStack *s);
 void push(SharedStack *s, int item);
 int pop(SharedStack *s);
@@ -38,6 +93,7 @@ void deleteConsumer();
 
 // Global variables
 SharedStack stack;
+LockFreeStack *lfStack = NULL; // used instead of stack when the program is started with "lockfree"
 pthread_t producerThreads[MAX_PRODUCER_THREADS];
 pthread_t consumerThreads[MAX_CONSUMER_THREADS];
 pthread_t managerThread;
@@ -103,6 +159,306 @@ int isEmpty(SharedStack *s) {
     return (s->top == -1);
 }
 
+/*
+ * Lock-free stack.
+ *
+ * LockFreeStack is a Treiber stack: push and pop each swing the top with one CAS. The nodes
+ * are kept in chunks that are never freed, and addressed by a 32-bit index, so top can hold
+ * the index together with a 32-bit tag that every successful CAS increments. A thread that
+ * read top, was delayed while the node was popped and pushed again, and then tries its CAS,
+ * fails because the tag changed - the ABA problem cannot occur, and a delayed thread reading
+ * a node that was popped meanwhile never touches freed memory. Free nodes are kept on a
+ * second tagged stack, freeTop.
+ *
+ * With a capacity, no more than capacity nodes are ever handed out, which makes the stack
+ * bounded: a push that finds no free node reports the stack full.
+ *
+ * Elimination: a push and a pop that collide on top can cancel each other out. A push whose
+ * CAS fails offers its item in a random cell of the elimination array for a short while; a
+ * pop whose CAS fails looks in a random cell and takes an item on offer. Such pairs never
+ * touch top at all, which keeps the stack scaling when many threads hammer it.
+ */
+
+#define ELIM_OFFER (1ULL << 32) // an elimination cell holding an item: ELIM_OFFER | item
+#define ELIM_TAKEN (2ULL << 32) // a pop took the item; the pushing thread empties the cell
+
+static inline void cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    sched_yield();
+#endif
+}
+
+static unsigned randomSlot(void) {
+    static _Thread_local unsigned x = 0;
+    if (x == 0) {
+        x = (unsigned)(uintptr_t)&x | 1; // differs between threads
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x % ELIM_SLOTS;
+}
+
+static unsigned waitBegin(FutexWait *w) {
+    atomic_fetch_add(&w->waiters, 1);
+    return atomic_load(&w->seq);
+}
+
+static void waitCommit(FutexWait *w, unsigned seq) {
+    syscall(SYS_futex, &w->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+    atomic_fetch_sub(&w->waiters, 1);
+    pthread_testcancel(); // the raw futex wait is not a cancellation point
+}
+
+static void waitCancel(FutexWait *w) {
+    atomic_fetch_sub(&w->waiters, 1);
+}
+
+static void notify(FutexWait *w) {
+    atomic_thread_fence(memory_order_seq_cst); // order the stack update before reading waiters
+    if (atomic_load_explicit(&w->waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&w->seq, 1);
+        syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static void notifyAll(FutexWait *w) {
+    atomic_fetch_add(&w->seq, 1);
+    syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static TNode *nodeAt(LockFreeStack *s, unsigned i) {
+    return &atomic_load_explicit(&s->chunks[i / CHUNK_NODES], memory_order_acquire)[i % CHUNK_NODES];
+}
+
+static unsigned long long nextTop(unsigned long long old, unsigned index) {
+    return ((old >> 32) + 1) << 32 | index;
+}
+
+/**
+ * @brief Pushes node i onto the free nodes.
+ */
+static void freeIndex(LockFreeStack *s, unsigned i) {
+    unsigned long long old = atomic_load_explicit(&s->freeTop, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&nodeAt(s, i)->next, (unsigned)old, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&s->freeTop, &old, nextTop(old, i),
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/**
+ * @brief Hands out more nodes: a new chunk, but never more than the capacity.
+ * @return 0 if there may be free nodes now, -1 if the stack is full or out of memory.
+ */
+static int growLFStack(LockFreeStack *s) {
+    pthread_mutex_lock(&s->growLock);
+    if ((unsigned)atomic_load(&s->freeTop) != 0) {
+        pthread_mutex_unlock(&s->growLock); // another thread has just grown it
+        return 0;
+    }
+    unsigned first = s->numNodes, c = first / CHUNK_NODES;
+    unsigned end = (c + 1) * CHUNK_NODES;
+    if (s->capacity > 0 && end > s->capacity + 1) {
+        end = s->capacity + 1; // index 0 is never used
+    }
+    if (first >= end || c >= MAX_CHUNKS) {
+        pthread_mutex_unlock(&s->growLock);
+        return -1;
+    }
+    if (atomic_load(&s->chunks[c]) == NULL) {
+        TNode *chunk = calloc(CHUNK_NODES, sizeof(TNode));
+        if (chunk == NULL) {
+            pthread_mutex_unlock(&s->growLock);
+            return -1;
+        }
+        atomic_store_explicit(&s->chunks[c], chunk, memory_order_release);
+    }
+    for (unsigned i = first; i < end; i++) {
+        freeIndex(s, i);
+    }
+    s->numNodes = end;
+    pthread_mutex_unlock(&s->growLock);
+    return 0;
+}
+
+/**
+ * @brief Takes a free node.
+ * @return Its index, or 0 if the stack is full.
+ */
+static unsigned allocIndex(LockFreeStack *s) {
+    for (;;) {
+        unsigned long long old = atomic_load_explicit(&s->freeTop, memory_order_acquire);
+        while ((unsigned)old != 0) {
+            unsigned i = (unsigned)old;
+            unsigned next = atomic_load_explicit(&nodeAt(s, i)->next, memory_order_relaxed);
+            if (atomic_compare_exchange_weak_explicit(&s->freeTop, &old, nextTop(old, next),
+                                                      memory_order_acquire, memory_order_acquire)) {
+                return i;
+            }
+        }
+        if (growLFStack(s) == -1) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Offers an item in the elimination array for a pop to take.
+ * @return 1 if a pop took it, 0 if nobody came.
+ */
+static int offerItem(LockFreeStack *s, int item) {
+    atomic_ullong *cell = &s->elim[randomSlot()];
+    unsigned long long expected = 0, offer = ELIM_OFFER | (unsigned)item;
+    if (!atomic_compare_exchange_strong(cell, &expected, offer)) {
+        return 0; // the cell is busy
+    }
+    for (int i = 0; i < ELIM_SPINS && atomic_load_explicit(cell, memory_order_relaxed) == offer; i++) {
+        cpuRelax();
+    }
+    if (atomic_compare_exchange_strong(cell, &offer, 0)) {
+        return 0; // withdrawn
+    }
+    atomic_store(cell, 0); // it was taken
+    atomic_fetch_add_explicit(&s->eliminated, 1, memory_order_relaxed);
+    return 1;
+}
+
+/**
+ * @brief Takes an item a push offers in the elimination array, if there is one.
+ * @return 1 if an item was taken into *item, 0 otherwise.
+ */
+static int takeItem(LockFreeStack *s, int *item) {
+    atomic_ullong *cell = &s->elim[randomSlot()];
+    unsigned long long v = atomic_load_explicit(cell, memory_order_relaxed);
+    if ((v & ~0xffffffffULL) == ELIM_OFFER && atomic_compare_exchange_strong(cell, &v, ELIM_TAKEN)) {
+        *item = (int)(unsigned)v;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Initializes a lock-free stack.
+ * @param s A pointer to the stack.
+ * @param capacity The most items it may hold, 0 for no limit.
+ * @param eliminate 1 to use the elimination array.
+ * @return 0 on success, -1 if the first nodes cannot be allocated.
+ */
+int initLFStack(LockFreeStack *s, unsigned capacity, int eliminate) {
+    memset(s, 0, sizeof(*s));
+    s->capacity = capacity;
+    s->eliminate = eliminate;
+    s->numNodes = 1; // index 0 means "no node"
+    pthread_mutex_init(&s->growLock, NULL);
+    return growLFStack(s);
+}
+
+/**
+ * @brief Frees the nodes of a lock-free stack. No thread may use it any more.
+ */
+void destroyLFStack(LockFreeStack *s) {
+    for (int c = 0; c < MAX_CHUNKS; c++) {
+        free(atomic_load(&s->chunks[c]));
+        atomic_store(&s->chunks[c], NULL);
+    }
+    pthread_mutex_destroy(&s->growLock);
+}
+
+/**
+ * @brief Pushes an item unless the stack is full.
+ * @return 1 if the item was pushed (or handed to a pop), 0 if the stack is full.
+ */
+int lfTryPush(LockFreeStack *s, int item) {
+    unsigned i = allocIndex(s);
+    if (i == 0) {
+        return s->eliminate && offerItem(s, item); // a waiting pop can still take it
+    }
+    TNode *node = nodeAt(s, i);
+    node->value = item;
+    unsigned long long old = atomic_load_explicit(&s->top, memory_order_relaxed);
+    for (;;) {
+        atomic_store_explicit(&node->next, (unsigned)old, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&s->top, &old, nextTop(old, i),
+                                                  memory_order_release, memory_order_relaxed)) {
+            return 1;
+        }
+        if (s->eliminate && offerItem(s, item)) {
+            freeIndex(s, i);
+            return 1;
+        }
+        old = atomic_load_explicit(&s->top, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Pops an item unless the stack is empty.
+ * @return 1 if an item was popped into *item, 0 if the stack is empty.
+ */
+int lfTryPop(LockFreeStack *s, int *item) {
+    unsigned long long old = atomic_load_explicit(&s->top, memory_order_acquire);
+    for (;;) {
+        unsigned i = (unsigned)old;
+        if (i == 0) {
+            return s->eliminate && takeItem(s, item);
+        }
+        unsigned next = atomic_load_explicit(&nodeAt(s, i)->next, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&s->top, &old, nextTop(old, next),
+                                                  memory_order_acquire, memory_order_acquire)) {
+            *item = nodeAt(s, i)->value;
+            freeIndex(s, i);
+            return 1;
+        }
+        if (s->eliminate && takeItem(s, item)) {
+            return 1;
+        }
+    }
+}
+
+/**
+ * @brief Pushes an item, waiting while a bounded stack is full. This is the producer's operation.
+ */
+void lfPush(LockFreeStack *s, int item) {
+    for (int spins = 0; !lfTryPush(s, item); spins++) {
+        if (spins < SPIN_TRIES) {
+            cpuRelax();
+            continue;
+        }
+        unsigned seq = waitBegin(&s->notFull);
+        if (lfTryPush(s, item)) {
+            waitCancel(&s->notFull);
+            break;
+        }
+        waitCommit(&s->notFull, seq);
+    }
+    notify(&s->notEmpty);
+}
+
+/**
+ * @brief Pops an item, waiting while the stack is empty. This is the consumer's operation.
+ * @return The item popped from the stack.
+ */
+int lfPop(LockFreeStack *s) {
+    int item;
+    for (int spins = 0; !lfTryPop(s, &item); spins++) {
+        if (spins < SPIN_TRIES) {
+            cpuRelax();
+            continue;
+        }
+        unsigned seq = waitBegin(&s->notEmpty);
+        if (lfTryPop(s, &item)) {
+            waitCancel(&s->notEmpty);
+            break;
+        }
+        waitCommit(&s->notEmpty, seq);
+    }
+    if (s->capacity > 0) {
+        notify(&s->notFull);
+    }
+    return item;
+}
+
 /**
  * @brief The producer thread function. It produces random items and pushes them onto the stack.
  * @param data A pointer to the producer's ID.
@@ -116,7 +472,11 @@ void *producer(void *data) {
         printf("\n");
         for (int i = 0; i < numItems; ++i) {
             int item = rand() % 100;
-            push(&stack, item);
+            if (lfStack) {
+                lfPush(lfStack, item);
+            } else {
+                push(&stack, item);
+            }
             printf("Producer %d pushed %d/%d item: %d\n",
                    producerId, i+1, numItems, item);
         }
@@ -137,7 +497,7 @@ void *consumer(void *data) {
         int numItems = rand() % (MAX_STACK_SIZE - 1) + 1;
         printf("\n");
         for (int i = 0; i < numItems; ++i) {
-            int item = pop(&stack);
+            int item = lfStack ? lfPop(lfStack) : pop(&stack);
             printf("Consumer %d popped %d/%d item: %d\n",
                    consumerId, i+1, numItems, item);
         }
@@ -146,6 +506,16 @@ void *consumer(void *data) {
     return NULL;
 }
 
+/**
+ * @brief Waits for a cancelled thread of the lock-free stack to exit. Threads asleep on
+ * the full or empty stack are woken, so that they reach their cancellation point.
+ */
+static void joinLFThread(pthread_t thread) {
+    notifyAll(&lfStack->notFull);
+    notifyAll(&lfStack->notEmpty);
+    pthread_join(thread, NULL);
+}
+
 /**
  * @brief Clears all resources, including threads, mutexes, and condition variables.
  */
@@ -156,9 +526,23 @@ void clearResources() {
     for (int i = 0; i < numConsumers; ++i) {
         pthread_cancel(consumerThreads[i]);
     }
+    if (lfStack) {
+        // The stack is freed below, so every thread that uses it must have exited.
+        for (int i = 0; i < numProducers; ++i) {
+            joinLFThread(producerThreads[i]);
+        }
+        for (int i = 0; i < numConsumers; ++i) {
+            joinLFThread(consumerThreads[i]);
+        }
+    }
     pthread_mutex_destroy(&stack.mutex);
     pthread_cond_destroy(&stack.empty);
     pthread_cond_destroy(&stack.full);
+    if (lfStack) {
+        destroyLFStack(lfStack);
+        free(lfStack);
+        lfStack = NULL;
+    }
     printf("All threads and resources cleared.\n");
     numProducers = 0;
     numConsumers = 0;
@@ -170,6 +554,9 @@ void clearResources() {
 void deleteProducer() {
     if (numProducers > 0) {
         pthread_cancel(producerThreads[numProducers - 1]);
+        if (lfStack) {
+            joinLFThread(producerThreads[numProducers - 1]);
+        }
         printf("Producer thread %d deleted.\n", numProducers);
         numProducers--;
     } else {
@@ -183,6 +570,9 @@ void deleteProducer() {
 void deleteConsumer() {
     if (numConsumers > 0) {
         pthread_cancel(consumerThreads[numConsumers - 1]);
+        if (lfStack) {
+            joinLFThread(consumerThreads[numConsumers - 1]);
+        }
         printf("Consumer thread %d deleted.\n", numConsumers);
         numConsumers--;
     } else {
@@ -247,11 +637,143 @@ void *manager(void *data) {
     return NULL;
 }
 
+/*
+ * Benchmark: every thread pushes an item and pops one, over and over, so all threads fight
+ * over the top of the stack. Runs the mutex stack and the lock-free stack without and with
+ * elimination, from 1 to 32 threads.
+ */
+
+/**
+ * @struct BenchArg
+ * @brief The work of one benchmark thread.
+ */
+typedef struct {
+    SharedStack *stack;     // the mutex stack ...
+    LockFreeStack *lfStack; // ... or a lock-free one
+    long pairs;
+    int first;
+    long long sum;
+} BenchArg;
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *benchWorker(void *data) {
+    BenchArg *a = data;
+    a->sum = 0;
+    for (long i = 0; i < a->pairs; i++) {
+        if (a->lfStack) {
+            lfPush(a->lfStack, a->first + (int)i);
+            a->sum += lfPop(a->lfStack);
+        } else {
+            push(a->stack, a->first + (int)i);
+            a->sum += pop(a->stack);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs one stack with the given number of threads.
+ * @return Operations (pushes plus pops) per second.
+ */
+static double runBench(SharedStack *st, LockFreeStack *lf, int threads, long pairs, int *ok) {
+    pthread_t tids[32];
+    BenchArg args[32];
+    long long sum = 0, expected = 0;
+
+    double start = seconds();
+    for (int i = 0; i < threads; i++) {
+        args[i].stack = st;
+        args[i].lfStack = lf;
+        args[i].pairs = pairs / threads;
+        args[i].first = (int)(i * (pairs / threads));
+        pthread_create(&tids[i], NULL, benchWorker, &args[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        sum += args[i].sum;
+        expected += args[i].pairs * args[i].first + args[i].pairs * (args[i].pairs - 1) / 2;
+    }
+    double elapsed = seconds() - start;
+    *ok = *ok && sum == expected;
+    return 2.0 * (pairs / threads) * threads / elapsed;
+}
+
+/**
+ * @brief Compares the mutex stack and the lock-free stacks under contention.
+ * @param pairs Push/pop pairs done in each run, shared among the threads.
+ * @param capacity Capacity of the lock-free stacks, 0 for no limit.
+ */
+static void benchStacks(long pairs, unsigned capacity) {
+    LockFreeStack *plain = malloc(sizeof(LockFreeStack));
+    LockFreeStack *elim = malloc(sizeof(LockFreeStack));
+    int ok = 1;
+
+    if (plain == NULL || elim == NULL) {
+        perror("benchStacks");
+        free(plain);
+        free(elim);
+        return;
+    }
+    printf("%ld push/pop pairs per run, lock-free capacity %u%s\n", pairs, capacity, capacity ? "" : " (no limit)");
+    printf("%8s %14s %14s %14s %11s\n", "threads", "mutex", "treiber", "elimination", "eliminated");
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        SharedStack st;
+        initStack(&st);
+        if (initLFStack(plain, capacity, 0) == -1 || initLFStack(elim, capacity, 1) == -1) {
+            perror("initLFStack");
+            break;
+        }
+        double mutexRate = runBench(&st, NULL, threads, pairs, &ok);
+        double plainRate = runBench(NULL, plain, threads, pairs, &ok);
+        double elimRate = runBench(NULL, elim, threads, pairs, &ok);
+        printf("%8d %14.0f %14.0f %14.0f %10.1f%%\n", threads, mutexRate, plainRate, elimRate,
+               100.0 * atomic_load(&elim->eliminated) / (pairs / threads * threads));
+        pthread_mutex_destroy(&st.mutex);
+        pthread_cond_destroy(&st.empty);
+        pthread_cond_destroy(&st.full);
+        destroyLFStack(plain);
+        destroyLFStack(elim);
+    }
+    if (!ok) {
+        printf("LOST OR DUPLICATED ITEMS\n");
+    }
+    free(plain);
+    free(elim);
+}
+
 /**
  * @brief The main function. It initializes the stack and creates the manager thread.
+ *        "lockfree [capacity]" makes the producers and consumers use the lock-free stack
+ *        (bounded to MAX_STACK_SIZE items unless another capacity is given, 0 for no limit),
+ *        "bench [pairs [capacity]]" runs the contention benchmark instead.
  * @return 0 on success.
  */
-int main() {
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        long pairs = argc > 2 ? atol(argv[2]) : 1000000;
+        long capacity = argc > 3 ? atol(argv[3]) : 0;
+        if (pairs < 32 || capacity < 0) {
+            printf("Usage: %s bench [pairs (at least 32) [capacity]]\n", argv[0]);
+            return 1;
+        }
+        benchStacks(pairs, (unsigned)capacity);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "lockfree") == 0) {
+        long capacity = argc > 2 ? atol(argv[2]) : MAX_STACK_SIZE;
+        lfStack = malloc(sizeof(LockFreeStack));
+        if (capacity < 0 || lfStack == NULL || initLFStack(lfStack, (unsigned)capacity, 1) == -1) {
+            printf("Cannot create a lock-free stack of capacity %ld.\n", capacity);
+            return 1;
+        }
+        printf("Using the lock-free stack, capacity %ld%s.\n", capacity, capacity ? "" : " (no limit)");
+    }
+
     initStack(&stack);
     pthread_create(&managerThread, NULL, manager, NULL);
     pthread_join(managerThread, NULL); // Wait for manager thread to finish
@@ -3,8 +3,10 @@
  * @brief A simple block-based file system implementation.
  * This program demonstrates how to manage a file as a collection of fixed-size blocks,
  * with a bitmap to keep track of used and free blocks.
- * @note The implementation has some issues. The bitmap is a char array instead of a bit array,
- * which is inefficient. The file size calculation is also incorrect.
+ * @note Files are written in the v2 format: a BlockHeader followed by a packed bitmap of
+ * (n + 7) / 8 bytes, one bit per block, and then the blocks themselves. Files in the old
+ * v1 format (a BlockRecord with one '0'/'1' character per block, limited to 256 blocks)
+ * are migrated to v2 the first time they are opened for writing; a check reads them as they are.
  */
 
 #include <stdio.h>
@@ -14,12 +16,17 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #define BLOCK_SIZE 4096
+#define BLOCK_MAGIC "BLK2"      /* identifies a v2 block file */
+#define V1_MAX_BLOCKS 256       /* capacity of the v1 character bitmap */
+#define SCAN_CHUNK 65536        /* bitmap bytes read at a time when scanning */
+#define COPY_CHUNK (1 << 20)    /* bytes copied at a time when migrating */
 
 /**
  * @struct BlockRecord
- * @brief A structure to hold the metadata of the file system.
+ * @brief The v1 metadata of the file system, kept only to migrate old files.
  */
 typedef struct blockrec {
     int n;          /**< Number of blocks in the file. */
@@ -29,8 +36,224 @@ typedef struct blockrec {
     char ub[256];   /**< Used block bitmap. '1' for used, '0' for free. */
 } BlockRecord;
 
+/**
+ * @struct BlockHeader
+ * @brief The v2 metadata of the file system. The packed bitmap follows it on disk.
+ */
+typedef struct blockhdr {
+    char magic[4];  /**< BLOCK_MAGIC. */
+    int n;          /**< Number of blocks in the file. */
+    int size;       /**< Size of each block. */
+    int ubn;        /**< Number of used blocks. */
+    int fbn;        /**< Number of free blocks. */
+} BlockHeader;
+
+/**
+ * @brief Returns the size of the v2 bitmap.
+ * @param n The number of blocks.
+ * @return The size of the bitmap in bytes.
+ */
+off_t bitmap_bytes(int n) {
+    return ((off_t)n + 7) / 8;
+}
+
+/**
+ * @brief Returns the offset of the first block in a v2 file.
+ * @param n The number of blocks.
+ * @return The offset in bytes.
+ */
+off_t data_offset(int n) {
+    return sizeof(BlockHeader) + bitmap_bytes(n);
+}
+
+/**
+ * @brief Checks whether a record read from the start of a file is v1 metadata.
+ * @param old The record.
+ * @return 1 if it is, 0 otherwise.
+ */
+int is_v1_record(const BlockRecord *old) {
+    return old->n > 0 && old->n <= V1_MAX_BLOCKS && old->size > 0;
+}
+
+/**
+ * @brief Converts a v1 file into the v2 format.
+ * The new file is written next to the old one, with the same permissions, and renamed
+ * over it, so an interrupted migration leaves the v1 file untouched.
+ * @param fname The name of the file.
+ * @param old The v1 metadata already read from the file.
+ * @return 0 on success, -1 on failure.
+ */
+int migrate_v1(const char *fname, const BlockRecord *old) {
+    char tmpname[4096];
+    BlockHeader hdr;
+    unsigned char *bitmap;
+    char *buf;
+    int ifd, ofd;
+    int i;
+    struct stat st;
+    off_t left, in_pos, out_pos;
+
+    if (snprintf(tmpname, sizeof(tmpname), "%s.v2tmp", fname) >= (int)sizeof(tmpname)) {
+        fprintf(stderr, "migrate_v1: file name too long\n");
+        return -1;
+    }
+    printf("Migrating %s to the v2 format\n", fname);
+
+    memcpy(hdr.magic, BLOCK_MAGIC, sizeof(hdr.magic));
+    hdr.n = old->n;
+    hdr.size = old->size;
+    hdr.ubn = 0;
+    bitmap = calloc(bitmap_bytes(old->n), 1);
+    buf = malloc(COPY_CHUNK);
+    if (bitmap == NULL || buf == NULL) {
+        perror("malloc");
+        free(bitmap);
+        free(buf);
+        return -1;
+    }
+    for (i = 0; i < old->n; i++) {
+        if (old->ub[i] == '1') {
+            bitmap[i / 8] |= 1 << (i % 8);
+            hdr.ubn++;
+        }
+    }
+    hdr.fbn = hdr.n - hdr.ubn;
+
+    ofd = -1;
+    ifd = open(fname, O_RDONLY);
+    if (ifd == -1 || fstat(ifd, &st) == -1) {
+        perror("open");
+        goto fail;
+    }
+    ofd = open(tmpname, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    if (ofd == -1 || fchmod(ofd, st.st_mode & 07777) == -1) { /* not narrowed by the umask */
+        perror("open");
+        goto fail;
+    }
+    if (write(ofd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        write(ofd, bitmap, bitmap_bytes(hdr.n)) != bitmap_bytes(hdr.n)) {
+        perror("write");
+        goto fail;
+    }
+
+    /* The block contents move down from after the BlockRecord to after the packed bitmap. */
+    left = (off_t)old->n * old->size;
+    in_pos = sizeof(BlockRecord);
+    out_pos = data_offset(hdr.n);
+    while (left > 0) {
+        ssize_t want = left < COPY_CHUNK ? left : COPY_CHUNK;
+        ssize_t got = pread(ifd, buf, want, in_pos);
+        if (got < 0) {
+            perror("read");
+            goto fail;
+        }
+        if (got == 0) {
+            break; /* short v1 file: the rest of the blocks are holes */
+        }
+        if (pwrite(ofd, buf, got, out_pos) != got) {
+            perror("write");
+            goto fail;
+        }
+        left -= got;
+        in_pos += got;
+        out_pos += got;
+    }
+    if (ftruncate(ofd, data_offset(hdr.n) + (off_t)hdr.n * hdr.size) == -1 || fsync(ofd) == -1) {
+        perror("ftruncate");
+        goto fail;
+    }
+    close(ifd);
+    close(ofd);
+    free(bitmap);
+    free(buf);
+
+    if (rename(tmpname, fname) == -1) {
+        perror("rename");
+        unlink(tmpname);
+        return -1;
+    }
+    return 0;
+
+fail:
+    if (ifd != -1) {
+        close(ifd);
+    }
+    if (ofd != -1) {
+        close(ofd);
+    }
+    unlink(tmpname);
+    free(bitmap);
+    free(buf);
+    return -1;
+}
+
+/**
+ * @brief Opens a block file and reads its v2 header, migrating a v1 file first.
+ * A v1 file is only migrated when it is opened for writing.
+ * @param fname The name of the file.
+ * @param flags The flags passed to open().
+ * @param hdr The header read from the file.
+ * @return The file descriptor, or -1 on failure.
+ */
+int open_blockfile(const char *fname, int flags, BlockHeader *hdr) {
+    BlockRecord old;
+    int fd;
+
+    fd = open(fname, flags);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    if (pread(fd, hdr, sizeof(*hdr), 0) == sizeof(*hdr) &&
+        memcmp(hdr->magic, BLOCK_MAGIC, sizeof(hdr->magic)) == 0) {
+        return fd;
+    }
+
+    if (pread(fd, &old, sizeof(old), 0) != sizeof(old) || !is_v1_record(&old)) {
+        fprintf(stderr, "%s: not a block file\n", fname);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    if ((flags & O_ACCMODE) == O_RDONLY) {
+        fprintf(stderr, "%s: a v1 block file must be opened for writing to migrate it\n", fname);
+        return -1;
+    }
+    if (migrate_v1(fname, &old) != 0) {
+        return -1;
+    }
+
+    fd = open(fname, flags);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    if (pread(fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr)) {
+        perror("read");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Writes the v2 header back to the file.
+ * @param fd The file descriptor.
+ * @param hdr The header to write.
+ * @return 0 on success, -1 on failure.
+ */
+int write_header(int fd, const BlockHeader *hdr) {
+    if (pwrite(fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr)) {
+        perror("write");
+        return -1;
+    }
+    return 0;
+}
+
 /**
  * @brief Initializes a file with a given number of blocks of a given size.
+ * The header and the zeroed bitmap are written with one call and the blocks are
+ * preallocated with one posix_fallocate() call instead of one write per block.
  * @param fname The name of the file to initialize.
  * @param bsize The size of each block.
  * @param bno The number of blocks.
@@ -38,27 +261,48 @@ typedef struct blockrec {
  */
 int init_File_dd(const char *fname, int bsize, int bno) {
     int fd;
-    BlockRecord br;
-    int i;
+    BlockHeader *hdr;
+    off_t meta_size;
+    int err;
     printf("Creating file %s\n", fname);
 
-    fd = open(fname, O_CREAT | O_WRONLY, 0700);
+    if (bsize <= 0 || bno <= 0) {
+        fprintf(stderr, "Invalid block size or number of blocks\n");
+        return -1;
+    }
+
+    fd = open(fname, O_CREAT | O_TRUNC | O_WRONLY, 0700);
     if (fd == -1) {
         perror("open");
         return -1;
     }
-    br.n = bno;
-    br.size = bsize;
-    br.ubn = 0;
-    br.fbn = bno;
-    memset(br.ub, '0', sizeof(br.ub));
+    meta_size = data_offset(bno);
+    hdr = calloc(1, meta_size); /* the bitmap follows the header and starts all free */
+    if (hdr == NULL) {
+        perror("calloc");
+        close(fd);
+        return -1;
+    }
+    memcpy(hdr->magic, BLOCK_MAGIC, sizeof(hdr->magic));
+    hdr->n = bno;
+    hdr->size = bsize;
+    hdr->ubn = 0;
+    hdr->fbn = bno;
     printf("Block size: %d, Number of blocks: %d\n", bsize, bno);
-    write(fd, (void *)&br, sizeof(BlockRecord));
-    for (i = 0; i < bno; i++) {
-        char *block = malloc(bsize);
-        memset(block, '0', bsize);
-        write(fd, block, bsize);
-        free(block);
+    if (write(fd, hdr, meta_size) != meta_size) {
+        perror("write");
+        free(hdr);
+        close(fd);
+        return -1;
+    }
+    free(hdr);
+
+    err = posix_fallocate(fd, 0, meta_size + (off_t)bno * bsize);
+    if (err != 0) {
+        errno = err;
+        perror("posix_fallocate");
+        close(fd);
+        return -1;
     }
     close(fd);
     return 0;
@@ -66,34 +310,62 @@ int init_File_dd(const char *fname, int bsize, int bno) {
 
 /**
  * @brief Gets the first free block in the file.
+ * The bitmap is read SCAN_CHUNK bytes at a time, and only the changed bitmap byte
+ * and the header are written back.
  * @param fname The name of the file.
  * @return The block number of the first free block, or -1 if no free blocks are available.
  */
 int get_freeblock(const char *fname) {
     int fd;
-    BlockRecord br;
-    int i;
+    BlockHeader hdr;
+    unsigned char *chunk;
+    off_t nbytes, pos;
 
-    fd = open(fname, O_RDWR);
+    fd = open_blockfile(fname, O_RDWR, &hdr);
     if (fd == -1) {
-        perror("open");
+        return -1;
+    }
+    chunk = malloc(SCAN_CHUNK);
+    if (chunk == NULL) {
+        perror("malloc");
+        close(fd);
         return -1;
     }
 
-    read(fd, (void *)&br, sizeof(BlockRecord));
-    for (i = 0; i < br.n; i++) {
-        if (br.ub[i] == '0') {
-            br.ub[i] = '1';
-            br.ubn++;
-            br.fbn--;
-            lseek(fd, 0, SEEK_SET);
-            write(fd, (void *)&br, sizeof(BlockRecord));
-            close(fd);
-            printf("Free block number: %d\n", i);
-            return i;
+    nbytes = bitmap_bytes(hdr.n);
+    for (pos = 0; pos < nbytes && hdr.fbn > 0; pos += SCAN_CHUNK) {
+        ssize_t len = nbytes - pos < SCAN_CHUNK ? nbytes - pos : SCAN_CHUNK;
+        ssize_t j;
+        if (pread(fd, chunk, len, sizeof(BlockHeader) + pos) != len) {
+            perror("read");
+            break;
+        }
+        for (j = 0; j < len; j++) {
+            if (chunk[j] != 0xff) {
+                int bit = __builtin_ctz(~chunk[j] & 0xff);
+                long i = (pos + j) * 8 + bit;
+                if (i >= hdr.n) {
+                    break; /* only padding bits are left in the last byte */
+                }
+                chunk[j] |= 1 << bit;
+                hdr.ubn++;
+                hdr.fbn--;
+                if (pwrite(fd, &chunk[j], 1, sizeof(BlockHeader) + pos + j) != 1 ||
+                    write_header(fd, &hdr) != 0) {
+                    perror("write");
+                    free(chunk);
+                    close(fd);
+                    return -1;
+                }
+                free(chunk);
+                close(fd);
+                printf("Free block number: %ld\n", i);
+                return (int)i;
+            }
         }
     }
 
+    free(chunk);
     close(fd);
     return -1;
 }
@@ -106,21 +378,28 @@ int get_freeblock(const char *fname) {
  */
 int free_block(const char *fname, int bno) {
     int fd;
-    BlockRecord br;
+    BlockHeader hdr;
+    unsigned char byte;
+    off_t posn;
 
-    fd = open(fname, O_RDWR);
+    fd = open_blockfile(fname, O_RDWR, &hdr);
     if (fd == -1) {
-        perror("open");
+        return 0;
+    }
+    if (bno < 0 || bno >= hdr.n) {
+        close(fd);
         return 0;
     }
 
-    read(fd, (void *)&br, sizeof(BlockRecord));
-    if (br.ub[bno] == '1') {
-        br.ub[bno] = '0';
-        br.ubn--;
-        br.fbn++;
-        lseek(fd, 0, SEEK_SET);
-        write(fd, (void *)&br, sizeof(BlockRecord));
+    posn = sizeof(BlockHeader) + bno / 8;
+    if (pread(fd, &byte, 1, posn) == 1 && (byte & (1 << (bno % 8)))) {
+        byte &= ~(1 << (bno % 8));
+        hdr.ubn--;
+        hdr.fbn++;
+        if (pwrite(fd, &byte, 1, posn) != 1 || write_header(fd, &hdr) != 0) {
+            close(fd);
+            return 0;
+        }
         close(fd);
         return 1;
     }
@@ -130,48 +409,111 @@ int free_block(const char *fname, int bno) {
 }
 
 /**
- * @brief Checks the integrity of the file system.
+ * @brief Checks the integrity of a v1 file without migrating it.
+ * @param fd The file descriptor, open for reading.
+ * @param fname The name of the file.
+ * @return 0 if the file system is consistent, 1 otherwise.
+ */
+int check_v1(int fd, const char *fname) {
+    BlockRecord old;
+    int i, used = 0;
+
+    if (pread(fd, &old, sizeof(old), 0) != sizeof(old) || !is_v1_record(&old)) {
+        fprintf(stderr, "%s: not a block file\n", fname);
+        return 1;
+    }
+    for (i = 0; i < old.n; i++) {
+        used += old.ub[i] == '1';
+    }
+    return old.ubn + old.fbn == old.n && used == old.ubn ? 0 : 1;
+}
+
+/**
+ * @brief Checks the integrity of the file system. The file is only read: a v1 file is
+ * checked as it is, not migrated.
+ * Besides ubn + fbn == n, the used blocks are recounted from the bitmap.
  * @param fname The name of the file.
  * @return 0 if the file system is consistent, 1 otherwise.
  */
 int check_fs(const char *fname) {
     int fd;
-    BlockRecord br;
+    BlockHeader hdr;
+    unsigned char *chunk;
+    off_t nbytes, pos;
+    long used = 0;
 
-    fd = open(fname, O_RDWR);
+    fd = open(fname, O_RDONLY);
     if (fd == -1) {
         perror("open");
         return 1;
     }
-
-    read(fd, (void *)&br, sizeof(BlockRecord));
-    if (br.ubn + br.fbn != br.n) {
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        memcmp(hdr.magic, BLOCK_MAGIC, sizeof(hdr.magic)) != 0) {
+        int status = check_v1(fd, fname);
+        close(fd);
+        return status;
+    }
+    if (hdr.ubn + hdr.fbn != hdr.n) {
         close(fd);
         return 1;
     }
+    chunk = malloc(SCAN_CHUNK);
+    if (chunk == NULL) {
+        perror("malloc");
+        close(fd);
+        return 1;
+    }
+
+    nbytes = bitmap_bytes(hdr.n);
+    for (pos = 0; pos < nbytes; pos += SCAN_CHUNK) {
+        ssize_t len = nbytes - pos < SCAN_CHUNK ? nbytes - pos : SCAN_CHUNK;
+        ssize_t j;
+        if (pread(fd, chunk, len, sizeof(BlockHeader) + pos) != len) {
+            perror("read");
+            free(chunk);
+            close(fd);
+            return 1;
+        }
+        if (pos + len == nbytes && hdr.n % 8 != 0) {
+            chunk[len - 1] &= (1 << (hdr.n % 8)) - 1; /* ignore padding bits */
+        }
+        for (j = 0; j < len; j++) {
+            used += __builtin_popcount(chunk[j]);
+        }
+    }
 
+    free(chunk);
     close(fd);
-    return 0;
+    return used == hdr.ubn ? 0 : 1;
 }
 
 /**
  * @brief The main function. It initializes a file system, gets a free block, frees a block, and checks the file system integrity.
+ * With only a file name it checks an existing file instead; a v1 file is checked without migrating it.
  * @param argc The number of command-line arguments.
  * @param argv An array of command-line arguments.
  * @return 0 on success, 1 on failure.
  */
 int main(int argc, char *argv[]) {
     int bsize, bno;
+    if (argc == 2) {
+        if (check_fs(argv[1]) != 0) {
+            printf("File system %s is inconsistent\n", argv[1]);
+            return 1;
+        }
+        printf("File system %s is consistent\n", argv[1]);
+        return 0;
+    }
     if (argc != 4) {
-        fprintf(stderr, "Usage: %s <filename> <block size> <number of blocks>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <filename> [<block size> <number of blocks>]\n", argv[0]);
         exit(1);
     }
     bsize = atoi(argv[2]);
     bno = atoi(argv[3]);
-    init_File_dd(argv[1], bsize, bno);
+    if (init_File_dd(argv[1], bsize, bno) != 0) {
+        return 1;
+    }
     get_freeblock(argv[1]);
     free_block(argv[1], 0);
-    check_fs(argv[1]);
-    return 0;
+    return check_fs(argv[1]);
 }
-
@@ -12,6 +12,16 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "blockio.h" /* batched block I/O for flushing the cache */
+
+#define CHECK_PAR_MIN_BLOCKS (1 << 20) // bitmaps at least this large are checked in parallel
+#define CHECK_MAX_THREADS 16           // upper bound on verification threads
+#define EXTENT_BUCKETS 32              // free-extent histogram buckets (powers of two)
 
 /**
  * @struct file_metadata
@@ -170,55 +180,189 @@ int init_file_dd(const char *fname, int bsize, int bno) {
 }
 
 /**
- * @brief Gets the first free block in the file.
+ * @struct shared_alloc
+ * @brief A process's view of the allocator shared through a MAP_SHARED mapping of the metadata.
+ * Every process maps the same metadata, so the bitmap and the counters live in the
+ * page cache once and are updated with atomic instructions instead of read/modify/write.
+ */
+typedef struct {
+    int fd;                     // descriptor of the block file
+    file_metadata *meta;        // shared mapping of the metadata
+    size_t map_len;             // length of the mapping
+    long units;                 // allocation units: full 64-bit words, then single tail bytes
+    long full_words;            // number of full 64-bit words in the bitmap
+    long hint;                  // unit where this process looks first (its allocation region)
+} shared_alloc;
+
+/**
+ * @brief Maps the metadata of a block file for shared allocation.
+ * @param sa The allocator handle to initialize.
  * @param fname The name of the file.
- * @return The block number of the first free block, or -1 if no free blocks are available.
+ * @return 0 on success, -1 on failure.
  */
-int get_freeblock(const char *fname) {
-    int fd = open(fname, O_RDWR);
-    if (fd == -1) {
+int shared_alloc_open(shared_alloc *sa, const char *fname) {
+    int n;
+
+    sa->fd = open(fname, O_RDWR);
+    if (sa->fd == -1) {
         perror("Failed to open file");
         return -1;
     }
-    
-    int n;
-    if (read(fd, &n, sizeof(int)) != sizeof(int)) {
+    if (pread(sa->fd, &n, sizeof(int), 0) != sizeof(int) || n <= 0) {
         perror("Failed to read block count");
-        close(fd);
+        close(sa->fd);
         return -1;
     }
-    
-    lseek(fd, 0, SEEK_SET);
-    file_metadata* metadata = read_metadata(fd, n);
-    if (!metadata) {
-        close(fd);
+
+    sa->map_len = get_metadata_size(n);
+    sa->meta = (file_metadata *)mmap(NULL, sa->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, sa->fd, 0);
+    if (sa->meta == MAP_FAILED) {
+        perror("Failed to map metadata");
+        close(sa->fd);
         return -1;
     }
-    
-    int free_block_num = -1;
-    for (int i = 0; i < metadata->n; i++) {
-        if (is_block_free(metadata, i)) {
-            free_block_num = i;
-            set_block_used(metadata, i);
-            break;
+
+    long nbytes = (n + 7) / 8;
+    sa->full_words = nbytes / 8;
+    sa->units = sa->full_words + nbytes % 8;
+    // Spread processes over the bitmap so that they rarely CAS the same word.
+    sa->hint = (long)(((unsigned long)getpid() * 2654435761UL) % (unsigned long)sa->units);
+    return 0;
+}
+
+/**
+ * @brief Unmaps the shared metadata and closes the file.
+ * @param sa The allocator handle.
+ */
+void shared_alloc_close(shared_alloc *sa) {
+    munmap(sa->meta, sa->map_len);
+    close(sa->fd);
+}
+
+/**
+ * @brief Converts a bit position inside a 64-bit bitmap word to a block offset in that word.
+ * Bytes of the on-disk bitmap are in block order, so on big-endian hosts the byte
+ * holding a bit is mirrored inside the word.
+ * @param bit The bit position (0-63).
+ * @return The offset of the block from the first block covered by the word.
+ */
+static int word_bit_to_block(int bit) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (7 - bit / 8) * 8 + bit % 8;
+#else
+    return bit;
+#endif
+}
+
+/**
+ * @brief Atomically claims a free block of one allocation unit.
+ * @param sa The allocator handle.
+ * @param unit The unit to search.
+ * @return The claimed block number, or -1 if the unit has no free block.
+ */
+static int claim_in_unit(shared_alloc *sa, long unit) {
+    int n = sa->meta->n;
+
+    if (unit < sa->full_words) {
+        uint64_t *wp = (uint64_t *)sa->meta->ub + unit;
+        uint64_t old = __atomic_load_n(wp, __ATOMIC_RELAXED);
+        while (~old != 0) {
+            int bit = __builtin_ctzll(~old);
+            if (__atomic_compare_exchange_n(wp, &old, old | ((uint64_t)1 << bit), 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                return (int)(unit * 64 + word_bit_to_block(bit));
+            }
         }
+        return -1;
     }
-    
-    if (free_block_num == -1) {
-        fprintf(stderr, "No free blocks available\n");
-        free(metadata);
-        close(fd);
+
+    long byte_idx = sa->full_words * 8 + (unit - sa->full_words);
+    unsigned char *bp = &sa->meta->ub[byte_idx];
+    int valid = n - byte_idx * 8 < 8 ? n - (int)byte_idx * 8 : 8;
+    unsigned char valid_mask = (unsigned char)((1 << valid) - 1);
+    unsigned char old = __atomic_load_n(bp, __ATOMIC_RELAXED);
+    while ((~old & valid_mask) != 0) {
+        int bit = __builtin_ctz(~old & valid_mask);
+        if (__atomic_compare_exchange_n(bp, &old, (unsigned char)(old | (1 << bit)), 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return (int)(byte_idx * 8 + bit);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Allocates a free block; safe to call from several processes at once.
+ * The search starts at this process's region and wraps around the whole bitmap.
+ * @param sa The allocator handle.
+ * @return The allocated block number, or -1 if no free blocks are available.
+ */
+int shared_get_freeblock(shared_alloc *sa) {
+    for (long i = 0; i < sa->units; i++) {
+        long unit = (sa->hint + i) % sa->units;
+        int bno = claim_in_unit(sa, unit);
+        if (bno != -1) {
+            sa->hint = unit;
+            __atomic_fetch_add(&sa->meta->ubn, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_sub(&sa->meta->fbn, 1, __ATOMIC_RELAXED);
+            return bno;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Frees a block; safe to call from several processes at once.
+ * @param sa The allocator handle.
+ * @param bno The block number to free.
+ * @return 1 on success, 0 if the block is already free, -1 on failure.
+ */
+int shared_free_block(shared_alloc *sa, int bno) {
+    int was_used;
+
+    if (bno < 0 || bno >= sa->meta->n) {
+        fprintf(stderr, "Invalid block number\n");
         return -1;
     }
-    
-    if (write_metadata(fd, metadata, n) != 0) {
-        free(metadata);
-        close(fd);
+
+    long unit = bno / 64;
+    if (unit < sa->full_words) {
+        int off = bno % 64;
+        int bit = word_bit_to_block(off); // the mapping is its own inverse
+        uint64_t mask = (uint64_t)1 << bit;
+        uint64_t old = __atomic_fetch_and((uint64_t *)sa->meta->ub + unit, ~mask, __ATOMIC_ACQ_REL);
+        was_used = (old & mask) != 0;
+    } else {
+        unsigned char mask = (unsigned char)(1 << (bno % 8));
+        unsigned char old = __atomic_fetch_and(&sa->meta->ub[bno / 8], (unsigned char)~mask, __ATOMIC_ACQ_REL);
+        was_used = (old & mask) != 0;
+    }
+
+    if (!was_used) {
+        return 0;
+    }
+    __atomic_fetch_sub(&sa->meta->ubn, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sa->meta->fbn, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * @brief Gets a free block in the file.
+ * @param fname The name of the file.
+ * @return The block number of the allocated block, or -1 if no free blocks are available.
+ */
+int get_freeblock(const char *fname) {
+    shared_alloc sa;
+    if (shared_alloc_open(&sa, fname) != 0) {
         return -1;
     }
     
-    free(metadata);
-    close(fd);
+    int free_block_num = shared_get_freeblock(&sa);
+    if (free_block_num == -1) {
+        fprintf(stderr, "No free blocks available\n");
+    }
+    
+    shared_alloc_close(&sa);
     return free_block_num;
 }
 
@@ -229,58 +373,528 @@ int get_freeblock(const char *fname) {
  * @return 1 on success, 0 if the block is already free, -1 on failure.
  */
 int free_block(const char *fname, int bno) {
-    int fd = open(fname, O_RDWR);
-    if (fd == -1) {
-        perror("Failed to open file");
+    shared_alloc sa;
+    if (shared_alloc_open(&sa, fname) != 0) {
         return -1;
     }
     
-    int n;
-    if (read(fd, &n, sizeof(int)) != sizeof(int)) {
-        perror("Failed to read block count");
-        close(fd);
-        return -1;
+    int status = shared_free_block(&sa, bno);
+    if (status == 0) {
+        fprintf(stderr, "Block %d is already free\n", bno);
     }
     
-    if (bno < 0 || bno >= n) {
+    shared_alloc_close(&sa);
+    return status;
+}
+
+/**
+ * @struct cache_page
+ * @brief One cached block. Pages are kept on an LRU list and in a hash chain.
+ */
+typedef struct cache_page {
+    int bno;                        // cached block number, or -1 if the page is unused
+    int dirty;                      // 1 if the page differs from the block on disk
+    char *data;                     // block contents
+    struct cache_page *prev;        // LRU neighbour towards the most recently used end
+    struct cache_page *next;        // LRU neighbour towards the least recently used end
+    struct cache_page *hnext;       // next page in the same hash bucket
+} cache_page;
+
+/**
+ * @struct block_cache
+ * @brief A write-back LRU cache of the blocks of one block file.
+ */
+typedef struct {
+    int fd;                         // descriptor of the block file
+    int n;                          // number of blocks
+    int s;                          // size of each block
+    off_t meta_size;                // offset of block 0 in the file
+    int capacity;                   // number of pages
+    cache_page *pages;              // all pages
+    char *data;                     // capacity * s bytes of page contents
+    cache_page **buckets;           // hash table from block number to page
+    int nbuckets;                   // number of buckets (a power of two)
+    cache_page *mru;                // most recently used page
+    cache_page *lru;                // least recently used page
+    long hits;                      // lookups served from the cache
+    long misses;                    // lookups that had to go to the file
+    long writebacks;                // dirty pages written to the file
+} block_cache;
+
+/**
+ * @brief Opens a block file for block I/O through a cache.
+ * @param c The cache to initialize.
+ * @param fname The name of the file.
+ * @param capacity The number of blocks the cache may hold.
+ * @return 0 on success, -1 on failure.
+ */
+int block_cache_open(block_cache *c, const char *fname, int capacity) {
+    file_metadata head;
+
+    memset(c, 0, sizeof(*c));
+    if (capacity <= 0) {
+        fprintf(stderr, "Invalid cache capacity\n");
+        return -1;
+    }
+    c->fd = open(fname, O_RDWR);
+    if (c->fd == -1) {
+        perror("Failed to open file");
+        return -1;
+    }
+    if (pread(c->fd, &head, sizeof(head), 0) != sizeof(head)) {
+        perror("Failed to read metadata");
+        close(c->fd);
+        return -1;
+    }
+
+    c->n = head.n;
+    c->s = head.s;
+    c->meta_size = get_metadata_size(head.n);
+    c->capacity = capacity;
+    c->nbuckets = 1;
+    while (c->nbuckets < 2 * capacity) {
+        c->nbuckets <<= 1;
+    }
+    c->pages = (cache_page *)calloc(capacity, sizeof(cache_page));
+    c->data = (char *)malloc((size_t)capacity * c->s);
+    c->buckets = (cache_page **)calloc(c->nbuckets, sizeof(cache_page *));
+    if (!c->pages || !c->data || !c->buckets) {
+        perror("Memory allocation failed");
+        free(c->pages);
+        free(c->data);
+        free(c->buckets);
+        close(c->fd);
+        return -1;
+    }
+
+    // All pages start unused, chained on the LRU list so that they are taken first.
+    for (int i = 0; i < capacity; i++) {
+        cache_page *p = &c->pages[i];
+        p->bno = -1;
+        p->data = c->data + (size_t)i * c->s;
+        p->prev = i > 0 ? &c->pages[i - 1] : NULL;
+        p->next = i < capacity - 1 ? &c->pages[i + 1] : NULL;
+    }
+    c->mru = &c->pages[0];
+    c->lru = &c->pages[capacity - 1];
+    return 0;
+}
+
+/**
+ * @brief Returns the hash bucket of a block number.
+ */
+static cache_page **cache_bucket(block_cache *c, int bno) {
+    return &c->buckets[((unsigned)bno * 2654435761U) & (c->nbuckets - 1)];
+}
+
+/**
+ * @brief Moves a page to the most recently used end of the LRU list.
+ */
+static void cache_touch(block_cache *c, cache_page *p) {
+    if (c->mru == p) {
+        return;
+    }
+    p->prev->next = p->next;
+    if (p->next) {
+        p->next->prev = p->prev;
+    } else {
+        c->lru = p->prev;
+    }
+    p->prev = NULL;
+    p->next = c->mru;
+    c->mru->prev = p;
+    c->mru = p;
+}
+
+/**
+ * @brief Writes a dirty page back to the file.
+ * @return 0 on success, -1 on failure.
+ */
+static int cache_writeback(block_cache *c, cache_page *p) {
+    if (!p->dirty) {
+        return 0;
+    }
+    if (pwrite(c->fd, p->data, c->s, c->meta_size + (off_t)p->bno * c->s) != c->s) {
+        perror("Failed to write block");
+        return -1;
+    }
+    p->dirty = 0;
+    c->writebacks++;
+    return 0;
+}
+
+/**
+ * @brief Finds the page caching a block, or makes room for it.
+ * @param c The cache.
+ * @param bno The block number.
+ * @param fill 1 if a newly assigned page must be read from the file.
+ * @return The page, now the most recently used, or NULL on failure.
+ */
+static cache_page *cache_get(block_cache *c, int bno, int fill) {
+    cache_page **bucket = cache_bucket(c, bno);
+
+    for (cache_page *p = *bucket; p; p = p->hnext) {
+        if (p->bno == bno) {
+            c->hits++;
+            cache_touch(c, p);
+            return p;
+        }
+    }
+    c->misses++;
+
+    // Evict the least recently used page.
+    cache_page *victim = c->lru;
+    if (victim->bno != -1) {
+        if (cache_writeback(c, victim) != 0) {
+            return NULL;
+        }
+        cache_page **pp = cache_bucket(c, victim->bno);
+        while (*pp != victim) {
+            pp = &(*pp)->hnext;
+        }
+        *pp = victim->hnext;
+        victim->bno = -1;
+    }
+
+    if (fill && pread(c->fd, victim->data, c->s, c->meta_size + (off_t)bno * c->s) != c->s) {
+        perror("Failed to read block");
+        return NULL;
+    }
+    victim->bno = bno;
+    victim->hnext = *bucket;
+    *bucket = victim;
+    cache_touch(c, victim);
+    return victim;
+}
+
+/**
+ * @brief Reads the contents of a block.
+ * @param c The cache.
+ * @param bno The block number.
+ * @param buf A buffer of at least one block.
+ * @return 0 on success, -1 on failure.
+ */
+int read_block(block_cache *c, int bno, void *buf) {
+    if (bno < 0 || bno >= c->n) {
         fprintf(stderr, "Invalid block number\n");
-        close(fd);
         return -1;
     }
-    
-    lseek(fd, 0, SEEK_SET);
-    file_metadata* metadata = read_metadata(fd, n);
-    if (!metadata) {
-        close(fd);
+    cache_page *p = cache_get(c, bno, 1);
+    if (!p) {
         return -1;
     }
-    
-    if (is_block_free(metadata, bno)) {
-        fprintf(stderr, "Block %d is already free\n", bno);
-        free(metadata);
-        close(fd);
-        return 0; 
+    memcpy(buf, p->data, c->s);
+    return 0;
+}
+
+/**
+ * @brief Writes the contents of a block. The write reaches the file when the
+ * page is evicted or the cache is flushed.
+ * @param c The cache.
+ * @param bno The block number.
+ * @param buf The new contents of the block.
+ * @return 0 on success, -1 on failure.
+ */
+int write_block(block_cache *c, int bno, const void *buf) {
+    if (bno < 0 || bno >= c->n) {
+        fprintf(stderr, "Invalid block number\n");
+        return -1;
     }
-    
-    set_block_free(metadata, bno);
-    
-    if (write_metadata(fd, metadata, n) != 0) {
-        free(metadata);
-        close(fd);
+    cache_page *p = cache_get(c, bno, 0); // the whole block is overwritten, no need to read it
+    if (!p) {
         return -1;
     }
-    
-    free(metadata);
-    close(fd);
-    return 1;
+    memcpy(p->data, buf, c->s);
+    p->dirty = 1;
+    return 0;
 }
 
 /**
- * @brief Checks the integrity of the file system.
+ * @brief Writes all dirty pages back to the file.
+ * The writes are queued in batches through the block I/O engine, so many of them are
+ * in flight at once; without the engine the pages are written one by one.
+ * @param c The cache.
+ * @return 0 on success, -1 on failure.
+ */
+int block_cache_flush(block_cache *c) {
+    blk_engine e;
+    int status = 0;
+    int ndirty = 0;
+
+    for (int i = 0; i < c->capacity; i++) {
+        ndirty += c->pages[i].bno != -1 && c->pages[i].dirty;
+    }
+    if (ndirty == 0) {
+        return 0;
+    }
+    blk_req *reqs = (blk_req *)malloc(ndirty * sizeof(blk_req));
+    cache_page **owners = (cache_page **)malloc(ndirty * sizeof(cache_page *));
+    if (!reqs || !owners || blk_engine_init(&e, DEFAULT_DEPTH, BLK_AUTO) != 0) {
+        free(reqs);
+        free(owners);
+        for (int i = 0; i < c->capacity; i++) {
+            if (c->pages[i].bno != -1 && cache_writeback(c, &c->pages[i]) != 0) {
+                status = -1;
+            }
+        }
+        return status;
+    }
+
+    int n = 0;
+    for (int i = 0; i < c->capacity; i++) {
+        cache_page *p = &c->pages[i];
+        if (p->bno != -1 && p->dirty) {
+            reqs[n].op = BLK_WRITE;
+            reqs[n].fd = c->fd;
+            reqs[n].buf = p->data;
+            reqs[n].len = c->s;
+            reqs[n].off = c->meta_size + (off_t)p->bno * c->s;
+            reqs[n].res = -1; // requests not run after a failure stay dirty
+            owners[n++] = p;
+        }
+    }
+    status = blk_run(&e, reqs, n);
+    blk_engine_exit(&e);
+
+    // Only the pages whose block reached the file are clean now.
+    for (int i = 0; i < n; i++) {
+        if (reqs[i].res == c->s) {
+            owners[i]->dirty = 0;
+            c->writebacks++;
+        }
+    }
+    free(reqs);
+    free(owners);
+    return status;
+}
+
+/**
+ * @brief Flushes the cache, releases it and closes the file.
+ * @param c The cache.
+ * @return 0 on success, -1 if some dirty page could not be written.
+ */
+int block_cache_close(block_cache *c) {
+    int status = block_cache_flush(c);
+    free(c->pages);
+    free(c->data);
+    free(c->buckets);
+    close(c->fd);
+    return status;
+}
+
+/**
+ * @struct fs_stats
+ * @brief Block counts and free-space fragmentation collected by check_fs_stats().
+ */
+typedef struct {
+    long used;                      // blocks marked used in the bitmap
+    long free;                      // blocks marked free in the bitmap
+    long extents;                   // number of maximal runs of free blocks
+    long largest_free_run;          // length of the longest free run
+    long hist[EXTENT_BUCKETS];      // hist[k] counts free runs of length [2^k, 2^(k+1))
+} fs_stats;
+
+/**
+ * @struct scan_chunk
+ * @brief Partial result of scanning one bit range of the bitmap.
+ * Free runs that touch either edge of the range are kept apart as lead/trail,
+ * so that runs crossing a chunk boundary can be joined when the chunks are merged.
+ */
+typedef struct {
+    const unsigned char *ub;        // bitmap being scanned
+    long start;                     // first bit of the range (multiple of 64)
+    long end;                       // one past the last bit of the range
+    long used;                      // used blocks in the range
+    long lead;                      // free run at the start of the range
+    long trail;                     // free run at the end of the range
+    int all_free;                   // 1 if the range has no used block at all
+    fs_stats interior;              // free runs lying strictly inside the range
+} scan_chunk;
+
+/**
+ * @brief Records a free run of the given length in the statistics.
+ * @param st The statistics to update.
+ * @param len The length of the free run.
+ */
+static void record_extent(fs_stats *st, long len) {
+    int k = 0;
+
+    if (len <= 0) {
+        return;
+    }
+    while (k < EXTENT_BUCKETS - 1 && (len >> (k + 1)) != 0) {
+        k++;
+    }
+    st->hist[k]++;
+    st->extents++;
+    if (len > st->largest_free_run) {
+        st->largest_free_run = len;
+    }
+}
+
+/**
+ * @brief Loads 64 bitmap bits starting at block w * 64.
+ * Bit k of the result describes block w * 64 + k, whatever the host byte order.
+ * @param ub The bitmap.
+ * @param w The index of the 64-bit word.
+ * @param nbytes The size of the bitmap in bytes.
+ * @return The bitmap word; bytes past the end of the bitmap read as zero.
+ */
+static uint64_t load_bitmap_word(const unsigned char *ub, long w, long nbytes) {
+    uint64_t word = 0;
+    long off = w * 8;
+    long len = nbytes - off < 8 ? nbytes - off : 8;
+
+    memcpy(&word, ub + off, len);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/**
+ * @brief Scans a range of the bitmap one 64-bit word at a time.
+ * Used blocks are counted with a single popcount per word, and free runs are
+ * walked with count-trailing-zeros, so a word costs a few instructions instead
+ * of 64 calls to is_block_free().
+ * @param arg A pointer to the scan_chunk describing the range.
+ * @return NULL.
+ */
+static void *scan_bitmap_range(void *arg) {
+    scan_chunk *c = (scan_chunk *)arg;
+    long nbytes = (c->end + 7) / 8;
+    long run = 0;
+    int seen_used = 0;
+
+    c->used = 0;
+    memset(&c->interior, 0, sizeof(c->interior));
+
+    for (long bit = c->start; bit < c->end; bit += 64) {
+        int valid = c->end - bit < 64 ? (int)(c->end - bit) : 64;
+        uint64_t mask = valid == 64 ? ~(uint64_t)0 : (((uint64_t)1 << valid) - 1);
+        uint64_t w = load_bitmap_word(c->ub, bit / 64, nbytes) & mask;
+        int pos = 0;
+
+        if (w == 0) {
+            run += valid;
+            continue;
+        }
+        c->used += __builtin_popcountll(w);
+
+        while (pos < valid) {
+            uint64_t rest = w >> pos;
+            if (rest == 0) {
+                run += valid - pos;
+                break;
+            }
+            int z = __builtin_ctzll(rest);     // free blocks before the next used one
+            run += z;
+            if (!seen_used) {
+                c->lead = run;
+                seen_used = 1;
+            } else {
+                record_extent(&c->interior, run);
+            }
+            run = 0;
+            pos += z;
+            uint64_t free_bits = ~(w >> pos);
+            pos = free_bits ? pos + __builtin_ctzll(free_bits) : valid; // skip the used blocks
+        }
+    }
+
+    c->all_free = !seen_used;
+    if (c->all_free) {
+        c->lead = run;
+        c->trail = run;
+    } else {
+        c->trail = run;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Counts used blocks and collects fragmentation statistics for a bitmap.
+ * Bitmaps of at least CHECK_PAR_MIN_BLOCKS blocks are split into word-aligned
+ * chunks that are scanned by separate threads and merged afterwards.
+ * @param ub The bitmap.
+ * @param n The number of blocks.
+ * @param st The statistics to fill in.
+ * @return 0 on success, -1 on failure.
+ */
+int scan_bitmap(const unsigned char *ub, long n, fs_stats *st) {
+    int nthreads = 1;
+    long words = (n + 63) / 64;
+
+    if (n >= CHECK_PAR_MIN_BLOCKS) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus < 1 ? 1 : (cpus > CHECK_MAX_THREADS ? CHECK_MAX_THREADS : (int)cpus);
+    }
+
+    scan_chunk *chunks = (scan_chunk *)calloc(nthreads, sizeof(scan_chunk));
+    pthread_t *tids = (pthread_t *)calloc(nthreads, sizeof(pthread_t));
+    if (!chunks || !tids) {
+        perror("Memory allocation failed");
+        free(chunks);
+        free(tids);
+        return -1;
+    }
+
+    long per = (words + nthreads - 1) / nthreads;
+    for (int t = 0; t < nthreads; t++) {
+        chunks[t].ub = ub;
+        chunks[t].start = t * per * 64 < n ? t * per * 64 : n;
+        chunks[t].end = (t + 1) * per * 64 < n ? (t + 1) * per * 64 : n;
+    }
+
+    int started = 0;
+    for (int t = 1; t < nthreads; t++) {
+        if (pthread_create(&tids[t], NULL, scan_bitmap_range, &chunks[t]) != 0) {
+            break;
+        }
+        started = t;
+    }
+    scan_bitmap_range(&chunks[0]);
+    for (int t = 1; t <= started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    for (int t = started + 1; t < nthreads; t++) {
+        scan_bitmap_range(&chunks[t]); // thread creation failed, scan inline
+    }
+
+    memset(st, 0, sizeof(*st));
+    long carry = 0;
+    for (int t = 0; t < nthreads; t++) {
+        scan_chunk *c = &chunks[t];
+        st->used += c->used;
+        if (c->all_free) {
+            carry += c->end - c->start;
+            continue;
+        }
+        record_extent(st, carry + c->lead);
+        for (int k = 0; k < EXTENT_BUCKETS; k++) {
+            st->hist[k] += c->interior.hist[k];
+        }
+        st->extents += c->interior.extents;
+        if (c->interior.largest_free_run > st->largest_free_run) {
+            st->largest_free_run = c->interior.largest_free_run;
+        }
+        carry = c->trail;
+    }
+    record_extent(st, carry);
+    st->free = n - st->used;
+
+    free(chunks);
+    free(tids);
+    return 0;
+}
+
+/**
+ * @brief Checks the integrity of the file system and collects fragmentation statistics.
  * @param fname The name of the file.
+ * @param st The statistics to fill in, or NULL if they are not needed.
  * @return 0 if the file system is consistent, -1 otherwise.
  */
-int check_fs(const char *fname) {
+int check_fs_stats(const char *fname, fs_stats *st) {
     int fd = open(fname, O_RDONLY);
     if (fd == -1) {
         perror("Failed to open file");
@@ -301,21 +915,20 @@ int check_fs(const char *fname) {
         return -1;
     }
     
-    int counted_used = 0;
-    int counted_free = 0;
-    
-    for (int i = 0; i < metadata->n; i++) {
-        if (is_block_free(metadata, i)) {
-            counted_free++;
-        } else {
-            counted_used++;
-        }
+    fs_stats local;
+    if (!st) {
+        st = &local;
+    }
+    if (scan_bitmap(metadata->ub, metadata->n, st) != 0) {
+        free(metadata);
+        close(fd);
+        return -1;
     }
     
-    if (counted_used != metadata->ubn || counted_free != metadata->fbn) {
+    if (st->used != metadata->ubn || st->free != metadata->fbn) {
         fprintf(stderr, "Inconsistency detected: \n");
         fprintf(stderr, "Metadata: ubn=%d, fbn=%d\n", metadata->ubn, metadata->fbn);
-        fprintf(stderr, "Counted: used=%d, free=%d\n", counted_used, counted_free);
+        fprintf(stderr, "Counted: used=%ld, free=%ld\n", st->used, st->free);
         free(metadata);
         close(fd);
         return -1;
@@ -326,6 +939,30 @@ int check_fs(const char *fname) {
     return 0;
 }
 
+/**
+ * @brief Checks the integrity of the file system.
+ * @param fname The name of the file.
+ * @return 0 if the file system is consistent, -1 otherwise.
+ */
+int check_fs(const char *fname) {
+    return check_fs_stats(fname, NULL);
+}
+
+/**
+ * @brief Prints the block counts and the free-extent histogram.
+ * @param st The statistics to print.
+ */
+void print_fs_stats(const fs_stats *st) {
+    printf("Used blocks: %ld, free blocks: %ld\n", st->used, st->free);
+    printf("Free extents: %ld, largest free run: %ld blocks\n", st->extents, st->largest_free_run);
+    for (int k = 0; k < EXTENT_BUCKETS; k++) {
+        if (st->hist[k] != 0) {
+            printf("  extents of %ld-%ld blocks: %ld\n",
+                   1L << k, (1L << (k + 1)) - 1, st->hist[k]);
+        }
+    }
+}
+
 /**
  * @brief Demonstrates the file system functions.
  * @param fname The name of the file to use for the demonstration.
@@ -368,18 +1005,250 @@ void demonstrate_functions(const char *fname) {
     }
     
     printf("\nChecking file system integrity after operations...\n");
-    if (check_fs(fname) == 0) {
+    fs_stats st;
+    if (check_fs_stats(fname, &st) == 0) {
         printf("File system integrity check passed.\n");
+        print_fs_stats(&st);
     } else {
         printf("File system integrity check failed.\n");
     }
 }
 
 /**
- * @brief The main function. It runs the demonstration.
- * @return 0 on success.
+ * @brief Returns the current monotonic time in seconds.
+ * @return The time in seconds.
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Stress-tests the shared allocator with several forked processes.
+ * Every child allocates its share of the blocks at the same time and records the
+ * block numbers it got in a shared array. The parent then checks that no block was
+ * handed out twice, and the children free everything again in parallel.
+ * @param fname The name of the block file to create.
+ * @param nprocs The number of allocator processes.
+ * @param per_proc The number of blocks each process allocates.
+ * @return 0 if no block was allocated twice and the file is consistent, -1 otherwise.
+ */
+int stress_allocator(const char *fname, int nprocs, int per_proc) {
+    long total = (long)nprocs * per_proc;
+
+    if (nprocs <= 0 || per_proc <= 0 || total > 0x7fffffff) {
+        fprintf(stderr, "Invalid process or allocation count\n");
+        return -1;
+    }
+    if (init_file_dd(fname, 512, (int)total) != 0) {
+        return -1;
+    }
+
+    int *got = (int *)mmap(NULL, total * sizeof(int), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (got == MAP_FAILED) {
+        perror("Failed to map result array");
+        return -1;
+    }
+
+    for (int phase = 0; phase < 2; phase++) {
+        double start = now_sec();
+        for (int p = 0; p < nprocs; p++) {
+            pid_t pid = fork();
+            if (pid == -1) {
+                perror("fork failed");
+                munmap(got, total * sizeof(int));
+                return -1;
+            }
+            if (pid == 0) {
+                shared_alloc sa;
+                int *mine = got + (long)p * per_proc;
+                if (shared_alloc_open(&sa, fname) != 0) {
+                    _exit(1);
+                }
+                for (int i = 0; i < per_proc; i++) {
+                    if (phase == 0) {
+                        mine[i] = shared_get_freeblock(&sa);
+                    } else if (shared_free_block(&sa, mine[i]) != 1) {
+                        _exit(1);
+                    }
+                }
+                shared_alloc_close(&sa);
+                _exit(0);
+            }
+        }
+
+        int failed = 0;
+        int status;
+        while (wait(&status) > 0) {
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failed = 1;
+            }
+        }
+        double elapsed = now_sec() - start;
+        printf("%s: %ld blocks by %d processes in %.3f s (%.0f ops/s)\n",
+               phase == 0 ? "allocate" : "free", total, nprocs, elapsed, total / elapsed);
+        if (failed) {
+            fprintf(stderr, "A %s process failed\n", phase == 0 ? "allocator" : "free");
+            munmap(got, total * sizeof(int));
+            return -1;
+        }
+
+        if (phase == 0) {
+            unsigned char *seen = (unsigned char *)calloc(total, 1);
+            long dups = 0;
+            if (!seen) {
+                perror("Memory allocation failed");
+                munmap(got, total * sizeof(int));
+                return -1;
+            }
+            for (long i = 0; i < total; i++) {
+                if (got[i] < 0 || got[i] >= total || seen[got[i]]++) {
+                    dups++;
+                }
+            }
+            free(seen);
+            printf("Double or invalid allocations: %ld\n", dups);
+            if (dups != 0) {
+                munmap(got, total * sizeof(int));
+                return -1;
+            }
+        }
+
+        fs_stats st;
+        if (check_fs_stats(fname, &st) != 0 || st.used != (phase == 0 ? total : 0)) {
+            fprintf(stderr, "File system inconsistent after %s phase\n", phase == 0 ? "allocate" : "free");
+            munmap(got, total * sizeof(int));
+            return -1;
+        }
+    }
+
+    munmap(got, total * sizeof(int));
+    return 0;
+}
+
+/**
+ * @brief Benchmarks block reads through the cache against direct pread() calls.
+ * A sequential pass, a uniformly random pass and a skewed random pass (90% of the
+ * accesses go to 10% of the blocks) are timed, followed by random block writes.
+ * @param fname The name of the block file to create.
+ * @param nblocks The number of blocks in the file.
+ * @param capacity The number of blocks the cache may hold.
+ * @param ops The number of accesses in each pass.
+ * @return 0 on success, -1 on failure.
+ */
+int bench_block_cache(const char *fname, int nblocks, int capacity, int ops) {
+    const int bsize = 4096;
+    const char *pass[] = { "sequential", "random", "skewed random", "random write" };
+    block_cache c;
+    char *buf;
+
+    if (nblocks <= 0 || ops <= 0) {
+        fprintf(stderr, "Invalid block or operation count\n");
+        return -1;
+    }
+    if (init_file_dd(fname, bsize, nblocks) != 0) {
+        return -1;
+    }
+    if (block_cache_open(&c, fname, capacity) != 0) {
+        return -1;
+    }
+    buf = (char *)calloc(1, bsize);
+    if (!buf) {
+        perror("Memory allocation failed");
+        block_cache_close(&c);
+        return -1;
+    }
+
+    printf("%d blocks of %d bytes, cache of %d blocks, %d accesses per pass\n", nblocks, bsize, capacity, ops);
+    printf("%-14s %12s %12s %10s %10s\n", "pass", "cached op/s", "direct op/s", "hits", "misses");
+    for (int k = 0; k < 4; k++) {
+        double cached, direct;
+        long hits = c.hits, misses = c.misses;
+
+        srand(k + 1);
+        double start = now_sec();
+        for (int i = 0; i < ops; i++) {
+            int bno = k == 0 ? i % nblocks
+                    : k == 2 && rand() % 10 != 0 ? rand() % (nblocks / 10 + 1)
+                    : rand() % nblocks;
+            int rc = k == 3 ? write_block(&c, bno, buf) : read_block(&c, bno, buf);
+            if (rc != 0) {
+                free(buf);
+                block_cache_close(&c);
+                return -1;
+            }
+        }
+        if (k == 3 && block_cache_flush(&c) != 0) {
+            free(buf);
+            block_cache_close(&c);
+            return -1;
+        }
+        cached = ops / (now_sec() - start);
+
+        srand(k + 1);
+        start = now_sec();
+        for (int i = 0; i < ops; i++) {
+            int bno = k == 0 ? i % nblocks
+                    : k == 2 && rand() % 10 != 0 ? rand() % (nblocks / 10 + 1)
+                    : rand() % nblocks;
+            off_t off = c.meta_size + (off_t)bno * bsize;
+            ssize_t rc = k == 3 ? pwrite(c.fd, buf, bsize, off) : pread(c.fd, buf, bsize, off);
+            if (rc != bsize) {
+                perror("Direct block I/O failed");
+                free(buf);
+                block_cache_close(&c);
+                return -1;
+            }
+        }
+        direct = ops / (now_sec() - start);
+
+        printf("%-14s %12.0f %12.0f %10ld %10ld\n", pass[k], cached, direct, c.hits - hits, c.misses - misses);
+    }
+    printf("Dirty pages written back: %ld\n", c.writebacks);
+
+    free(buf);
+    return block_cache_close(&c);
+}
+
+/**
+ * @brief The main function. It runs the demonstration, checks an existing file
+ * when invoked as "check <file>", or stress-tests the shared allocator when invoked
+ * as "stress <file> <processes> <blocks per process>", or benchmarks the block cache
+ * when invoked as "cachebench <file> <blocks> <cache blocks> <accesses>".
+ * @param argc The number of command-line arguments.
+ * @param argv An array of command-line arguments.
+ * @return 0 on success, 1 on failure.
  */
-int main() {
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "check") == 0) {
+        fs_stats st;
+        if (check_fs_stats(argv[2], &st) != 0) {
+            printf("File system integrity check failed.\n");
+            return 1;
+        }
+        printf("File system integrity check passed.\n");
+        print_fs_stats(&st);
+        return 0;
+    }
+    if (argc == 5 && strcmp(argv[1], "stress") == 0) {
+        if (stress_allocator(argv[2], atoi(argv[3]), atoi(argv[4])) != 0) {
+            printf("Allocator stress test failed.\n");
+            return 1;
+        }
+        printf("Allocator stress test passed.\n");
+        return 0;
+    }
+    if (argc == 6 && strcmp(argv[1], "cachebench") == 0) {
+        return bench_block_cache(argv[2], atoi(argv[3]), atoi(argv[4]), atoi(argv[5])) == 0 ? 0 : 1;
+    }
+    if (argc != 1) {
+        fprintf(stderr, "Usage: %s [check <file> | stress <file> <processes> <blocks per process>"
+                        " | cachebench <file> <blocks> <cache blocks> <accesses>]\n", argv[0]);
+        return 1;
+    }
+
     const char* filename = "dd1";
     demonstrate_functions(filename);
     return 0;
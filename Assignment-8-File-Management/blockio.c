@@ -0,0 +1,360 @@
+/**
+ * @file blockio.c
+ * @brief Commands for the asynchronous, batched block I/O engine in blockio.h.
+ * The format and copy commands keep a deep queue of block requests in flight, and the
+ * bench command compares the io_uring, thread-pool and synchronous engines with
+ * one lseek()+read() per block.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "blockio.h"
+
+/**
+ * @brief Returns the current monotonic time in seconds.
+ * @return The time in seconds.
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Creates a file of zeroed blocks, keeping up to depth writes in flight.
+ * All writes share one zero-filled buffer.
+ * @param fname The name of the file to create.
+ * @param bsize The size of each block.
+ * @param nblocks The number of blocks.
+ * @param depth The queue depth.
+ * @return 0 on success, -1 on failure.
+ */
+int blk_format(const char *fname, int bsize, long nblocks, unsigned depth) {
+    if (bsize <= 0 || nblocks < 0 || depth == 0) {
+        fprintf(stderr, "Invalid block size, block count or queue depth\n");
+        return -1;
+    }
+    int fd = open(fname, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1) {
+        perror("Failed to create file");
+        return -1;
+    }
+    char *zero = (char *)calloc(1, bsize);
+    if (!zero) {
+        perror("Memory allocation failed");
+        close(fd);
+        return -1;
+    }
+    int status = blk_fill(fd, zero, bsize, 0, nblocks, depth);
+    free(zero);
+    if (close(fd) == -1) {
+        perror("close failed");
+        status = -1;
+    }
+    return status;
+}
+
+/**
+ * @brief Copies a file block by block, keeping up to depth requests in flight.
+ * Each slot cycles read -> write -> next read, so reads and writes of different
+ * blocks overlap.
+ * @param src The file to copy.
+ * @param dst The file to create.
+ * @param bsize The size of each block.
+ * @param depth The queue depth.
+ * @return 0 on success, -1 on failure.
+ */
+int blk_copy(const char *src, const char *dst, int bsize, unsigned depth) {
+    blk_engine e;
+    struct stat sb;
+    int status = 0;
+
+    if (bsize <= 0 || depth == 0) {
+        fprintf(stderr, "Invalid block size or queue depth\n");
+        return -1;
+    }
+    int in = open(src, O_RDONLY);
+    if (in == -1 || fstat(in, &sb) == -1) {
+        perror("Failed to open source");
+        if (in != -1) {
+            close(in);
+        }
+        return -1;
+    }
+    int out = open(dst, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (out == -1) {
+        perror("Failed to create destination");
+        close(in);
+        return -1;
+    }
+    if (blk_engine_init(&e, depth, BLK_AUTO) != 0) {
+        close(in);
+        close(out);
+        return -1;
+    }
+    depth = e.depth;
+
+    blk_req *reqs = (blk_req *)calloc(depth, sizeof(blk_req));
+    blk_req **batch = (blk_req **)calloc(depth, sizeof(blk_req *));
+    char *bufs = (char *)malloc((size_t)depth * bsize);
+    if (!reqs || !batch || !bufs) {
+        perror("Memory allocation failed");
+        free(reqs);
+        free(batch);
+        free(bufs);
+        blk_engine_exit(&e);
+        close(in);
+        close(out);
+        return -1;
+    }
+
+    // The size fstat() reports is only a hint: files in /proc report 0. Past it the copy
+    // goes on with one read at a time until a read comes back short.
+    long nblocks = (sb.st_size + bsize - 1) / bsize;
+    long next = 0;
+    long shortBlock = LONG_MAX; // the first block that came back short: the end of the file
+    long lastData = -1;         // the last block that came back with data
+    int probing = 0;            // reads in flight past nblocks
+    int n = 0;
+    for (unsigned i = 0; i < depth && (next < nblocks || probing == 0); i++, next++) {
+        blk_req *r = &reqs[i];
+        r->op = BLK_READ;
+        r->fd = in;
+        r->buf = bufs + (size_t)i * bsize;
+        r->len = bsize;
+        r->off = (off_t)next * bsize;
+        probing += next >= nblocks;
+        batch[n++] = r;
+    }
+
+    while (n > 0 || e.inflight > 0) {
+        if (blk_submit(&e, batch, n) != 0) {
+            status = -1;
+            break;
+        }
+        int got = blk_reap(&e, batch, depth, 1);
+        if (got < 0) {
+            status = -1;
+            break;
+        }
+        n = 0;
+        for (int i = 0; i < got; i++) {
+            blk_req *r = batch[i];
+            if (r->res < 0 || (r->op == BLK_WRITE && r->res != (ssize_t)r->len)) {
+                fprintf(stderr, "Block %s at offset %lld failed\n",
+                        r->op == BLK_READ ? "read" : "write", (long long)r->off);
+                status = -1;
+                continue;
+            }
+            if (r->op == BLK_READ) {
+                long b = r->off / bsize;
+                probing -= b >= nblocks;
+                if (r->res < (ssize_t)r->len && b < shortBlock) {
+                    shortBlock = b;
+                }
+                if (r->res > 0 && b > lastData) {
+                    lastData = b;
+                }
+                // The engines retry short reads, so a short block ends the file. A short block
+                // before the reported size, or data after a short block, means the source
+                // changed size during the copy.
+                if ((r->res < (ssize_t)r->len && b < nblocks - 1) || lastData > shortBlock) {
+                    fprintf(stderr, "Block read at offset %lld: the source changed size\n", (long long)r->off);
+                    status = -1;
+                    continue;
+                }
+            }
+            if (r->op == BLK_READ && r->res > 0) {
+                r->op = BLK_WRITE; // the last block may be short
+                r->fd = out;
+                r->len = r->res;
+            } else if (next < nblocks || (shortBlock == LONG_MAX && probing == 0)) {
+                r->op = BLK_READ;
+                r->fd = in;
+                r->len = bsize;
+                probing += next >= nblocks;
+                r->off = (off_t)next++ * bsize;
+            } else {
+                continue;
+            }
+            batch[n++] = r;
+        }
+        if (status != 0) {
+            break;
+        }
+    }
+
+    while (e.inflight > 0 && blk_reap(&e, batch, depth, e.inflight) > 0) {
+        // drain after a failure
+    }
+    blk_engine_exit(&e);
+    free(reqs);
+    free(batch);
+    free(bufs);
+    close(in);
+    if (close(out) == -1) {
+        perror("close failed");
+        status = -1;
+    }
+    return status;
+}
+
+/**
+ * @brief Measures random block-read IOPS of the synchronous path and of each engine.
+ * @param fname An existing file to read.
+ * @param bsize The size of each block.
+ * @param ops The number of reads per run.
+ * @param depth The queue depth of the asynchronous engines.
+ * @return 0 on success, -1 on failure.
+ */
+int blk_bench(const char *fname, int bsize, long ops, unsigned depth) {
+    struct stat sb;
+    if (bsize <= 0 || depth == 0) {
+        fprintf(stderr, "Invalid block size or queue depth\n");
+        return -1;
+    }
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1 || fstat(fd, &sb) == -1) {
+        perror("Failed to open file");
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    long nblocks = sb.st_size / bsize;
+    if (nblocks <= 0 || ops <= 0) {
+        fprintf(stderr, "File is smaller than one block or no reads requested\n");
+        close(fd);
+        return -1;
+    }
+
+    blk_req *reqs = (blk_req *)calloc(depth, sizeof(blk_req));
+    blk_req **batch = (blk_req **)calloc(depth, sizeof(blk_req *));
+    char *bufs = (char *)malloc((size_t)depth * bsize);
+    if (!reqs || !batch || !bufs) {
+        perror("Memory allocation failed");
+        free(reqs);
+        free(batch);
+        free(bufs);
+        close(fd);
+        return -1;
+    }
+
+    printf("%ld random reads of %d bytes from %ld blocks, queue depth %u\n", ops, bsize, nblocks, depth);
+
+    // The synchronous path of the other tools: lseek() + read() per block.
+    srand(1);
+    double start = now_sec();
+    long done = 0;
+    for (; done < ops; done++) {
+        if (lseek(fd, (off_t)(rand() % nblocks) * bsize, SEEK_SET) == -1 ||
+            read(fd, bufs, bsize) != bsize) {
+            perror("Synchronous read failed");
+            break;
+        }
+    }
+    if (done < ops) {
+        printf("%-10s %12s\n", "lseek+read", "failed");
+    } else {
+        printf("%-10s %12.0f IOPS\n", "lseek+read", ops / (now_sec() - start));
+    }
+
+    int kinds[] = { BLK_SYNC, BLK_THREADS, BLK_URING };
+    for (int k = 0; k < 3; k++) {
+        blk_engine e;
+        if (blk_engine_init(&e, depth, kinds[k]) != 0) {
+            printf("%-10s %12s\n", kinds[k] == BLK_URING ? "io_uring" : "threads", "unavailable");
+            continue;
+        }
+        unsigned d = e.depth;
+        for (unsigned i = 0; i < d; i++) {
+            reqs[i].op = BLK_READ;
+            reqs[i].fd = fd;
+            reqs[i].buf = bufs + (size_t)i * bsize;
+            reqs[i].len = bsize;
+            batch[i] = &reqs[i];
+        }
+
+        srand(1);
+        long issued = 0, completed = 0, failed = 0;
+        int n = d, stopped = 0;
+        start = now_sec();
+        while (issued < ops || e.inflight > 0) {
+            int m = 0;
+            while (m < n && issued < ops) {
+                batch[m]->off = (off_t)(rand() % nblocks) * bsize;
+                m++;
+                issued++;
+            }
+            if (blk_submit(&e, batch, m) != 0) {
+                stopped = 1;
+                break;
+            }
+            n = blk_reap(&e, batch, d, 1);
+            if (n < 0) {
+                stopped = 1;
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                if (batch[i]->res == bsize) {
+                    completed++;
+                } else {
+                    failed++;
+                }
+            }
+        }
+        double elapsed = now_sec() - start;
+        while (e.inflight > 0 && blk_reap(&e, batch, d, e.inflight) > 0) {
+            // drain after a failure
+        }
+        // The rate counts only the reads that completed in full.
+        if (stopped) {
+            printf("%-10s %12s\n", blk_engine_name(&e), "failed");
+        } else {
+            printf("%-10s %12.0f IOPS%s\n", blk_engine_name(&e), completed / elapsed,
+                   failed ? " (some reads failed)" : "");
+        }
+        blk_engine_exit(&e);
+    }
+
+    free(reqs);
+    free(batch);
+    free(bufs);
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief The main function. It dispatches to the format, copy and bench commands.
+ * @param argc The number of command-line arguments.
+ * @param argv An array of command-line arguments.
+ * @return 0 on success, 1 on failure.
+ */
+int main(int argc, char *argv[]) {
+    if (argc >= 5 && argc <= 6 && strcmp(argv[1], "format") == 0) {
+        unsigned depth = argc == 6 ? (unsigned)atoi(argv[5]) : DEFAULT_DEPTH;
+        return blk_format(argv[2], atoi(argv[3]), atol(argv[4]), depth) == 0 ? 0 : 1;
+    }
+    if (argc >= 5 && argc <= 6 && strcmp(argv[1], "copy") == 0) {
+        unsigned depth = argc == 6 ? (unsigned)atoi(argv[5]) : DEFAULT_DEPTH;
+        return blk_copy(argv[2], argv[3], atoi(argv[4]), depth) == 0 ? 0 : 1;
+    }
+    if (argc >= 5 && argc <= 6 && strcmp(argv[1], "bench") == 0) {
+        unsigned depth = argc == 6 ? (unsigned)atoi(argv[5]) : DEFAULT_DEPTH;
+        return blk_bench(argv[2], atoi(argv[3]), atol(argv[4]), depth) == 0 ? 0 : 1;
+    }
+
+    fprintf(stderr, "Usage: %s format <file> <block size> <blocks> [depth]\n", argv[0]);
+    fprintf(stderr, "       %s copy <source> <destination> <block size> [depth]\n", argv[0]);
+    fprintf(stderr, "       %s bench <file> <block size> <reads> [depth]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,592 @@
+/**
+ * @file blockio.h
+ * @brief An asynchronous, batched block I/O engine shared by the block-file tools.
+ * Block reads and writes are queued in batches and completed asynchronously, either
+ * through io_uring or, where io_uring is not available, through a pool of threads
+ * doing pread()/pwrite(). blk_run() and blk_fill() keep a deep queue of requests in
+ * flight for the bulk paths of blockio.c, blockfile2.c, myfs.c and myfsv1.c.
+ * Programs that include it are compiled with -pthread.
+ */
+
+#ifndef BLOCKIO_H
+#define BLOCKIO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// linux/fs.h, included by linux/io_uring.h, defines BLOCK_SIZE; the tools define their own.
+#undef BLOCK_SIZE
+
+#define BLK_READ 0
+#define BLK_WRITE 1
+
+#define BLK_AUTO 0      // io_uring if the kernel allows it, threads otherwise
+#define BLK_URING 1
+#define BLK_THREADS 2
+#define BLK_SYNC 3      // requests complete inside blk_submit(), for comparison
+
+#define POOL_THREADS 8  // workers of the thread-pool engine
+#define DEFAULT_DEPTH 64
+
+/**
+ * @struct blk_req
+ * @brief One block read or write.
+ */
+typedef struct blk_req {
+    int op;             // BLK_READ or BLK_WRITE
+    int fd;             // file to read or write
+    void *buf;          // data buffer
+    size_t len;         // bytes to transfer
+    off_t off;          // offset in the file
+    ssize_t res;        // bytes transferred, or -errno, once completed
+    size_t done;        // bytes transferred so far, while a short transfer is being retried
+    struct blk_req *next; // queue link used by the thread-pool engine
+} blk_req;
+
+/**
+ * @struct blk_engine
+ * @brief The state of one I/O engine.
+ */
+typedef struct {
+    int kind;           // BLK_URING, BLK_THREADS or BLK_SYNC
+    unsigned depth;     // maximum number of requests in flight
+    unsigned inflight;  // requests submitted but not yet reaped
+
+    // io_uring
+    int ring_fd;
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // thread pool, and the completion list of the synchronous engine
+    pthread_t threads[POOL_THREADS];
+    int nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    blk_req *sub_head, *sub_tail;
+    blk_req *done_head, *done_tail;
+    int stopping;
+} blk_engine;
+
+/**
+ * @brief Performs one request synchronously, retrying short transfers.
+ * @param r The request.
+ */
+static inline void blk_do_sync(blk_req *r) {
+    size_t done = 0;
+
+    while (done < r->len) {
+        ssize_t n = r->op == BLK_READ
+                  ? pread(r->fd, (char *)r->buf + done, r->len - done, r->off + done)
+                  : pwrite(r->fd, (char *)r->buf + done, r->len - done, r->off + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            r->res = -errno;
+            return;
+        }
+        if (n == 0) {
+            break; // end of file
+        }
+        done += n;
+    }
+    r->res = done;
+}
+
+/**
+ * @brief Appends a request to a singly linked request queue.
+ */
+static inline void queue_push(blk_req **head, blk_req **tail, blk_req *r) {
+    r->next = NULL;
+    if (*tail) {
+        (*tail)->next = r;
+    } else {
+        *head = r;
+    }
+    *tail = r;
+}
+
+/**
+ * @brief Removes the first request of a singly linked request queue.
+ */
+static inline blk_req *queue_pop(blk_req **head, blk_req **tail) {
+    blk_req *r = *head;
+    if (r) {
+        *head = r->next;
+        if (!*head) {
+            *tail = NULL;
+        }
+    }
+    return r;
+}
+
+/**
+ * @brief A worker of the thread-pool engine.
+ * @param arg The engine.
+ * @return NULL.
+ */
+static inline void *pool_worker(void *arg) {
+    blk_engine *e = (blk_engine *)arg;
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        while (!e->sub_head && !e->stopping) {
+            pthread_cond_wait(&e->work, &e->lock);
+        }
+        if (!e->sub_head) {
+            break;
+        }
+        blk_req *r = queue_pop(&e->sub_head, &e->sub_tail);
+        pthread_mutex_unlock(&e->lock);
+
+        blk_do_sync(r);
+
+        pthread_mutex_lock(&e->lock);
+        queue_push(&e->done_head, &e->done_tail, r);
+        pthread_cond_signal(&e->done);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+/**
+ * @brief Sets up an io_uring instance and maps its rings.
+ * @param e The engine.
+ * @return 0 on success, -1 if io_uring is not available.
+ */
+static inline int uring_setup(blk_engine *e) {
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    e->ring_fd = syscall(__NR_io_uring_setup, e->depth, &p);
+    if (e->ring_fd < 0) {
+        return -1;
+    }
+
+    e->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    e->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (e->cq_map_len > e->sq_map_len) {
+            e->sq_map_len = e->cq_map_len;
+        }
+        e->cq_map_len = e->sq_map_len;
+    }
+
+    e->sq_map = mmap(NULL, e->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     e->ring_fd, IORING_OFF_SQ_RING);
+    if (e->sq_map == MAP_FAILED) {
+        close(e->ring_fd);
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        e->cq_map = e->sq_map;
+    } else {
+        e->cq_map = mmap(NULL, e->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         e->ring_fd, IORING_OFF_CQ_RING);
+        if (e->cq_map == MAP_FAILED) {
+            munmap(e->sq_map, e->sq_map_len);
+            close(e->ring_fd);
+            return -1;
+        }
+    }
+    e->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    e->sqes = (struct io_uring_sqe *)mmap(NULL, e->sqes_len, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, e->ring_fd, IORING_OFF_SQES);
+    if (e->sqes == MAP_FAILED) {
+        if (e->cq_map != e->sq_map) {
+            munmap(e->cq_map, e->cq_map_len);
+        }
+        munmap(e->sq_map, e->sq_map_len);
+        close(e->ring_fd);
+        return -1;
+    }
+
+    char *sq = (char *)e->sq_map;
+    char *cq = (char *)e->cq_map;
+    e->sq_head = (unsigned *)(sq + p.sq_off.head);
+    e->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    e->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    e->sq_array = (unsigned *)(sq + p.sq_off.array);
+    e->cq_head = (unsigned *)(cq + p.cq_off.head);
+    e->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    e->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    e->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    if (p.sq_entries < e->depth) {
+        e->depth = p.sq_entries;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fills the submission queue entry at position tail for the part of a request not yet done.
+ */
+static inline void uring_fill(blk_engine *e, unsigned tail, blk_req *r) {
+    unsigned idx = tail & *e->sq_mask;
+    struct io_uring_sqe *sqe = &e->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = r->op == BLK_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = r->fd;
+    sqe->addr = (unsigned long)((char *)r->buf + r->done);
+    sqe->len = r->len - r->done;
+    sqe->off = r->off + r->done;
+    sqe->user_data = (unsigned long)r;
+    e->sq_array[idx] = idx;
+}
+
+/**
+ * @brief Hands the next n queued submission queue entries to the kernel.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int uring_enter_all(blk_engine *e, int n) {
+    while (n > 0) {
+        int rc = syscall(__NR_io_uring_enter, e->ring_fd, n, 0, 0, NULL, 0);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc < 0) {
+            perror("io_uring_enter failed");
+            return -1;
+        }
+        n -= rc;
+    }
+    return 0;
+}
+
+/**
+ * @brief Initializes an I/O engine.
+ * @param e The engine to initialize.
+ * @param depth The maximum number of requests in flight.
+ * @param kind BLK_AUTO, BLK_URING, BLK_THREADS or BLK_SYNC.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int blk_engine_init(blk_engine *e, unsigned depth, int kind) {
+    memset(e, 0, sizeof(*e));
+    e->depth = depth ? depth : 1;
+    e->ring_fd = -1;
+
+    if (kind == BLK_AUTO || kind == BLK_URING) {
+        if (uring_setup(e) == 0) {
+            e->kind = BLK_URING;
+            return 0;
+        }
+        if (kind == BLK_URING) {
+            perror("io_uring_setup failed");
+            return -1;
+        }
+        kind = BLK_THREADS;
+    }
+
+    e->kind = kind;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->work, NULL);
+    pthread_cond_init(&e->done, NULL);
+    if (kind == BLK_THREADS) {
+        int want = e->depth < POOL_THREADS ? (int)e->depth : POOL_THREADS;
+        for (e->nthreads = 0; e->nthreads < want; e->nthreads++) {
+            if (pthread_create(&e->threads[e->nthreads], NULL, pool_worker, e) != 0) {
+                break;
+            }
+        }
+        if (e->nthreads == 0) {
+            fprintf(stderr, "Cannot start I/O threads\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the name of the engine in use.
+ * @param e The engine.
+ * @return The name.
+ */
+static inline const char *blk_engine_name(const blk_engine *e) {
+    return e->kind == BLK_URING ? "io_uring" : e->kind == BLK_THREADS ? "threads" : "sync";
+}
+
+/**
+ * @brief Queues a batch of requests. The caller must not have more than
+ * e->depth requests in flight, counting this batch.
+ * @param e The engine.
+ * @param reqs The requests.
+ * @param n The number of requests.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int blk_submit(blk_engine *e, blk_req **reqs, int n) {
+    if (n <= 0) {
+        return 0;
+    }
+    if (e->inflight + n > e->depth) {
+        fprintf(stderr, "blk_submit: queue depth %u exceeded\n", e->depth);
+        return -1;
+    }
+
+    if (e->kind == BLK_URING) {
+        unsigned tail = *e->sq_tail;
+        for (int i = 0; i < n; i++) {
+            reqs[i]->done = 0;
+            uring_fill(e, tail++, reqs[i]);
+        }
+        __atomic_store_n(e->sq_tail, tail, __ATOMIC_RELEASE);
+        if (uring_enter_all(e, n) != 0) {
+            return -1;
+        }
+        e->inflight += n;
+        return 0;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    for (int i = 0; i < n; i++) {
+        if (e->kind == BLK_SYNC) {
+            blk_do_sync(reqs[i]);
+            queue_push(&e->done_head, &e->done_tail, reqs[i]);
+        } else {
+            queue_push(&e->sub_head, &e->sub_tail, reqs[i]);
+        }
+    }
+    e->inflight += n;
+    if (e->kind == BLK_THREADS) {
+        pthread_cond_broadcast(&e->work);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return 0;
+}
+
+/**
+ * @brief Collects completed requests. Like blk_do_sync(), the io_uring engine resubmits
+ * the rest of a short transfer, so a request completes short only at the end of the file.
+ * @param e The engine.
+ * @param done Receives up to max completed requests.
+ * @param max The size of done.
+ * @param min The number of completions to wait for (at most the number in flight).
+ * @return The number of completed requests, or -1 on failure.
+ */
+static inline int blk_reap(blk_engine *e, blk_req **done, int max, int min) {
+    int got = 0;
+
+    if (min > (int)e->inflight) {
+        min = e->inflight;
+    }
+
+    if (e->kind == BLK_URING) {
+        for (;;) {
+            unsigned head = *e->cq_head;
+            unsigned tail = __atomic_load_n(e->cq_tail, __ATOMIC_ACQUIRE);
+            unsigned sq_tail = *e->sq_tail;
+            int again = 0;
+            while (head != tail && got < max) {
+                struct io_uring_cqe *cqe = &e->cqes[head & *e->cq_mask];
+                blk_req *r = (blk_req *)(unsigned long)cqe->user_data;
+                if (cqe->res > 0 && r->done + cqe->res < r->len) {
+                    // A short transfer: queue the rest, which stays in flight.
+                    r->done += cqe->res;
+                    uring_fill(e, sq_tail++, r);
+                    again++;
+                } else {
+                    r->res = cqe->res < 0 ? cqe->res : (ssize_t)(r->done + cqe->res);
+                    done[got++] = r;
+                }
+                head++;
+            }
+            __atomic_store_n(e->cq_head, head, __ATOMIC_RELEASE);
+            if (again > 0) {
+                __atomic_store_n(e->sq_tail, sq_tail, __ATOMIC_RELEASE);
+                if (uring_enter_all(e, again) != 0) {
+                    return -1;
+                }
+            }
+            if (got >= min) {
+                break;
+            }
+            int rc = syscall(__NR_io_uring_enter, e->ring_fd, 0, min - got,
+                             IORING_ENTER_GETEVENTS, NULL, 0);
+            if (rc < 0 && errno != EINTR) {
+                perror("io_uring_enter failed");
+                return -1;
+            }
+        }
+        e->inflight -= got;
+        return got;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        blk_req *r;
+        while (got < max && (r = queue_pop(&e->done_head, &e->done_tail)) != NULL) {
+            done[got++] = r;
+        }
+        if (got >= min) {
+            break;
+        }
+        pthread_cond_wait(&e->done, &e->lock);
+    }
+    e->inflight -= got;
+    pthread_mutex_unlock(&e->lock);
+    return got;
+}
+
+/**
+ * @brief Shuts an engine down. All requests must have been reaped.
+ * @param e The engine.
+ */
+static inline void blk_engine_exit(blk_engine *e) {
+    if (e->kind == BLK_URING) {
+        munmap(e->sqes, e->sqes_len);
+        if (e->cq_map != e->sq_map) {
+            munmap(e->cq_map, e->cq_map_len);
+        }
+        munmap(e->sq_map, e->sq_map_len);
+        close(e->ring_fd);
+        return;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    e->stopping = 1;
+    pthread_cond_broadcast(&e->work);
+    pthread_mutex_unlock(&e->lock);
+    for (int i = 0; i < e->nthreads; i++) {
+        pthread_join(e->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->work);
+    pthread_cond_destroy(&e->done);
+}
+
+/**
+ * @brief Runs a set of requests to completion, keeping up to the engine's depth in flight.
+ * @param e The engine; no requests may be in flight.
+ * @param reqs The requests.
+ * @param n The number of requests.
+ * @return 0 if every request transferred all of its bytes, -1 otherwise.
+ */
+static inline int blk_run(blk_engine *e, blk_req *reqs, long n) {
+    blk_req **batch = (blk_req **)calloc(e->depth, sizeof(blk_req *));
+    long next = 0;
+    int status = 0;
+
+    if (!batch) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    while (next < n || e->inflight > 0) {
+        int m = 0;
+        while (next < n && e->inflight + m < e->depth) {
+            batch[m++] = &reqs[next++];
+        }
+        if (blk_submit(e, batch, m) != 0) {
+            status = -1;
+            break;
+        }
+        int got = blk_reap(e, batch, e->depth, 1);
+        if (got < 0) {
+            status = -1;
+            break;
+        }
+        for (int i = 0; i < got; i++) {
+            if (batch[i]->res != (ssize_t)batch[i]->len) {
+                fprintf(stderr, "Block %s at offset %lld failed\n",
+                        batch[i]->op == BLK_READ ? "read" : "write", (long long)batch[i]->off);
+                status = -1;
+            }
+        }
+        if (status != 0) {
+            break;
+        }
+    }
+    while (e->inflight > 0 && blk_reap(e, batch, e->depth, e->inflight) > 0) {
+        // drain after a failure
+    }
+    free(batch);
+    return status;
+}
+
+/**
+ * @brief Writes the same buffer to count consecutive blocks, keeping up to depth writes in flight.
+ * @param fd The file to write.
+ * @param buf The contents of every block.
+ * @param bsize The size of each block.
+ * @param off The offset of the first block.
+ * @param count The number of blocks.
+ * @param depth The queue depth.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int blk_fill(int fd, const void *buf, int bsize, off_t off, long count, unsigned depth) {
+    blk_engine e;
+    int status = 0;
+
+    if (bsize <= 0 || count < 0 || depth == 0) {
+        fprintf(stderr, "Invalid block size, block count or queue depth\n");
+        return -1;
+    }
+    blk_req *reqs = (blk_req *)calloc(depth, sizeof(blk_req));
+    blk_req **batch = (blk_req **)calloc(depth, sizeof(blk_req *));
+    if (!reqs || !batch || blk_engine_init(&e, depth, BLK_AUTO) != 0) {
+        perror("Failed to set up the block writes");
+        free(reqs);
+        free(batch);
+        return -1;
+    }
+    depth = e.depth;
+
+    // Every request slot starts free; a completed write frees its slot for the next block.
+    long next = 0;
+    int nfree = depth;
+    for (unsigned i = 0; i < depth; i++) {
+        batch[i] = &reqs[i];
+    }
+    while (next < count || e.inflight > 0) {
+        int n = 0;
+        while (n < nfree && next < count) {
+            blk_req *r = batch[n++];
+            r->op = BLK_WRITE;
+            r->fd = fd;
+            r->buf = (void *)buf;
+            r->len = bsize;
+            r->off = off + (off_t)next++ * bsize;
+        }
+        if (blk_submit(&e, batch, n) != 0) {
+            status = -1;
+            break;
+        }
+        // Completed slots are collected at the front of batch and reused.
+        int got = blk_reap(&e, batch, depth, 1);
+        if (got < 0) {
+            status = -1;
+            break;
+        }
+        for (int i = 0; i < got; i++) {
+            if (batch[i]->res != (ssize_t)batch[i]->len) {
+                fprintf(stderr, "Block write at offset %lld failed\n", (long long)batch[i]->off);
+                status = -1;
+            }
+        }
+        nfree = got;
+        if (status != 0) {
+            break;
+        }
+    }
+
+    while (e.inflight > 0 && blk_reap(&e, batch, depth, e.inflight) > 0) {
+        // drain after a failure
+    }
+    blk_engine_exit(&e);
+    free(reqs);
+    free(batch);
+    return status;
+}
+
+#endif
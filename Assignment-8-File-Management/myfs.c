@@ -13,6 +13,7 @@ Remaining 2048 blocks of dd1 are data blocks of the contained files.
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include "blockio.h" /* batched block I/O; compile with -pthread */
 
 # define METADATA_BLOCK 8
 #define DATA_BLOCK 2048 
@@ -41,12 +42,30 @@ int create_filesystem(char *filename) {
         perror("Error creating filesystem");
         return -1;
     }
+    /* the zeroed blocks are written in batches, many at a time */
     char buffer[BLOCK_SIZE] = {0};
-    for (int i = 0; i < METADATA_BLOCK + DATA_BLOCK; i++) {
-        write_block(fd, i, buffer);
-    }
+    int status = blk_fill(fd, buffer, BLOCK_SIZE, 0, METADATA_BLOCK + DATA_BLOCK, DEFAULT_DEPTH);
     close(fd);
-    return 0;
+    return status;
+}
+
+/* Reads the metadata at the start of every data block with one batch of reads. */
+int read_all_metadata(int fd, struct file_metadata *metas) {
+    blk_engine e;
+    blk_req reqs[DATA_BLOCK];
+    if (blk_engine_init(&e, DEFAULT_DEPTH, BLK_AUTO) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < DATA_BLOCK; i++) {
+        reqs[i].op = BLK_READ;
+        reqs[i].fd = fd;
+        reqs[i].buf = &metas[i];
+        reqs[i].len = sizeof(struct file_metadata);
+        reqs[i].off = (off_t)(METADATA_BLOCK + i) * BLOCK_SIZE;
+    }
+    int status = blk_run(&e, reqs, DATA_BLOCK);
+    blk_engine_exit(&e);
+    return status;
 }
 
 int get_free_block(char *filename) {
@@ -56,10 +75,13 @@ int get_free_block(char *filename) {
         perror("Error opening filesystem");
         return -1;
     }
-    char buffer[BLOCK_SIZE];
+    static struct file_metadata metas[DATA_BLOCK];
+    if (read_all_metadata(fd, metas) != 0) {
+        close(fd);
+        return -1;
+    }
     for (int i = 0; i < DATA_BLOCK; i++) {
-        read_block(fd, METADATA_BLOCK + i, buffer);
-        if (buffer[0] == '\0') { // Check if the block is free
+        if (metas[i].name[0] == '\0') { // Check if the block is free
             close(fd);
             return METADATA_BLOCK + i;
         }
@@ -151,12 +173,15 @@ void myCopyFrom(char *filename, char *linux_file) {
         perror("Error opening filesystem");
         return;
     }
-    struct file_metadata metadata;
+    static struct file_metadata metas[DATA_BLOCK];
     char buffer[BLOCK_SIZE];
     int block_num = -1;
+    if (read_all_metadata(fd, metas) != 0) {
+        close(fd);
+        return;
+    }
     for (int i = 0; i < DATA_BLOCK; i++) {
-        read_metadata(filename, METADATA_BLOCK + i, &metadata);
-        if (strcmp(metadata.name, linux_file) == 0) {
+        if (strncmp(metas[i].name, linux_file, MAX_FILE_NAME) == 0) {
             block_num = METADATA_BLOCK + i;
             break;
         }
@@ -173,7 +198,7 @@ void myCopyFrom(char *filename, char *linux_file) {
         close(fd);
         return;
     }
-    write(linux_fd, buffer, metadata.size);
+    write(linux_fd, buffer, metas[block_num - METADATA_BLOCK].size);
     printf("File %s copied from filesystem %s to Linux file %s.\n", linux_file, filename, linux_file);
     close(linux_fd);
     close(fd);
@@ -186,11 +211,14 @@ void myrm(char *filename, char *linux_file) {
         perror("Error opening filesystem");
         return;
     }
-    struct file_metadata metadata;
+    static struct file_metadata metas[DATA_BLOCK];
     int block_num = -1;
+    if (read_all_metadata(fd, metas) != 0) {
+        close(fd);
+        return;
+    }
     for (int i = 0; i < DATA_BLOCK; i++) {
-        read_metadata(filename, METADATA_BLOCK + i, &metadata);
-        if (strcmp(metadata.name, linux_file) == 0) {
+        if (strncmp(metas[i].name, linux_file, MAX_FILE_NAME) == 0) {
             block_num = METADATA_BLOCK + i;
             break;
         }
@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <stdint.h>
+#include "blockio.h" /* batched block I/O; compile with -pthread */
 
 #define BS 4096
 #define BNO 2048
@@ -99,7 +100,6 @@ int main(int argc, char *argv[]) {
  */
 int mymkfs(const char *fname) {
     int fd;
-    int i;
     int flag;
     fd = open(fname, O_CREAT | O_WRONLY, S_IRWXU);
     if (fd == -1) {
@@ -108,13 +108,12 @@ int mymkfs(const char *fname) {
         return (-1);
     }
     memset(buf, 0, BS);
-    for (i = 0; i < BNO + 8; i++) {
-        flag = write(fd, buf, BS);
-        if (flag == -1) {
-            fprintf(stderr, "%s: ", fname);
-            perror("File write failed!");
-            return (-1);
-        }
+    // The zeroed blocks are written in batches, many at a time.
+    flag = blk_fill(fd, buf, BS, 0, BNO + 8, DEFAULT_DEPTH);
+    close(fd);
+    if (flag == -1) {
+        fprintf(stderr, "%s: File write failed!\n", fname);
+        return (-1);
     }
     return (0);
 }
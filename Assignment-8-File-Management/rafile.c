@@ -8,6 +8,19 @@
 #include <sys/stat.h> /* for open(2) */
 #include <fcntl.h> /* for open(2) */
 #include <unistd.h> /* for lseek(2), write(2), close(2)*/
+#include <string.h> /* for strncmp(3), memcpy(3), memmove(3) */
+#include <limits.h> /* for INT_MIN, IOV_MAX */
+#include <stdlib.h> /* for malloc(3), rand(3) */
+#include <errno.h> /* for errno(3) */
+#include <time.h> /* for clock_gettime(2) */
+#include <sys/uio.h> /* for preadv(2), pwritev(2) */
+#include <sys/mman.h> /* for mmap(2), munmap(2) */
+#include <pthread.h> /* for the background compactor; compile with -pthread */
+#include <sys/wait.h> /* for wait(2) */
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 /* Here we are maintaining a Book ("Register") of "Records". Please go through the code given below. It should be self-explanatory */
 
@@ -25,13 +38,157 @@ typedef struct reg {
         Record rs[MAXR]; /* Records */
 } Register;
 
+/* An index on field1 is kept as a B+-tree in a sidecar file "<data file>.idx".
+   Page 0 holds the IdxMeta; every other page is an IdxPage. Leaves are chained
+   through "next" so that a range scan walks the leaves in key order.
+   Keys are (field1, record number) pairs, so equal field1 values can coexist.
+   While an index is open, every record write to its data file descriptor
+   (putNthRec(), the batched and the locked writers) updates it. The meta page
+   remembers the size and modification time of the data file when the index was
+   closed, so openIndex() rebuilds an index whose data file was changed without it. */
+
+#define IDX_ORDER 140 /* maximum number of keys in an index page */
+#define IDX_MAGIC "RAFIDX2"
+
+typedef struct idxkey {
+        char k[20]; /* field1 of the record, padded with '\0' */
+        int n; /* record number */
+} IdxKey;
+
+typedef struct idxpage {
+        int leaf; /* 1 for a leaf, 0 for an inner page */
+        int nkeys; /* number of keys in use */
+        int next; /* next leaf in key order, 0 if none (leaves only) */
+        IdxKey keys[IDX_ORDER];
+        int child[IDX_ORDER + 1]; /* child pages (inner pages only) */
+} IdxPage;
+
+typedef struct idxmeta {
+        char magic[8];
+        int root; /* page number of the root */
+        int npages; /* number of pages including page 0 */
+        long long dataSize; /* size of the data file when the index was closed, -1 while it is open */
+        long long dataMtime; /* modification time of the data file then, in nanoseconds */
+} IdxMeta;
+
+typedef struct index {
+        int fd; /* descriptor of the sidecar file */
+        int dfd; /* descriptor of the data file; writes to it update the index */
+        IdxMeta meta;
+        long reads; /* index pages read, to compare with full scans */
+        int stale; /* a write failed, so the index may not match the data file */
+        long long seenSize, seenMtime; /* the data file after the last write through the index */
+        struct index *nextOpen; /* the next open index */
+} Index;
+
+/* The columnar format keeps field1 and field2 in separate column segments of a
+   memory-mapped file, so a scan of field2 touches 4 bytes per record instead of a
+   whole Record. The file is a COL_HDR-byte header followed by segments of COL_SEG
+   records; each segment holds the COL_SEG field2 values and then the COL_SEG field1
+   values. The file grows one segment at a time, so records never move. */
+
+#define COL_MAGIC "RAFCOL1"
+#define COL_HDR 4096 /* bytes reserved for the header */
+#define COL_SEG 65536 /* records per segment */
+#define COL_SEG_BYTES ((size_t)COL_SEG * (sizeof(int) + 20))
+
+typedef struct colheader {
+        char magic[8];
+        int count; /* number of records in the file */
+        int nsegs; /* number of segments allocated */
+} ColHeader;
+
+typedef struct colfile {
+        int fd; /* descriptor of the columnar file */
+        char *base; /* the whole file, mapped */
+        size_t maplen; /* length of the mapping */
+        ColHeader *hdr; /* header, at the start of the mapping */
+} ColFile;
+
+/* The log-structured mode never overwrites a record in place. Every update is
+   appended to a log file as a LogEntry, and an in-memory table maps each record
+   number to the offset of its latest entry. Appends are collected in a buffer and
+   written sequentially. A checksum in each entry lets logOpen() drop an entry that
+   was torn by a crash, so an update is either fully in the log or absent.
+   A background thread compacts the log into a new file holding only the live
+   entries, which is then renamed over the old one. */
+
+#define LOG_BUF 65536 /* bytes of appends buffered before a write */
+#define LOG_GARBAGE 2 /* compact when the log is this many times the live data */
+#define LOG_MIN_COMPACT (1 << 20) /* ... and at least this long */
+
+typedef struct logentry {
+        int n; /* record number */
+        unsigned sum; /* checksum of n and r */
+        Record r;
+} LogEntry;
+
+typedef struct logstore {
+        int fd; /* descriptor of the log file */
+        char fname[4096]; /* name of the log file */
+        off_t flushed; /* bytes of the log that are in the file */
+        off_t len; /* bytes of the log including the buffer */
+        char *wbuf; /* appends not yet written */
+        off_t *where; /* offset of the latest entry of each record, -1 if none */
+        int nwhere; /* size of where[] */
+        long live; /* number of records that have an entry */
+        long compactions; /* number of completed compactions */
+        int stop; /* tells the compactor to exit */
+        pthread_mutex_t lock; /* protects everything above */
+        pthread_mutex_t compacting; /* held for the whole of a compaction */
+        pthread_cond_t wake; /* wakes the compactor */
+        pthread_t compactor;
+} LogStore;
+
 int getCount(Register reg); /* Returns the number of records available in the register reg*/
 int putNthRec(int fd, Record r, int n); /* Write the record r at the n-th record position in the file with descriptor */
 int getNthRec(int fd, Record *r, int n); /* Read the n-th record from the file having descriptor fd into record pointed to by r */
 void displayRec(Record r); /* Displays the record r */
 void displayReg(Register reg); /* Displays the records of reg */
+int openIndex(Index *ix, int fd, const char *fname); /* Opens (building it if needed) the field1 index of the data file fname opened as fd */
+void closeIndex(Index *ix); /* Closes the index */
+int idxInsert(Index *ix, const char *field1, int n); /* Adds the key (field1, n) to the index */
+int idxDelete(Index *ix, const char *field1, int n); /* Removes the key (field1, n) from the index */
+int putNthRecIndexed(int fd, Index *ix, Record r, int n); /* putNthRec() that also keeps the index up to date */
+int findRecs(int fd, Index *ix, const char *lo, const char *hi, void (*visit)(Record r, int n)); /* Visits the records with lo <= field1 <= hi */
+int getRecByKey(int fd, Index *ix, const char *key, Record *r); /* Reads the first record whose field1 is key */
+int getRecs(int fd, Record *rs, int first, int count); /* Reads count records starting at record first into rs[] */
+int putRecs(int fd, const Record *rs, int first, int count); /* Writes rs[0..count-1] as records first, first+1, ... */
+int getRecsV(int fd, Record **rp, int first, int count); /* Like getRecs(), but record i goes to *rp[i] */
+int putRecsV(int fd, Record *const *rp, int first, int count); /* Like putRecs(), but record i comes from *rp[i] */
+int getRecsAt(int fd, Record *rs, const int *ns, int count); /* Reads the records numbered ns[0..count-1] into rs[] */
+int putRecsAt(int fd, const Record *rs, const int *ns, int count); /* Writes rs[i] as record ns[i] for every i */
+int benchRecIO(const char *fname, int n); /* Compares per-record and batched I/O on n records */
+int colOpen(ColFile *cf, const char *fname); /* Opens (creating it if needed) the columnar file fname */
+void colClose(ColFile *cf); /* Unmaps and closes a columnar file */
+int colPutNthRec(ColFile *cf, Record r, int n); /* Writes the record r as the n-th record, growing the file if needed */
+int colGetNthRec(ColFile *cf, Record *r, int n); /* Reads the n-th record of a columnar file */
+int colAppendRec(ColFile *cf, Record r); /* Appends the record r and returns its number */
+long long colSumField2(ColFile *cf); /* Sum of field2 over all records */
+int colFilterField2(ColFile *cf, int lo, int hi, int *ns, int max); /* Numbers of the records with lo <= field2 <= hi */
+int benchColumnar(const char *fname, int n); /* Compares field2 scans of the row and columnar layouts */
+int logOpen(LogStore *ls, const char *fname); /* Opens (recovering it) or creates the log fname and starts its compactor */
+int logPutNthRec(LogStore *ls, Record r, int n); /* Appends r as the new version of record n */
+int logGetNthRec(LogStore *ls, Record *r, int n); /* Reads the latest version of record n */
+int logSync(LogStore *ls); /* Writes the buffered appends and fsync()s the log */
+int logCompact(LogStore *ls); /* Rewrites the log with only the live entries */
+int logClose(LogStore *ls); /* Stops the compactor, syncs and closes the log */
+int benchLog(const char *fname, int n, int updates); /* Compares random in-place updates with log appends */
+int lockRecs(int fd, int first, int count, int exclusive); /* Waits for a shared or exclusive lock on records first..first+count-1 */
+int unlockRecs(int fd, int first, int count); /* Releases the lock on records first..first+count-1 */
+int getNthRecShared(int fd, Record *r, int n); /* getNthRec() under a shared lock on record n */
+int putNthRecLocked(int fd, Record r, int n); /* putNthRec() under an exclusive lock on record n */
+int updateNthRec(int fd, int n, void (*change)(Record *r)); /* Read-modify-write of record n under an exclusive lock */
+int benchLocks(const char *fname, int n, int ops, int maxprocs); /* Measures concurrent updates with 1..maxprocs processes */
+
+long recSyscalls = 0; /* read/write/seek system calls made by the record I/O functions */
 
-int main() {
+static Index *openIndexes = NULL; /* the open indexes, kept up to date by the record writers */
+static int idxWillWrite(int fd, const Record *r, int n); /* Updates the index open on fd before record n becomes r */
+static void idxWrote(int fd, int ok); /* Notes a finished write to fd in the index open on it */
+static int idxRegister(Index *ix, long long size, long long mtime); /* Marks ix as open and lets the writers find it */
+
+int main(int argc, char *argv[]) {
         int ifd, ofd;
         Register reg1 = {5, {{"ab", 9}, {"bc", 10}, {"cd", 11}, {"de", 12}, {"ef", 13}}}; /* reg1 is a register which is populated here itself */
         Register reg2;
@@ -45,6 +202,25 @@ int main() {
 
         int i;
 
+        if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+                /* "./a.out bench [n]" compares per-record and batched I/O on n records */
+                return benchRecIO("ioput.bench", argc > 2 ? atoi(argv[2]) : 1000000) ? 0 : 1;
+        }
+        if (argc >= 2 && strcmp(argv[1], "colbench") == 0) {
+                /* "./a.out colbench [n]" compares field2 scans of the row and columnar layouts */
+                return benchColumnar("ioput.bench", argc > 2 ? atoi(argv[2]) : 1000000) ? 0 : 1;
+        }
+        if (argc >= 2 && strcmp(argv[1], "logbench") == 0) {
+                /* "./a.out logbench [n] [updates]" compares random in-place updates with log appends */
+                return benchLog("ioput.bench", argc > 2 ? atoi(argv[2]) : 1000000,
+                                argc > 3 ? atoi(argv[3]) : 2000000) ? 0 : 1;
+        }
+        if (argc >= 2 && strcmp(argv[1], "lockbench") == 0) {
+                /* "./a.out lockbench [n] [ops] [max processes]" measures concurrent updates */
+                return benchLocks("ioput.bench", argc > 2 ? atoi(argv[2]) : 100000,
+                                  argc > 3 ? atoi(argv[3]) : 200000, argc > 4 ? atoi(argv[4]) : 8) ? 0 : 1;
+        }
+
         regsize1 = getCount(reg1);
         recsize1 = sizeof(Record);
 
@@ -93,6 +269,39 @@ int main() {
         close (ifd);
         printf("Reg2\n");
         displayReg(reg2);
+
+        /* looking records up by field1 through the index in "ioput.idx" */
+        {
+                Index ix;
+                Record r;
+                int n;
+
+                /* the records were just written without the index, so openIndex() finds
+                   that ioput changed since the index was closed and rebuilds it */
+                ifd = open("ioput", O_RDWR);
+                if (ifd == -1 || openIndex(&ix, ifd, "ioput") == 0) {
+                        fprintf(stderr, "Cannot open the index of ioput\n");
+                        return 1;
+                }
+
+                putNthRec(ifd, (Record){"zz", 99}, 1); /* replaces "bc"; the index follows */
+
+                ix.reads = 0;
+                n = getRecByKey(ifd, &ix, "cd", &r);
+                printf("Lookup of \"cd\": record %d, %d index page(s) read\n", n, (int)ix.reads);
+                if (n >= 0) {
+                        displayRec(r);
+                }
+                printf("Lookup of \"bc\": record %d\n", getRecByKey(ifd, &ix, "bc", &r));
+
+                printf("Records with \"b\" <= field1 <= \"dz\"\n");
+                n = findRecs(ifd, &ix, "b", "dz", NULL);
+                printf("%d record(s) found\n", n);
+
+                closeIndex(&ix);
+                close(ifd);
+        }
+        return 0;
 }
 
 int getCount(Register reg) {
@@ -116,6 +325,7 @@ int getNthRec(int fd, Record *r, int n) {
         /* Position at the starting of the n-th record in the file */
         /* off_t lseek(int fd, off_t offset, int whence);*/
         lseek(fd, posn, SEEK_SET);
+        recSyscalls += 2; /* lseek() and read() */
 
         /* Read the record from that position */
         /* ssize_t read(int fd, void *buf, size_t count); */
@@ -142,10 +352,15 @@ int putNthRec(int fd, Record r, int n) {
         rsize = sizeof(Record); /* size of each Record */
         posn = n * rsize; /* Position at the starting of the n-th record in the file */
 
+        /* an index open on fd learns the new field1 first */
+        if (idxWillWrite(fd, &r, n) == 0) {
+                return 0;
+        }
 
         /* Position at the starting of the n-th record in the file */
         /* off_t lseek(int fd, off_t offset, int whence);*/
         fposn = lseek(fd, posn, SEEK_SET);
+        recSyscalls += 2; /* lseek() and write() */
         if (fposn == -1) {
                 perror ("lseek failes:");
         }
@@ -157,9 +372,11 @@ int putNthRec(int fd, Record r, int n) {
                 /* whole record was not written */
                 fprintf(stderr, "putNthRec(): wrote %d of %d bytes.\n", wsize, rsize);
                 perror("write() Error:");
+                idxWrote(fd, 0);
                 return 0;
         }
 
+        idxWrote(fd, 1);
         return 1;
 }
 void displayRec(Record r) {
@@ -175,3 +392,1758 @@ void displayReg(Register reg) {
         }
 
 }
+
+/* ---------------------------------------------------------------------- */
+/* B+-tree index on field1                                                 */
+/* ---------------------------------------------------------------------- */
+
+static void makeKey(IdxKey *key, const char *field1, int n) {
+        /* builds a key; bytes after the end of field1 are zeroed so keys compare cleanly */
+        memset(key->k, 0, sizeof(key->k));
+        memcpy(key->k, field1, strnlen(field1, sizeof(key->k)));
+        key->n = n;
+}
+
+static int cmpKey(const IdxKey *a, const IdxKey *b) {
+        /* orders keys by field1 and then by record number */
+        int c = strncmp(a->k, b->k, sizeof(a->k));
+        if (c != 0) {
+                return c;
+        }
+        return (a->n > b->n) - (a->n < b->n);
+}
+
+static int readPage(Index *ix, int pno, IdxPage *p) {
+        /* returns 1 if successful, 0 otherwise */
+        ix->reads++;
+        if (pread(ix->fd, p, sizeof(IdxPage), (off_t)pno * sizeof(IdxPage)) != sizeof(IdxPage)) {
+                perror("readPage(): pread() Error");
+                return 0;
+        }
+        return 1;
+}
+
+static int writePage(Index *ix, int pno, const IdxPage *p) {
+        /* returns 1 if successful, 0 otherwise */
+        if (pwrite(ix->fd, p, sizeof(IdxPage), (off_t)pno * sizeof(IdxPage)) != sizeof(IdxPage)) {
+                perror("writePage(): pwrite() Error");
+                return 0;
+        }
+        return 1;
+}
+
+static int writeMeta(Index *ix) {
+        /* returns 1 if successful, 0 otherwise */
+        if (pwrite(ix->fd, &ix->meta, sizeof(IdxMeta), 0) != sizeof(IdxMeta)) {
+                perror("writeMeta(): pwrite() Error");
+                return 0;
+        }
+        return 1;
+}
+
+static int newPage(Index *ix, int leaf) {
+        /* appends an empty page and returns its number, or 0 on failure */
+        IdxPage p;
+        int pno = ix->meta.npages;
+
+        memset(&p, 0, sizeof(p));
+        p.leaf = leaf;
+        if (writePage(ix, pno, &p) == 0) {
+                return 0;
+        }
+        ix->meta.npages++;
+        if (writeMeta(ix) == 0) {
+                return 0;
+        }
+        return pno;
+}
+
+static int childFor(const IdxPage *p, const IdxKey *key) {
+        /* index of the child of an inner page that may hold key */
+        int i = 0;
+        while (i < p->nkeys && cmpKey(key, &p->keys[i]) >= 0) {
+                i++;
+        }
+        return i;
+}
+
+static int findLeaf(Index *ix, const IdxKey *key, IdxPage *p) {
+        /* descends from the root to the leaf that may hold key; returns its page number or 0 */
+        int pno = ix->meta.root;
+
+        if (readPage(ix, pno, p) == 0) {
+                return 0;
+        }
+        while (!p->leaf) {
+                pno = p->child[childFor(p, key)];
+                if (readPage(ix, pno, p) == 0) {
+                        return 0;
+                }
+        }
+        return pno;
+}
+
+static int insertAt(Index *ix, int pno, const IdxKey *key, IdxKey *up, int *upPage) {
+        /* inserts key below page pno.
+           returns 2 if the page was split (the new right page and its separator are
+           returned in upPage and up), 1 if it was not, 0 on failure */
+        IdxPage p, q;
+        IdxKey keys[IDX_ORDER + 1];
+        int child[IDX_ORDER + 2];
+        int i, pos, cnt, half, qno;
+
+        if (readPage(ix, pno, &p) == 0) {
+                return 0;
+        }
+
+        if (p.leaf) {
+                for (pos = 0; pos < p.nkeys && cmpKey(&p.keys[pos], key) < 0; pos++)
+                        ;
+                if (pos < p.nkeys && cmpKey(&p.keys[pos], key) == 0) {
+                        return 1; /* already indexed */
+                }
+                memcpy(keys, p.keys, pos * sizeof(IdxKey));
+                keys[pos] = *key;
+                memcpy(keys + pos + 1, p.keys + pos, (p.nkeys - pos) * sizeof(IdxKey));
+                cnt = p.nkeys + 1;
+
+                if (cnt <= IDX_ORDER) {
+                        memcpy(p.keys, keys, cnt * sizeof(IdxKey));
+                        p.nkeys = cnt;
+                        return writePage(ix, pno, &p);
+                }
+
+                /* split the leaf: the upper half moves to a new right sibling */
+                qno = newPage(ix, 1);
+                if (qno == 0) {
+                        return 0;
+                }
+                memset(&q, 0, sizeof(q));
+                half = cnt / 2;
+                q.leaf = 1;
+                q.nkeys = cnt - half;
+                memcpy(q.keys, keys + half, q.nkeys * sizeof(IdxKey));
+                q.next = p.next;
+                p.nkeys = half;
+                memcpy(p.keys, keys, half * sizeof(IdxKey));
+                p.next = qno;
+                *up = q.keys[0];
+                *upPage = qno;
+                return writePage(ix, qno, &q) && writePage(ix, pno, &p) ? 2 : 0;
+        }
+
+        pos = childFor(&p, key);
+        i = insertAt(ix, p.child[pos], key, up, upPage);
+        if (i != 2) {
+                return i;
+        }
+
+        /* the child was split: add its separator and new page after position pos */
+        memcpy(keys, p.keys, pos * sizeof(IdxKey));
+        keys[pos] = *up;
+        memcpy(keys + pos + 1, p.keys + pos, (p.nkeys - pos) * sizeof(IdxKey));
+        memcpy(child, p.child, (pos + 1) * sizeof(int));
+        child[pos + 1] = *upPage;
+        memcpy(child + pos + 2, p.child + pos + 1, (p.nkeys - pos) * sizeof(int));
+        cnt = p.nkeys + 1;
+
+        if (cnt <= IDX_ORDER) {
+                memcpy(p.keys, keys, cnt * sizeof(IdxKey));
+                memcpy(p.child, child, (cnt + 1) * sizeof(int));
+                p.nkeys = cnt;
+                return writePage(ix, pno, &p);
+        }
+
+        /* split the inner page: the middle key moves up */
+        qno = newPage(ix, 0);
+        if (qno == 0) {
+                return 0;
+        }
+        memset(&q, 0, sizeof(q));
+        half = cnt / 2;
+        p.nkeys = half;
+        memcpy(p.keys, keys, half * sizeof(IdxKey));
+        memcpy(p.child, child, (half + 1) * sizeof(int));
+        q.nkeys = cnt - half - 1;
+        memcpy(q.keys, keys + half + 1, q.nkeys * sizeof(IdxKey));
+        memcpy(q.child, child + half + 1, (q.nkeys + 1) * sizeof(int));
+        *up = keys[half];
+        *upPage = qno;
+        return writePage(ix, qno, &q) && writePage(ix, pno, &p) ? 2 : 0;
+}
+
+int idxInsert(Index *ix, const char *field1, int n) {
+        /* Adds the key (field1, n) to the index
+                returns 1 if successful
+                        0 otherwise
+        */
+        IdxKey key, up;
+        IdxPage root;
+        int upPage, status, rno;
+
+        makeKey(&key, field1, n);
+        status = insertAt(ix, ix->meta.root, &key, &up, &upPage);
+        if (status != 2) {
+                return status;
+        }
+
+        /* the root was split: the tree grows by one level */
+        rno = newPage(ix, 0);
+        if (rno == 0) {
+                return 0;
+        }
+        memset(&root, 0, sizeof(root));
+        root.nkeys = 1;
+        root.keys[0] = up;
+        root.child[0] = ix->meta.root;
+        root.child[1] = upPage;
+        if (writePage(ix, rno, &root) == 0) {
+                return 0;
+        }
+        ix->meta.root = rno;
+        return writeMeta(ix);
+}
+
+int idxDelete(Index *ix, const char *field1, int n) {
+        /* Removes the key (field1, n) from the index. Leaves are allowed to become
+           underfull: the separators above them still route searches correctly.
+                returns 1 if successful (or the key was not indexed)
+                        0 otherwise
+        */
+        IdxKey key;
+        IdxPage p;
+        int pno, pos;
+
+        makeKey(&key, field1, n);
+        pno = findLeaf(ix, &key, &p);
+        if (pno == 0) {
+                return 0;
+        }
+        for (pos = 0; pos < p.nkeys && cmpKey(&p.keys[pos], &key) != 0; pos++)
+                ;
+        if (pos == p.nkeys) {
+                return 1;
+        }
+        memmove(p.keys + pos, p.keys + pos + 1, (p.nkeys - pos - 1) * sizeof(IdxKey));
+        p.nkeys--;
+        return writePage(ix, pno, &p);
+}
+
+static Index *idxOf(int fd) {
+        /* the open index of the data file opened as fd, or NULL */
+        Index *ix;
+
+        for (ix = openIndexes; ix != NULL && ix->dfd != fd; ix = ix->nextOpen)
+                ;
+        return ix;
+}
+
+static int dataStamp(int fd, long long *size, long long *mtime) {
+        /* the size and modification time of the data file; returns 1 if successful, 0 otherwise */
+        struct stat st;
+
+        if (fstat(fd, &st) == -1) {
+                return 0;
+        }
+        *size = st.st_size;
+        *mtime = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        return 1;
+}
+
+static int idxWillWrite(int fd, const Record *r, int n) {
+        /* Before record n of the data file opened as fd becomes r, replaces the key of the
+           old record in the index open on fd (if any) with the key of r.
+                returns 1 if successful
+                        0 otherwise
+        */
+        Index *ix = idxOf(fd);
+        Record old;
+        int rsize = sizeof(Record);
+
+        if (ix == NULL) {
+                return 1;
+        }
+        if (pread(fd, &old, rsize, (off_t)n * rsize) == rsize) {
+                if (strncmp(old.field1, r->field1, sizeof(r->field1)) == 0) {
+                        return 1; /* the key does not change */
+                }
+                if (idxDelete(ix, old.field1, n) == 0) {
+                        ix->stale = 1;
+                        return 0;
+                }
+        }
+        if (idxInsert(ix, r->field1, n) == 0) {
+                ix->stale = 1;
+                return 0;
+        }
+        return 1;
+}
+
+static void idxWrote(int fd, int ok) {
+        /* Notes in the index open on fd (if any) that a write to the data file finished.
+           After a failed write the index may hold keys of records that were not written. */
+        Index *ix = idxOf(fd);
+
+        if (ix == NULL) {
+                return;
+        }
+        if (!ok || dataStamp(fd, &ix->seenSize, &ix->seenMtime) == 0) {
+                ix->stale = 1;
+        }
+}
+
+int openIndex(Index *ix, int fd, const char *fname) {
+        /* Opens the index "<fname>.idx" of the data file fname opened as fd.
+           A missing or empty index, or one that does not match the data file, is
+           (re)built from the records in the file. Until closeIndex(), writes to fd
+           keep the index up to date.
+                returns 1 if successful
+                        0 otherwise
+        */
+        char iname[4096];
+        Record r;
+        int n, rsize;
+        long long size, mtime;
+
+        rsize = sizeof(Record);
+        if (snprintf(iname, sizeof(iname), "%s.idx", fname) >= (int)sizeof(iname)) {
+                fprintf(stderr, "openIndex(): file name too long\n");
+                return 0;
+        }
+        ix->fd = open(iname, O_CREAT|O_RDWR, 0600);
+        if (ix->fd == -1) {
+                perror("openIndex(): open() Error");
+                return 0;
+        }
+        ix->reads = 0;
+        ix->dfd = fd;
+        ix->stale = 0;
+        if (dataStamp(fd, &size, &mtime) == 0) {
+                perror("openIndex(): fstat() Error");
+                close(ix->fd);
+                return 0;
+        }
+
+        /* the index is only trusted if the data file is as it was when the index was closed */
+        if (pread(ix->fd, &ix->meta, sizeof(IdxMeta), 0) == sizeof(IdxMeta) &&
+            strncmp(ix->meta.magic, IDX_MAGIC, sizeof(ix->meta.magic)) == 0 &&
+            ix->meta.dataSize == size && ix->meta.dataMtime == mtime) {
+                return idxRegister(ix, size, mtime);
+        }
+
+        /* build a new index: page 0 is the meta page, page 1 the (empty) root leaf */
+        memset(&ix->meta, 0, sizeof(IdxMeta));
+        strncpy(ix->meta.magic, IDX_MAGIC, sizeof(ix->meta.magic));
+        ix->meta.npages = 1;
+        if (ftruncate(ix->fd, 0) == -1 || writeMeta(ix) == 0) {
+                close(ix->fd);
+                return 0;
+        }
+        ix->meta.root = newPage(ix, 1);
+        if (ix->meta.root == 0 || writeMeta(ix) == 0) {
+                close(ix->fd);
+                return 0;
+        }
+        for (n = 0; pread(fd, &r, rsize, (off_t)n * rsize) == rsize; n++) {
+                if (idxInsert(ix, r.field1, n) == 0) {
+                        close(ix->fd);
+                        return 0;
+                }
+        }
+        return idxRegister(ix, size, mtime);
+}
+
+static int idxRegister(Index *ix, long long size, long long mtime) {
+        /* Marks the index as open in its meta page, so that it is rebuilt if the program
+           stops without closeIndex(), and lets the record writers find it.
+                returns 1 if successful
+                        0 otherwise
+        */
+        ix->meta.dataSize = -1;
+        ix->meta.dataMtime = 0;
+        if (writeMeta(ix) == 0) {
+                close(ix->fd);
+                return 0;
+        }
+        ix->seenSize = size;
+        ix->seenMtime = mtime;
+        ix->nextOpen = openIndexes;
+        openIndexes = ix;
+        return 1;
+}
+
+void closeIndex(Index *ix) {
+        /* Closes the index. If the data file is as the last write through the index
+           left it, the meta page remembers its size and modification time, so the
+           next openIndex() can trust the index; otherwise the index will be rebuilt.
+           The data file must still be open. */
+        Index **pp;
+        long long size, mtime;
+
+        for (pp = &openIndexes; *pp != NULL && *pp != ix; pp = &(*pp)->nextOpen)
+                ;
+        if (*pp == ix) {
+                *pp = ix->nextOpen;
+        }
+        if (!ix->stale && dataStamp(ix->dfd, &size, &mtime) &&
+            size == ix->seenSize && mtime == ix->seenMtime) {
+                ix->meta.dataSize = size;
+                ix->meta.dataMtime = mtime;
+                writeMeta(ix);
+        }
+        close(ix->fd);
+}
+
+int putNthRecIndexed(int fd, Index *ix, Record r, int n) {
+        /* putNthRec() for the data file opened as fd, whose index is ix. putNthRec()
+           itself keeps the index open on fd up to date; this only checks that ix is it.
+                returns 1 if successful
+                        0 otherwise
+        */
+        if (idxOf(fd) != ix) {
+                fprintf(stderr, "putNthRecIndexed(): the index was not opened on this descriptor.\n");
+                return 0;
+        }
+        return putNthRec(fd, r, n);
+}
+
+int findRecs(int fd, Index *ix, const char *lo, const char *hi, void (*visit)(Record r, int n)) {
+        /* Visits, in field1 order, the records with lo <= field1 <= hi.
+           visit may be NULL, in which case the records are displayed.
+                returns the number of records visited, or -1 on failure
+        */
+        IdxKey key, last;
+        IdxPage p;
+        Record r;
+        int pos, count = 0;
+
+        makeKey(&key, lo, INT_MIN);
+        makeKey(&last, hi, 0);
+        if (findLeaf(ix, &key, &p) == 0) {
+                return -1;
+        }
+        for (;;) {
+                for (pos = 0; pos < p.nkeys; pos++) {
+                        if (cmpKey(&p.keys[pos], &key) < 0) {
+                                continue;
+                        }
+                        if (strncmp(p.keys[pos].k, last.k, sizeof(last.k)) > 0) {
+                                return count;
+                        }
+                        if (getNthRec(fd, &r, p.keys[pos].n) == 0) {
+                                return -1;
+                        }
+                        if (visit != NULL) {
+                                visit(r, p.keys[pos].n);
+                        } else {
+                                displayRec(r);
+                        }
+                        count++;
+                }
+                if (p.next == 0) {
+                        return count;
+                }
+                if (readPage(ix, p.next, &p) == 0) {
+                        return -1;
+                }
+        }
+}
+
+int getRecByKey(int fd, Index *ix, const char *key, Record *r) {
+        /* Reads into r the first record whose field1 is key
+                returns the record number if found
+                        -1 otherwise
+        */
+        IdxKey k;
+        IdxPage p;
+        int pos;
+
+        makeKey(&k, key, INT_MIN);
+        if (findLeaf(ix, &k, &p) == 0) {
+                return -1;
+        }
+        for (;;) {
+                for (pos = 0; pos < p.nkeys; pos++) {
+                        if (cmpKey(&p.keys[pos], &k) < 0) {
+                                continue;
+                        }
+                        if (strncmp(p.keys[pos].k, k.k, sizeof(k.k)) != 0) {
+                                return -1;
+                        }
+                        return getNthRec(fd, r, p.keys[pos].n) ? p.keys[pos].n : -1;
+                }
+                if (p.next == 0 || readPage(ix, p.next, &p) == 0) {
+                        return -1;
+                }
+        }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Batched and vectored record I/O                                         */
+/* ---------------------------------------------------------------------- */
+
+static int fullIO(int fd, int wr, struct iovec *iov, int iovcnt, off_t off) {
+        /* Transfers all the buffers of iov[] to or from the file starting at off,
+           with as few preadv()/pwritev() calls as the kernel allows. iov[] is consumed.
+                returns 1 if successful
+                        0 otherwise
+        */
+        ssize_t done;
+
+        while (iovcnt > 0) {
+                int cnt = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+                done = wr ? pwritev(fd, iov, cnt, off) : preadv(fd, iov, cnt, off);
+                recSyscalls++;
+                if (done == -1 && errno == EINTR) {
+                        continue;
+                }
+                if (done == -1) {
+                        perror(wr ? "pwritev() Error" : "preadv() Error");
+                        return 0;
+                }
+                if (done == 0) {
+                        fprintf(stderr, "fullIO(): end of file at offset %lld.\n", (long long)off);
+                        return 0;
+                }
+                off += done;
+                /* skip the buffers that are complete and trim a partial one */
+                while (iovcnt > 0 && (size_t)done >= iov->iov_len) {
+                        done -= iov->iov_len;
+                        iov++;
+                        iovcnt--;
+                }
+                if (iovcnt > 0) {
+                        iov->iov_base = (char *)iov->iov_base + done;
+                        iov->iov_len -= done;
+                }
+        }
+        return 1;
+}
+
+int getRecs(int fd, Record *rs, int first, int count) {
+        /* Reads count records starting at record first into rs[] with one preadv()
+                returns 1 if successful
+                        0 otherwise
+        */
+        struct iovec iov;
+
+        if (count <= 0) {
+                return 1;
+        }
+        iov.iov_base = rs;
+        iov.iov_len = (size_t)count * sizeof(Record);
+        return fullIO(fd, 0, &iov, 1, (off_t)first * sizeof(Record));
+}
+
+int putRecs(int fd, const Record *rs, int first, int count) {
+        /* Writes rs[0..count-1] as records first, first+1, ... with one pwritev()
+                returns 1 if successful
+                        0 otherwise
+        */
+        struct iovec iov;
+        int i, status;
+
+        if (count <= 0) {
+                return 1;
+        }
+        for (i = 0; i < count; i++) {
+                if (idxWillWrite(fd, &rs[i], first + i) == 0) {
+                        return 0;
+                }
+        }
+        iov.iov_base = (void *)rs;
+        iov.iov_len = (size_t)count * sizeof(Record);
+        status = fullIO(fd, 1, &iov, 1, (off_t)first * sizeof(Record));
+        idxWrote(fd, status);
+        return status;
+}
+
+static int recsV(int fd, int wr, Record *const *rp, int first, int count) {
+        /* gathers/scatters records first..first+count-1 from/to the records pointed to by rp[] */
+        struct iovec *iov;
+        int i, status;
+
+        if (count <= 0) {
+                return 1;
+        }
+        iov = malloc((size_t)count * sizeof(struct iovec));
+        if (iov == NULL) {
+                perror("malloc() Error");
+                return 0;
+        }
+        for (i = 0; i < count; i++) {
+                if (wr && idxWillWrite(fd, rp[i], first + i) == 0) {
+                        free(iov);
+                        return 0;
+                }
+                iov[i].iov_base = rp[i];
+                iov[i].iov_len = sizeof(Record);
+        }
+        status = fullIO(fd, wr, iov, count, (off_t)first * sizeof(Record));
+        if (wr) {
+                idxWrote(fd, status);
+        }
+        free(iov);
+        return status;
+}
+
+int getRecsV(int fd, Record **rp, int first, int count) {
+        /* Reads records first..first+count-1, record first+i into *rp[i], with
+           one preadv() per IOV_MAX records
+                returns 1 if successful
+                        0 otherwise
+        */
+        return recsV(fd, 0, rp, first, count);
+}
+
+int putRecsV(int fd, Record *const *rp, int first, int count) {
+        /* Writes *rp[i] as record first+i for every i, with one pwritev() per
+           IOV_MAX records
+                returns 1 if successful
+                        0 otherwise
+        */
+        return recsV(fd, 1, rp, first, count);
+}
+
+static int recsAt(int fd, int wr, Record *rs, const int *ns, int count) {
+        /* transfers rs[i] from/to record ns[i]; each run of consecutive record
+           numbers is moved with a single call */
+        struct iovec iov;
+        int i, j;
+
+        for (i = 0; wr && i < count; i++) {
+                if (idxWillWrite(fd, &rs[i], ns[i]) == 0) {
+                        return 0;
+                }
+        }
+        for (i = 0; i < count; i = j) {
+                for (j = i + 1; j < count && ns[j] == ns[j - 1] + 1; j++)
+                        ;
+                iov.iov_base = &rs[i];
+                iov.iov_len = (size_t)(j - i) * sizeof(Record);
+                if (fullIO(fd, wr, &iov, 1, (off_t)ns[i] * sizeof(Record)) == 0) {
+                        if (wr) {
+                                idxWrote(fd, 0);
+                        }
+                        return 0;
+                }
+        }
+        if (wr) {
+                idxWrote(fd, 1);
+        }
+        return 1;
+}
+
+int getRecsAt(int fd, Record *rs, const int *ns, int count) {
+        /* Reads record ns[i] into rs[i] for every i. Runs of consecutive record
+           numbers in ns[] cost one system call each.
+                returns 1 if successful
+                        0 otherwise
+        */
+        return recsAt(fd, 0, rs, ns, count);
+}
+
+int putRecsAt(int fd, const Record *rs, const int *ns, int count) {
+        /* Writes rs[i] as record ns[i] for every i. Runs of consecutive record
+           numbers in ns[] cost one system call each.
+                returns 1 if successful
+                        0 otherwise
+        */
+        return recsAt(fd, 1, (Record *)rs, ns, count);
+}
+
+static double seconds(void) {
+        /* monotonic time in seconds, for the benchmarks */
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, int n, long calls, double t) {
+        /* prints one line of a benchmark table */
+        printf("%-24s %10d %12ld %10.3f %14.0f\n", what, n, calls, t, n / t);
+}
+
+int benchRecIO(const char *fname, int n) {
+        /* Loads n records into fname, and reads them back, record by record with
+           putNthRec()/getNthRec() and in bulk with the batched calls.
+           Prints the system calls made and the throughput of each method.
+                returns 1 if successful
+                        0 otherwise
+        */
+        Record *rs, **rp;
+        int *ns;
+        int fd, i, k, m;
+        long calls;
+        double t;
+
+        if (n <= 0) {
+                fprintf(stderr, "benchRecIO(): nothing to do for %d records\n", n);
+                return 0;
+        }
+        rs = malloc((size_t)n * sizeof(Record));
+        rp = malloc((size_t)n * sizeof(Record *));
+        ns = malloc((size_t)n * sizeof(int));
+        fd = open(fname, O_CREAT|O_TRUNC|O_RDWR, 0600);
+        if (rs == NULL || rp == NULL || ns == NULL || fd == -1) {
+                perror("benchRecIO()");
+                free(rs);
+                free(rp);
+                free(ns);
+                return 0;
+        }
+        memset(rs, 0, (size_t)n * sizeof(Record));
+        for (i = 0; i < n; i++) {
+                snprintf(rs[i].field1, sizeof(rs[i].field1), "rec%d", i);
+                rs[i].field2 = i;
+                rp[i] = &rs[i];
+        }
+
+        printf("%-24s %10s %12s %10s %14s\n", "method", "records", "syscalls", "seconds", "records/s");
+
+        calls = recSyscalls;
+        t = seconds();
+        for (i = 0; i < n && putNthRec(fd, rs[i], i); i++)
+                ;
+        report("putNthRec() loop", n, recSyscalls - calls, seconds() - t);
+
+        calls = recSyscalls;
+        t = seconds();
+        putRecs(fd, rs, 0, n);
+        report("putRecs()", n, recSyscalls - calls, seconds() - t);
+
+        calls = recSyscalls;
+        t = seconds();
+        putRecsV(fd, rp, 0, n);
+        report("putRecsV()", n, recSyscalls - calls, seconds() - t);
+
+        calls = recSyscalls;
+        t = seconds();
+        for (i = 0; i < n && getNthRec(fd, &rs[i], i); i++)
+                ;
+        report("getNthRec() loop", n, recSyscalls - calls, seconds() - t);
+
+        calls = recSyscalls;
+        t = seconds();
+        getRecs(fd, rs, 0, n);
+        report("getRecs()", n, recSyscalls - calls, seconds() - t);
+
+        calls = recSyscalls;
+        t = seconds();
+        getRecsV(fd, rp, 0, n);
+        report("getRecsV()", n, recSyscalls - calls, seconds() - t);
+
+        /* non-contiguous record numbers: random runs of 1 to 16 records */
+        srand(1);
+        for (m = 0; m < n; ) {
+                int start = rand() % n;
+                int len = 1 + rand() % 16;
+                for (k = 0; k < len && m < n && start + k < n; k++) {
+                        ns[m++] = start + k;
+                }
+        }
+
+        calls = recSyscalls;
+        t = seconds();
+        for (i = 0; i < n && getNthRec(fd, &rs[i], ns[i]); i++)
+                ;
+        report("getNthRec() scattered", n, recSyscalls - calls, seconds() - t);
+
+        calls = recSyscalls;
+        t = seconds();
+        getRecsAt(fd, rs, ns, n);
+        report("getRecsAt() scattered", n, recSyscalls - calls, seconds() - t);
+
+        for (i = 0; i < n; i++) {
+                if (rs[i].field2 != ns[i]) {
+                        fprintf(stderr, "benchRecIO(): record %d read back wrong\n", ns[i]);
+                        break;
+                }
+        }
+
+        close(fd);
+        unlink(fname);
+        free(rs);
+        free(rp);
+        free(ns);
+        return i == n;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Memory-mapped columnar layout                                           */
+/* ---------------------------------------------------------------------- */
+
+static int *colField2(ColFile *cf, int seg) {
+        /* the field2 column of segment seg */
+        return (int *)(cf->base + COL_HDR + (size_t)seg * COL_SEG_BYTES);
+}
+
+static char *colField1(ColFile *cf, int n) {
+        /* field1 of record n */
+        return cf->base + COL_HDR + (size_t)(n / COL_SEG) * COL_SEG_BYTES
+               + (size_t)COL_SEG * sizeof(int) + (size_t)(n % COL_SEG) * 20;
+}
+
+static int colMap(ColFile *cf, int nsegs) {
+        /* (re)maps the file with room for nsegs segments, extending it if needed
+                returns 1 if successful
+                        0 otherwise
+        */
+        size_t len = COL_HDR + (size_t)nsegs * COL_SEG_BYTES;
+        struct stat sb;
+        char *base;
+
+        if (fstat(cf->fd, &sb) == -1) {
+                perror("colMap(): fstat() Error");
+                return 0;
+        }
+        if ((size_t)sb.st_size < len && ftruncate(cf->fd, len) == -1) {
+                perror("colMap(): ftruncate() Error");
+                return 0;
+        }
+        base = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, cf->fd, 0);
+        if (base == MAP_FAILED) {
+                perror("colMap(): mmap() Error");
+                return 0;
+        }
+        if (cf->base != NULL) {
+                munmap(cf->base, cf->maplen);
+        }
+        cf->base = base;
+        cf->maplen = len;
+        cf->hdr = (ColHeader *)base;
+        return 1;
+}
+
+int colOpen(ColFile *cf, const char *fname) {
+        /* Opens the columnar file fname, creating an empty one if it does not exist
+                returns 1 if successful
+                        0 otherwise
+        */
+        ColHeader h;
+
+        cf->base = NULL;
+        cf->maplen = 0;
+        cf->fd = open(fname, O_CREAT|O_RDWR, 0600);
+        if (cf->fd == -1) {
+                perror("colOpen(): open() Error");
+                return 0;
+        }
+        if (pread(cf->fd, &h, sizeof(h), 0) == sizeof(h)) {
+                if (strncmp(h.magic, COL_MAGIC, sizeof(h.magic)) != 0) {
+                        fprintf(stderr, "colOpen(): %s is not a columnar record file\n", fname);
+                        close(cf->fd);
+                        return 0;
+                }
+                if (colMap(cf, h.nsegs) == 0) {
+                        close(cf->fd);
+                        return 0;
+                }
+                return 1;
+        }
+
+        /* a new file: just the header, segments are added as records arrive */
+        if (colMap(cf, 0) == 0) {
+                close(cf->fd);
+                return 0;
+        }
+        memset(cf->hdr, 0, sizeof(ColHeader));
+        memcpy(cf->hdr->magic, COL_MAGIC, sizeof(cf->hdr->magic));
+        return 1;
+}
+
+void colClose(ColFile *cf) {
+        /* Unmaps and closes a columnar file */
+        munmap(cf->base, cf->maplen);
+        close(cf->fd);
+}
+
+int colPutNthRec(ColFile *cf, Record r, int n) {
+        /* Writes the record r as the n-th record of the columnar file, adding
+           segments if n is beyond the end of the file
+                returns 1 if successful
+                        0 otherwise
+        */
+        if (n < 0) {
+                return 0;
+        }
+        if (n / COL_SEG >= cf->hdr->nsegs) {
+                int nsegs = n / COL_SEG + 1;
+                if (colMap(cf, nsegs) == 0) {
+                        return 0;
+                }
+                cf->hdr->nsegs = nsegs;
+        }
+        colField2(cf, n / COL_SEG)[n % COL_SEG] = r.field2;
+        memcpy(colField1(cf, n), r.field1, 20);
+        if (n >= cf->hdr->count) {
+                cf->hdr->count = n + 1;
+        }
+        return 1;
+}
+
+int colGetNthRec(ColFile *cf, Record *r, int n) {
+        /* Reads the n-th record of the columnar file into r
+                returns 1 if successful
+                        0 otherwise
+        */
+        if (n < 0 || n >= cf->hdr->count) {
+                fprintf(stderr, "colGetNthRec(): no record %d.\n", n);
+                return 0;
+        }
+        memcpy(r->field1, colField1(cf, n), 20);
+        r->field2 = colField2(cf, n / COL_SEG)[n % COL_SEG];
+        return 1;
+}
+
+int colAppendRec(ColFile *cf, Record r) {
+        /* Appends the record r
+                returns the number of the new record
+                        -1 otherwise
+        */
+        int n = cf->hdr->count;
+        return colPutNthRec(cf, r, n) ? n : -1;
+}
+
+long long colSumField2(ColFile *cf) {
+        /* Returns the sum of field2 over all records. Each segment's field2 column
+           is a plain int array, so the inner loop is vectorised by the compiler
+           (SSE2/AVX2 depending on -march). */
+        long long sum = 0;
+        int seg, i, len;
+
+        for (seg = 0; seg * COL_SEG < cf->hdr->count; seg++) {
+                const int *v = colField2(cf, seg);
+                len = cf->hdr->count - seg * COL_SEG < COL_SEG ? cf->hdr->count - seg * COL_SEG : COL_SEG;
+                for (i = 0; i < len; i++) {
+                        sum += v[i];
+                }
+        }
+        return sum;
+}
+
+int colFilterField2(ColFile *cf, int lo, int hi, int *ns, int max) {
+        /* Stores in ns[] the numbers of the records with lo <= field2 <= hi, at most max
+           of them. The loop has no data-dependent branch: every record number is
+           written and the output position only advances on a match.
+                returns the number of matching records (which may exceed max)
+        */
+        int seg, i, len, k = 0;
+
+        for (seg = 0; seg * COL_SEG < cf->hdr->count; seg++) {
+                const int *v = colField2(cf, seg);
+                int base = seg * COL_SEG;
+                len = cf->hdr->count - base < COL_SEG ? cf->hdr->count - base : COL_SEG;
+                for (i = 0; i < len; i++) {
+                        int match = (v[i] >= lo) & (v[i] <= hi);
+                        if (k < max) {
+                                ns[k] = base + i;
+                        }
+                        k += match;
+                }
+        }
+        return k;
+}
+
+int benchColumnar(const char *fname, int n) {
+        /* Writes n records in the row layout and in the columnar layout, then times
+           a sum and a filter over field2 on each of them.
+                returns 1 if successful
+                        0 otherwise
+        */
+        char cname[4096];
+        ColFile cf;
+        Record *rs;
+        int *ns;
+        int fd, i, rows, cols;
+        long long rowSum, colSum;
+        double t, rowT, colT;
+
+        if (n <= 0) {
+                fprintf(stderr, "benchColumnar(): nothing to do for %d records\n", n);
+                return 0;
+        }
+        snprintf(cname, sizeof(cname), "%s.col", fname);
+        unlink(cname);
+        rs = malloc((size_t)n * sizeof(Record));
+        ns = malloc((size_t)n * sizeof(int));
+        fd = open(fname, O_CREAT|O_TRUNC|O_RDWR, 0600);
+        if (rs == NULL || ns == NULL || fd == -1 || colOpen(&cf, cname) == 0) {
+                perror("benchColumnar()");
+                free(rs);
+                free(ns);
+                return 0;
+        }
+
+        srand(1);
+        memset(rs, 0, (size_t)n * sizeof(Record));
+        for (i = 0; i < n; i++) {
+                snprintf(rs[i].field1, sizeof(rs[i].field1), "rec%d", i);
+                rs[i].field2 = rand() % 1000;
+        }
+        putRecs(fd, rs, 0, n);
+        for (i = 0; i < n; i++) {
+                colPutNthRec(&cf, rs[i], i);
+        }
+        free(rs);
+
+        /* row layout: every Record has to be read to get at its field2 */
+        t = seconds();
+        rs = mmap(NULL, (size_t)n * sizeof(Record), PROT_READ, MAP_SHARED, fd, 0);
+        if (rs == MAP_FAILED) {
+                perror("benchColumnar(): mmap() Error");
+                colClose(&cf);
+                close(fd);
+                free(ns);
+                return 0;
+        }
+        rowSum = 0;
+        for (i = 0; i < n; i++) {
+                rowSum += rs[i].field2;
+        }
+        rowT = seconds() - t;
+
+        t = seconds();
+        colSum = colSumField2(&cf);
+        colT = seconds() - t;
+
+        printf("%-22s %12s %10s %12s\n", "scan", "result", "seconds", "MB scanned");
+        printf("%-22s %12lld %10.4f %12.1f\n", "row sum(field2)", rowSum, rowT, n * sizeof(Record) / 1e6);
+        printf("%-22s %12lld %10.4f %12.1f\n", "columnar sum(field2)", colSum, colT, n * sizeof(int) / 1e6);
+
+        t = seconds();
+        rows = 0;
+        for (i = 0; i < n; i++) {
+                int match = (rs[i].field2 >= 100) & (rs[i].field2 <= 199);
+                ns[rows] = i;
+                rows += match;
+        }
+        rowT = seconds() - t;
+
+        t = seconds();
+        cols = colFilterField2(&cf, 100, 199, ns, n);
+        colT = seconds() - t;
+
+        printf("%-22s %12d %10.4f %12.1f\n", "row filter(field2)", rows, rowT, n * sizeof(Record) / 1e6);
+        printf("%-22s %12d %10.4f %12.1f\n", "columnar filter", cols, colT, n * sizeof(int) / 1e6);
+
+        munmap(rs, (size_t)n * sizeof(Record));
+        colClose(&cf);
+        close(fd);
+        unlink(fname);
+        unlink(cname);
+        free(ns);
+        return rowSum == colSum && rows == cols;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Log-structured updates with background compaction                       */
+/* ---------------------------------------------------------------------- */
+
+static unsigned logSum(const LogEntry *e) {
+        /* FNV-1a style checksum of the record number and the record, a word at a time */
+        unsigned w[sizeof(Record) / sizeof(unsigned)];
+        unsigned h = 2166136261u;
+        size_t i;
+
+        memcpy(w, &e->r, sizeof(w));
+        h = (h ^ (unsigned)e->n) * 16777619u;
+        for (i = 0; i < sizeof(w) / sizeof(w[0]); i++) {
+                h = (h ^ w[i]) * 16777619u;
+        }
+        return h;
+}
+
+static int logGrow(LogStore *ls, int n) {
+        /* makes where[] large enough for record n; called with ls->lock held */
+        off_t *w;
+        int size, i;
+
+        if (n < ls->nwhere) {
+                return 1;
+        }
+        size = ls->nwhere ? ls->nwhere : 1024;
+        while (size <= n) {
+                size *= 2;
+        }
+        w = realloc(ls->where, (size_t)size * sizeof(off_t));
+        if (w == NULL) {
+                perror("logGrow(): realloc() Error");
+                return 0;
+        }
+        for (i = ls->nwhere; i < size; i++) {
+                w[i] = -1;
+        }
+        ls->where = w;
+        ls->nwhere = size;
+        return 1;
+}
+
+static int logFlush(LogStore *ls) {
+        /* writes the buffered appends; called with ls->lock held */
+        struct iovec iov;
+
+        if (ls->len == ls->flushed) {
+                return 1;
+        }
+        iov.iov_base = ls->wbuf;
+        iov.iov_len = ls->len - ls->flushed;
+        if (fullIO(ls->fd, 1, &iov, 1, ls->flushed) == 0) {
+                return 0;
+        }
+        ls->flushed = ls->len;
+        return 1;
+}
+
+static int logNote(LogStore *ls, const LogEntry *e, off_t off) {
+        /* records that the latest entry of e->n is at off; called with ls->lock held */
+        if (logGrow(ls, e->n) == 0) {
+                return 0;
+        }
+        if (ls->where[e->n] == -1) {
+                ls->live++;
+        }
+        ls->where[e->n] = off;
+        return 1;
+}
+
+static void *logCompactor(void *arg) {
+        /* the background compactor: sleeps until the log holds too much garbage */
+        LogStore *ls = arg;
+
+        pthread_mutex_lock(&ls->lock);
+        while (!ls->stop) {
+                if (ls->len < LOG_MIN_COMPACT || ls->len < LOG_GARBAGE * ls->live * (off_t)sizeof(LogEntry)) {
+                        pthread_cond_wait(&ls->wake, &ls->lock);
+                        continue;
+                }
+                pthread_mutex_unlock(&ls->lock);
+                if (logCompact(ls) == 0) {
+                        fprintf(stderr, "logCompactor(): compaction failed, giving up.\n");
+                        return NULL;
+                }
+                pthread_mutex_lock(&ls->lock);
+        }
+        pthread_mutex_unlock(&ls->lock);
+        return NULL;
+}
+
+int logOpen(LogStore *ls, const char *fname) {
+        /* Opens the log fname, creating it if needed, and starts its compactor.
+           An existing log is replayed to rebuild the offset table; a torn or corrupt
+           entry at the end (from a crash during an append) is cut off.
+                returns 1 if successful
+                        0 otherwise
+        */
+        LogEntry e;
+        off_t off;
+
+        memset(ls, 0, sizeof(*ls));
+        if (snprintf(ls->fname, sizeof(ls->fname), "%s", fname) >= (int)sizeof(ls->fname)) {
+                fprintf(stderr, "logOpen(): file name too long\n");
+                return 0;
+        }
+        ls->wbuf = malloc(LOG_BUF);
+        ls->fd = open(fname, O_CREAT|O_RDWR, 0600);
+        if (ls->wbuf == NULL || ls->fd == -1) {
+                perror("logOpen()");
+                free(ls->wbuf);
+                return 0;
+        }
+
+        for (off = 0; pread(ls->fd, &e, sizeof(e), off) == sizeof(e) && e.n >= 0 && e.sum == logSum(&e);
+             off += sizeof(e)) {
+                if (logNote(ls, &e, off) == 0) {
+                        close(ls->fd);
+                        free(ls->wbuf);
+                        free(ls->where);
+                        return 0;
+                }
+        }
+        if (ftruncate(ls->fd, off) == -1) {
+                perror("logOpen(): ftruncate() Error");
+        }
+        ls->flushed = ls->len = off;
+
+        pthread_mutex_init(&ls->lock, NULL);
+        pthread_mutex_init(&ls->compacting, NULL);
+        pthread_cond_init(&ls->wake, NULL);
+        if (pthread_create(&ls->compactor, NULL, logCompactor, ls) != 0) {
+                fprintf(stderr, "logOpen(): cannot start the compactor\n");
+                close(ls->fd);
+                free(ls->wbuf);
+                free(ls->where);
+                return 0;
+        }
+        return 1;
+}
+
+int logPutNthRec(LogStore *ls, Record r, int n) {
+        /* Appends r as the new version of record n
+                returns 1 if successful
+                        0 otherwise
+        */
+        LogEntry e;
+        int status = 1;
+
+        if (n < 0) {
+                return 0;
+        }
+        memset(&e, 0, sizeof(e));
+        e.n = n;
+        e.r = r;
+        e.sum = logSum(&e);
+
+        pthread_mutex_lock(&ls->lock);
+        if (ls->len - ls->flushed + (off_t)sizeof(e) > LOG_BUF) {
+                status = logFlush(ls);
+        }
+        if (status) {
+                memcpy(ls->wbuf + (ls->len - ls->flushed), &e, sizeof(e));
+                status = logNote(ls, &e, ls->len);
+                ls->len += sizeof(e);
+        }
+        if (ls->len >= LOG_MIN_COMPACT && ls->len >= LOG_GARBAGE * ls->live * (off_t)sizeof(LogEntry)) {
+                pthread_cond_signal(&ls->wake);
+        }
+        pthread_mutex_unlock(&ls->lock);
+        return status;
+}
+
+int logGetNthRec(LogStore *ls, Record *r, int n) {
+        /* Reads the latest version of record n into r
+                returns 1 if successful
+                        0 otherwise
+        */
+        LogEntry e;
+        off_t off;
+        int status = 0;
+
+        pthread_mutex_lock(&ls->lock);
+        off = n >= 0 && n < ls->nwhere ? ls->where[n] : -1;
+        if (off == -1) {
+                fprintf(stderr, "logGetNthRec(): no record %d.\n", n);
+        } else if (off >= ls->flushed) {
+                memcpy(&e, ls->wbuf + (off - ls->flushed), sizeof(e));
+                status = 1;
+        } else {
+                status = pread(ls->fd, &e, sizeof(e), off) == sizeof(e);
+                if (!status) {
+                        perror("logGetNthRec(): pread() Error");
+                }
+        }
+        pthread_mutex_unlock(&ls->lock);
+        if (status) {
+                *r = e.r;
+        }
+        return status;
+}
+
+int logSync(LogStore *ls) {
+        /* Writes the buffered appends and fsync()s the log. Updates made before a
+           successful logSync() survive a crash.
+                returns 1 if successful
+                        0 otherwise
+        */
+        int status;
+
+        pthread_mutex_lock(&ls->lock);
+        status = logFlush(ls) && fsync(ls->fd) == 0;
+        pthread_mutex_unlock(&ls->lock);
+        return status;
+}
+
+int logCompact(LogStore *ls) {
+        /* Rewrites the log with only the latest entry of each record.
+           The live entries as of a snapshot are copied without holding ls->lock, so
+           updates continue meanwhile. The entries appended during the copy are then
+           moved over under the lock, and the new file is renamed over the old one.
+                returns 1 if successful
+                        0 otherwise
+        */
+        char tname[4200];
+        off_t *snap, *moved = NULL, *fresh, end, out, off;
+        char *buf, *obuf;
+        ssize_t got, i;
+        int tfd, nsnap, n, k, status = 0;
+        LogEntry e;
+
+        pthread_mutex_lock(&ls->compacting);
+        snprintf(tname, sizeof(tname), "%s.compact", ls->fname);
+
+        /* 1. snapshot the offset table */
+        pthread_mutex_lock(&ls->lock);
+        if (logFlush(ls) == 0) {
+                pthread_mutex_unlock(&ls->lock);
+                pthread_mutex_unlock(&ls->compacting);
+                return 0;
+        }
+        end = ls->flushed;
+        nsnap = ls->nwhere;
+        snap = malloc((size_t)(nsnap ? nsnap : 1) * sizeof(off_t));
+        if (snap != NULL) {
+                memcpy(snap, ls->where, (size_t)nsnap * sizeof(off_t));
+        }
+        pthread_mutex_unlock(&ls->lock);
+
+        buf = malloc(LOG_BUF);
+        obuf = malloc(LOG_BUF);
+        tfd = open(tname, O_CREAT|O_TRUNC|O_RDWR, 0600);
+        if (snap == NULL || buf == NULL || obuf == NULL || tfd == -1) {
+                perror("logCompact()");
+                goto out;
+        }
+
+        /* 2. copy the live entries of the snapshot, reading the old log sequentially.
+              An entry is live if the snapshot still points at it. ls->fd only grows
+              meanwhile, so the part before end does not change. */
+        moved = malloc((size_t)(nsnap ? nsnap : 1) * sizeof(off_t));
+        if (moved == NULL) {
+                perror("logCompact(): malloc() Error");
+                goto out;
+        }
+        for (n = 0; n < nsnap; n++) {
+                moved[n] = -1;
+        }
+        out = 0;
+        k = 0;
+        for (off = 0; off < end; off += got) {
+                LogEntry *ents = (LogEntry *)buf;
+                size_t want = end - off < LOG_BUF ? end - off : LOG_BUF;
+                got = pread(ls->fd, buf, want, off);
+                if (got <= 0 || got % sizeof(e) != 0) {
+                        perror("logCompact(): pread() Error");
+                        goto out;
+                }
+                for (i = 0; i < got / (ssize_t)sizeof(e); i++) {
+                        if (ents[i].n < nsnap && snap[ents[i].n] == off + i * (off_t)sizeof(e)) {
+                                moved[ents[i].n] = out + k;
+                                memcpy(obuf + k, &ents[i], sizeof(e));
+                                k += sizeof(e);
+                        }
+                }
+                if (k > 0 && pwrite(tfd, obuf, k, out) != k) {
+                        perror("logCompact(): pwrite() Error");
+                        goto out;
+                }
+                out += k;
+                k = 0;
+        }
+
+        /* 3. under the lock, move over the entries appended since the snapshot */
+        pthread_mutex_lock(&ls->lock);
+        if (logFlush(ls) == 0) {
+                pthread_mutex_unlock(&ls->lock);
+                goto out;
+        }
+        fresh = malloc((size_t)ls->nwhere * sizeof(off_t));
+        if (fresh == NULL) {
+                perror("logCompact(): malloc() Error");
+                pthread_mutex_unlock(&ls->lock);
+                goto out;
+        }
+        memcpy(fresh, moved, (size_t)nsnap * sizeof(off_t));
+        for (n = nsnap; n < ls->nwhere; n++) {
+                fresh[n] = -1;
+        }
+        for (off = end; off < ls->flushed; off += got) {
+                LogEntry *ents = (LogEntry *)buf;
+                size_t want = ls->flushed - off < LOG_BUF ? ls->flushed - off : LOG_BUF;
+                got = pread(ls->fd, buf, want, off);
+                if (got <= 0 || got % sizeof(e) != 0 || pwrite(tfd, buf, got, out) != got) {
+                        perror("logCompact(): tail copy Error");
+                        free(fresh);
+                        pthread_mutex_unlock(&ls->lock);
+                        goto out;
+                }
+                for (i = 0; i < got / (ssize_t)sizeof(e); i++) {
+                        fresh[ents[i].n] = out + i * (off_t)sizeof(e);
+                }
+                out += got;
+        }
+        if (fsync(tfd) == -1 || rename(tname, ls->fname) == -1) {
+                perror("logCompact(): fsync()/rename() Error");
+                free(fresh);
+                pthread_mutex_unlock(&ls->lock);
+                goto out;
+        }
+        close(ls->fd);
+        ls->fd = tfd;
+        tfd = -1;
+        free(ls->where);
+        ls->where = fresh;
+        ls->flushed = ls->len = out;
+        ls->compactions++;
+        pthread_mutex_unlock(&ls->lock);
+        status = 1;
+
+out:
+        if (tfd != -1) {
+                close(tfd);
+                unlink(tname);
+        }
+        free(snap);
+        free(moved);
+        free(buf);
+        free(obuf);
+        pthread_mutex_unlock(&ls->compacting);
+        return status;
+}
+
+int logClose(LogStore *ls) {
+        /* Stops the compactor, syncs and closes the log
+                returns 1 if successful
+                        0 otherwise
+        */
+        int status;
+
+        pthread_mutex_lock(&ls->lock);
+        ls->stop = 1;
+        pthread_cond_signal(&ls->wake);
+        pthread_mutex_unlock(&ls->lock);
+        pthread_join(ls->compactor, NULL);
+
+        status = logSync(ls);
+        close(ls->fd);
+        free(ls->wbuf);
+        free(ls->where);
+        pthread_mutex_destroy(&ls->lock);
+        pthread_mutex_destroy(&ls->compacting);
+        pthread_cond_destroy(&ls->wake);
+        return status;
+}
+
+int benchLog(const char *fname, int n, int updates) {
+        /* Times random updates of n records done in place with putNthRec() and
+           appended with logPutNthRec(), next to a sequential write of the same
+           amount of data with putRecs(). The log is then reopened and checked.
+                returns 1 if successful
+                        0 otherwise
+        */
+        char lname[4200];
+        LogStore ls;
+        Record r, *rs;
+        int *ns, *model;
+        int fd, i, ok = 1;
+        double t;
+
+        if (n <= 0 || updates <= 0) {
+                fprintf(stderr, "benchLog(): nothing to do\n");
+                return 0;
+        }
+        snprintf(lname, sizeof(lname), "%s.log", fname);
+        unlink(lname);
+        rs = calloc(updates, sizeof(Record));
+        ns = malloc((size_t)updates * sizeof(int));
+        model = malloc((size_t)n * sizeof(int));
+        fd = open(fname, O_CREAT|O_TRUNC|O_RDWR, 0600);
+        if (rs == NULL || ns == NULL || model == NULL || fd == -1) {
+                perror("benchLog()");
+                free(rs);
+                free(ns);
+                free(model);
+                return 0;
+        }
+        srand(1);
+        for (i = 0; i < updates; i++) {
+                ns[i] = rand() % n;
+                snprintf(rs[i].field1, sizeof(rs[i].field1), "v%d", i);
+                rs[i].field2 = i;
+        }
+
+        printf("%-24s %10s %10s %14s %10s\n", "method", "updates", "seconds", "updates/s", "MB/s");
+
+        t = seconds();
+        putRecs(fd, rs, 0, updates);
+        fsync(fd);
+        t = seconds() - t;
+        printf("%-24s %10d %10.3f %14.0f %10.1f\n", "sequential putRecs()", updates, t,
+               updates / t, updates * sizeof(Record) / t / 1e6);
+
+        ftruncate(fd, 0);
+        ftruncate(fd, (off_t)n * sizeof(Record));
+        t = seconds();
+        for (i = 0; i < updates && putNthRec(fd, rs[i], ns[i]); i++)
+                ;
+        fsync(fd);
+        t = seconds() - t;
+        printf("%-24s %10d %10.3f %14.0f %10.1f\n", "in-place putNthRec()", updates, t,
+               updates / t, updates * sizeof(Record) / t / 1e6);
+
+        if (logOpen(&ls, lname) == 0) {
+                close(fd);
+                free(rs);
+                free(ns);
+                free(model);
+                return 0;
+        }
+        t = seconds();
+        for (i = 0; i < updates && logPutNthRec(&ls, rs[i], ns[i]); i++)
+                ;
+        logSync(&ls);
+        t = seconds() - t;
+        printf("%-24s %10d %10.3f %14.0f %10.1f\n", "logPutNthRec()", updates, t,
+               updates / t, updates * sizeof(Record) / t / 1e6);
+        printf("compactions: %ld, live records: %ld, log size: %lld bytes\n",
+               ls.compactions, ls.live, (long long)ls.len);
+        logClose(&ls);
+
+        /* reopen (replaying the log) and check the latest version of every record */
+        for (i = 0; i < n; i++) {
+                model[i] = -1;
+        }
+        for (i = 0; i < updates; i++) {
+                model[ns[i]] = i;
+        }
+        if (logOpen(&ls, lname) == 0) {
+                ok = 0;
+        } else {
+                for (i = 0; i < n && ok; i++) {
+                        if (model[i] == -1) {
+                                continue;
+                        }
+                        if (logGetNthRec(&ls, &r, i) == 0 || r.field2 != model[i]) {
+                                fprintf(stderr, "benchLog(): record %d has the wrong version\n", i);
+                                ok = 0;
+                        }
+                }
+                logClose(&ls);
+        }
+
+        close(fd);
+        unlink(fname);
+        unlink(lname);
+        free(rs);
+        free(ns);
+        free(model);
+        return ok;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Concurrent access with record-range locks                               */
+/* ---------------------------------------------------------------------- */
+
+/* Several processes may work on one record file at the same time by locking only
+   the byte range of the records they touch with fcntl(2). Open file description
+   locks (F_OFD_SETLKW) are used where available: they belong to the open() rather
+   than to the process, so every process (or thread) must open the file itself
+   instead of sharing a descriptor inherited through fork(). The locked functions
+   use pread()/pwrite() because a shared file offset moved by lseek() in one process
+   would otherwise be moved under the feet of another. */
+
+#ifdef F_OFD_SETLKW
+#define REC_SETLKW F_OFD_SETLKW
+#else
+#define REC_SETLKW F_SETLKW
+#endif
+
+static int recLock(int fd, short type, int first, int count) {
+        /* applies an fcntl() lock of the given type to records first..first+count-1;
+           count 0 means up to the end of the file, however far it grows */
+        struct flock fl;
+
+        memset(&fl, 0, sizeof(fl)); /* l_pid must be 0 for OFD locks */
+        fl.l_type = type;
+        fl.l_whence = SEEK_SET;
+        fl.l_start = (off_t)first * sizeof(Record);
+        fl.l_len = (off_t)count * sizeof(Record);
+        while (fcntl(fd, REC_SETLKW, &fl) == -1) {
+                if (errno != EINTR) {
+                        perror("fcntl() lock Error");
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+int lockRecs(int fd, int first, int count, int exclusive) {
+        /* Waits until records first..first+count-1 can be locked for reading
+           (exclusive == 0) or for writing (exclusive != 0). count 0 locks up to
+           the end of the file.
+                returns 1 if successful
+                        0 otherwise
+        */
+        return recLock(fd, exclusive ? F_WRLCK : F_RDLCK, first, count);
+}
+
+int unlockRecs(int fd, int first, int count) {
+        /* Releases the lock on records first..first+count-1
+                returns 1 if successful
+                        0 otherwise
+        */
+        return recLock(fd, F_UNLCK, first, count);
+}
+
+int getNthRecShared(int fd, Record *r, int n) {
+        /* Reads the n-th record while holding a shared lock on it, so the record is
+           never seen half-written by a concurrent putNthRecLocked()
+                returns 1 if successful
+                        0 otherwise
+        */
+        int status;
+
+        if (lockRecs(fd, n, 1, 0) == 0) {
+                return 0;
+        }
+        status = pread(fd, r, sizeof(Record), (off_t)n * sizeof(Record)) == sizeof(Record);
+        if (!status) {
+                fprintf(stderr, "getNthRecShared(): cannot read record %d.\n", n);
+        }
+        unlockRecs(fd, n, 1);
+        return status;
+}
+
+int putNthRecLocked(int fd, Record r, int n) {
+        /* Writes the record r at the n-th position while holding an exclusive lock on it
+                returns 1 if successful
+                        0 otherwise
+        */
+        int status;
+
+        if (lockRecs(fd, n, 1, 1) == 0) {
+                return 0;
+        }
+        status = idxWillWrite(fd, &r, n) &&
+                 pwrite(fd, &r, sizeof(Record), (off_t)n * sizeof(Record)) == sizeof(Record);
+        if (!status) {
+                perror("putNthRecLocked(): pwrite() Error");
+        }
+        idxWrote(fd, status);
+        unlockRecs(fd, n, 1);
+        return status;
+}
+
+int updateNthRec(int fd, int n, void (*change)(Record *r)) {
+        /* Reads the n-th record, lets change() modify it and writes it back, all under
+           one exclusive lock, so that concurrent updates of the same record are not lost
+                returns 1 if successful
+                        0 otherwise
+        */
+        Record r;
+        int status = 0;
+
+        if (lockRecs(fd, n, 1, 1) == 0) {
+                return 0;
+        }
+        if (pread(fd, &r, sizeof(Record), (off_t)n * sizeof(Record)) == sizeof(Record)) {
+                change(&r);
+                status = idxWillWrite(fd, &r, n) &&
+                         pwrite(fd, &r, sizeof(Record), (off_t)n * sizeof(Record)) == sizeof(Record);
+                idxWrote(fd, status);
+        }
+        if (!status) {
+                fprintf(stderr, "updateNthRec(): cannot update record %d.\n", n);
+        }
+        unlockRecs(fd, n, 1);
+        return status;
+}
+
+static void incField2(Record *r) {
+        /* the update done by benchLocks() */
+        r->field2++;
+}
+
+static int runLockers(const char *fname, int n, int ops, int procs, int whole, double *rate) {
+        /* forks procs processes that together make ops random updates of the n records,
+           locking either each record or (whole != 0) the whole file */
+        double t;
+        int p, status, failed = 0;
+
+        t = seconds();
+        for (p = 0; p < procs; p++) {
+                pid_t pid = fork();
+                if (pid == -1) {
+                        perror("fork() Error");
+                        failed = 1;
+                        break;
+                }
+                if (pid == 0) {
+                        int fd = open(fname, O_RDWR); /* each process needs its own open() */
+                        int i, mine = ops / procs + (p < ops % procs);
+                        Record r;
+                        if (fd == -1) {
+                                _exit(1);
+                        }
+                        srand(p + 1);
+                        for (i = 0; i < mine; i++) {
+                                int k = rand() % n;
+                                if (!whole) {
+                                        if (updateNthRec(fd, k, incField2) == 0) {
+                                                _exit(1);
+                                        }
+                                        continue;
+                                }
+                                if (lockRecs(fd, 0, 0, 1) == 0 ||
+                                    pread(fd, &r, sizeof(r), (off_t)k * sizeof(r)) != sizeof(r)) {
+                                        _exit(1);
+                                }
+                                r.field2++;
+                                if (pwrite(fd, &r, sizeof(r), (off_t)k * sizeof(r)) != sizeof(r) ||
+                                    unlockRecs(fd, 0, 0) == 0) {
+                                        _exit(1);
+                                }
+                        }
+                        close(fd);
+                        _exit(0);
+                }
+        }
+        while (wait(&status) > 0) {
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                        failed = 1;
+                }
+        }
+        *rate = ops / (seconds() - t);
+        return !failed;
+}
+
+int benchLocks(const char *fname, int n, int ops, int maxprocs) {
+        /* Runs ops random increments of field2 over n records with 1, 2, 4, ...
+           maxprocs processes, using record locks and, for comparison, one lock on the
+           whole file. After each run the field2 values must add up to ops, which shows
+           that no update was lost.
+                returns 1 if successful
+                        0 otherwise
+        */
+        Record *rs;
+        int fd, procs, whole, i, ok = 1;
+        long long sum;
+        double rate = 0;
+
+        if (n <= 0 || ops <= 0 || maxprocs <= 0) {
+                fprintf(stderr, "benchLocks(): nothing to do\n");
+                return 0;
+        }
+        rs = calloc(n, sizeof(Record));
+        if (rs == NULL) {
+                perror("benchLocks(): calloc() Error");
+                return 0;
+        }
+
+        printf("%-12s %10s %14s\n", "processes", "locking", "updates/s");
+        for (procs = 1; procs <= maxprocs && ok; procs *= 2) {
+                for (whole = 0; whole < 2 && ok; whole++) {
+                        fd = open(fname, O_CREAT|O_TRUNC|O_RDWR, 0600);
+                        if (fd == -1 || putRecs(fd, rs, 0, n) == 0) {
+                                perror("benchLocks(): cannot create the record file");
+                                free(rs);
+                                return 0;
+                        }
+                        ok = runLockers(fname, n, ops, procs, whole, &rate);
+                        getRecs(fd, rs, 0, n);
+                        for (sum = 0, i = 0; i < n; i++) {
+                                sum += rs[i].field2;
+                                rs[i].field2 = 0;
+                        }
+                        close(fd);
+                        if (sum != ops) {
+                                fprintf(stderr, "benchLocks(): %lld of %d updates survived\n", sum, ops);
+                                ok = 0;
+                        }
+                        printf("%-12d %10s %14.0f\n", procs, whole ? "file" : "record", rate);
+                }
+        }
+
+        unlink(fname);
+        free(rs);
+        return ok;
+}
@@ -1,40 +1,254 @@
-/* File: stream1.c ["./a.out abc.txt" prints the number of english letters in the file abc.txt] */
+/* File: stream1.c ["./a.out abc.txt" prints the number of english letters in the file abc.txt]
+   ["./a.out -j 8 abc.txt" counts with 8 threads, "./a.out -b abc.txt" times 1, 2, 4, ... threads] */
 #include <stdio.h>
 #include <stdlib.h> /* the manual for exit() function (used in this program) tells that this header file has to be included - "man 3 exit"*/
+#include <string.h> /* for strcmp(3) */
+#include <fcntl.h> /* for open(2) */
+#include <unistd.h> /* for read(2), pread(2), close(2), sysconf(3) */
+#include <pthread.h> /* for the parallel mode; compile with -pthread */
+#include <time.h> /* for clock_gettime(2) */
+#include <sys/stat.h> /* for fstat(2) */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> /* SSE2 and AVX2 intrinsics */
+#endif
+
+#define BUFSIZE (1 << 20) /* the file is read 1 MiB at a time instead of one fgetc() per character */
+#define MAXTHREADS 256
+
+/* Counting the letters of a block of bytes.
+   The portable version looks at one byte at a time. On x86 the SSE2 and AVX2 versions
+   look at 16 or 32 bytes at a time: (c | 0x20) folds capital letters onto small ones,
+   and an unsigned "c - 'a' < 26" test is done with a signed compare after shifting the
+   range down by 128. Each compare gives a bit mask whose set bits are counted. */
+
+static long countLettersScalar(const unsigned char *p, size_t n) {
+	long count = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		unsigned char ch = p[i] | 0x20;
+		count += (ch >= 'a' && ch <= 'z');
+	}
+	return count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2,popcnt")))
+static long countLettersSSE2(const unsigned char *p, size_t n) {
+	const __m128i fold = _mm_set1_epi8(0x20);
+	const __m128i shift = _mm_set1_epi8((char)('a' + 128));
+	const __m128i limit = _mm_set1_epi8((char)(-128 + 26));
+	long count = 0;
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		v = _mm_sub_epi8(_mm_or_si128(v, fold), shift);
+		count += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(v, limit)));
+	}
+	return count + countLettersScalar(p + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+static long countLettersAVX2(const unsigned char *p, size_t n) {
+	const __m256i fold = _mm256_set1_epi8(0x20);
+	const __m256i shift = _mm256_set1_epi8((char)('a' + 128));
+	const __m256i limit = _mm256_set1_epi8((char)(-128 + 26));
+	long count = 0;
+	size_t i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		v = _mm256_sub_epi8(_mm256_or_si256(v, fold), shift);
+		/* a > b is the same as b < a */
+		count += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, v)));
+	}
+	return count + countLettersScalar(p + i, n - i);
+}
+#endif
+
+static long (*pickLetterCounter(void))(const unsigned char *, size_t) {
+	/* chooses the fastest version this CPU can run */
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+		return countLettersAVX2;
+	}
+	if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt")) {
+		return countLettersSSE2;
+	}
+#endif
+	return countLettersScalar;
+}
+
+static long (*countLetters)(const unsigned char *, size_t); /* the version picked for this CPU */
+
+/* In the parallel mode the file is cut into one chunk per thread. Every thread
+   reads its own chunk with pread(), which does not move a shared file offset, and
+   counts it; the counts are added up at the end. A letter is never split between
+   chunks, so nothing has to be fixed up at the chunk boundaries. */
+
+typedef struct job {
+	int fd; /* the file */
+	off_t start, end; /* the chunk of the file counted by this thread */
+	long count; /* the letters found in the chunk */
+	int failed; /* set if a read failed */
+} Job;
+
+static void *countChunk(void *arg) {
+	Job *job = arg;
+	unsigned char *buf = malloc(BUFSIZE);
+	off_t pos;
+	ssize_t n;
+
+	job->count = 0;
+	job->failed = (buf == NULL);
+	for (pos = job->start; pos < job->end && !job->failed; pos += n) {
+		size_t want = job->end - pos < BUFSIZE ? job->end - pos : BUFSIZE;
+		n = pread(job->fd, buf, want, pos);
+		if (n <= 0) {
+			job->failed = 1;
+			break;
+		}
+		job->count += countLetters(buf, n);
+	}
+	free(buf);
+	return NULL;
+}
+
+static int countFile(int fd, off_t size, int nthreads, long *count) {
+	/* counts the letters of the first size bytes of fd with nthreads threads; returns 0 on failure */
+	pthread_t tids[MAXTHREADS];
+	Job jobs[MAXTHREADS];
+	off_t chunk;
+	int i, started, ok = 1;
+
+	chunk = (size / nthreads + 4095) & ~(off_t)4095; /* chunks start on page boundaries */
+	for (i = 0; i < nthreads; i++) {
+		jobs[i].fd = fd;
+		jobs[i].start = (off_t)i * chunk < size ? (off_t)i * chunk : size;
+		jobs[i].end = (off_t)(i + 1) * chunk < size ? (off_t)(i + 1) * chunk : size;
+	}
+	for (started = 1; started < nthreads; started++) {
+		if (pthread_create(&tids[started], NULL, countChunk, &jobs[started]) != 0) {
+			break;
+		}
+	}
+	countChunk(&jobs[0]); /* the main thread counts the first chunk itself */
+	for (i = started; i < nthreads; i++) {
+		countChunk(&jobs[i]); /* a thread could not be started */
+	}
+
+	*count = 0;
+	for (i = 0; i < nthreads; i++) {
+		if (i > 0 && i < started) {
+			pthread_join(tids[i], NULL);
+		}
+		*count += jobs[i].count;
+		ok = ok && !jobs[i].failed;
+	}
+	return ok;
+}
+
+static double seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 int main(int argc, char *argv[]) {
 
-	FILE *fp; /* the variable to store the stream for the input file */
-	char ch;
-	int countE=0;
+	int fd; /* the file descriptor of the input file */
+	unsigned char *buf; /* a block of the file */
+	ssize_t n; /* how many bytes the last read() returned */
+	long countE=0;
+	int nthreads = 1; /* threads used to count */
+	int bench = 0; /* time the count with 1, 2, 4, ... threads */
+	struct stat sb;
+	char *fname;
+
+	/* options: "-j N" counts with N threads (0 means one per CPU), "-b" runs the benchmark */
+	while (argc > 2 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-j") == 0 && argc > 3) {
+			nthreads = atoi(argv[2]);
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-b") == 0) {
+			bench = 1;
+			argv++;
+			argc--;
+		} else {
+			break;
+		}
+	}
+	if (nthreads <= 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (nthreads < 1 || nthreads > MAXTHREADS) {
+		nthreads = nthreads < 1 ? 1 : MAXTHREADS;
+	}
 
-	if (argc != 2) { 
+	if (argc != 2) {
 		/* the program is invoked with wrong number of command line arguments.
 		   that is, it could have been called as "./a.out" where argc becomes 1 OR
 		   it could have been called as "./countL abc def ghi" where argc becomes 4, etc.
 		   So , print an error message and exit from the program
 		*/
-		printf("Wrong arguments! Use as %s <filename>\n", argv[0]); /* argv[0] is the name of the executable program - Eg., a.out or countL in the above examples. */
+		printf("Wrong arguments! Use as %s [-j threads] [-b] <filename>\n", argv[0]); /* argv[0] is the name of the executable program - Eg., a.out or countL in the above examples. */
 		exit(1); /* what does it do? Read manual by "man 3 exit" */
-		
+
 	}
+	fname = argv[1];
 
-	fp = fopen(argv[1], "r"); /* argv[1] stores the name of the file from which to read. "r" stands for "read" mode. */
-				  /* for details on fopen() read the online manual - "man 3 fopen" */
+	fd = open(fname, O_RDONLY); /* argv[1] stores the name of the file from which to read. O_RDONLY stands for "read only". */
+				  /* for details on open() read the online manual - "man 2 open" */
 
-	if (fp == NULL) { /* If for some reason fopen cannot "open" the file, it will return NULL) */
-		printf("The file %s cannot be opened for reading!!!\n", argv[1]); /* argv[1] is the name of the file the user has given as the command line argument! Eg., For example if the user has executed the program as "./a.out abc.txt", then argv[1] will contain "abc.txt" */
+	if (fd == -1) { /* If for some reason open cannot "open" the file, it will return -1) */
+		printf("The file %s cannot be opened for reading!!!\n", fname); /* argv[1] is the name of the file the user has given as the command line argument! Eg., For example if the user has executed the program as "./a.out abc.txt", then argv[1] will contain "abc.txt" */
 		exit(1); /* what does it do? Read manual by "man 3 exit" */
 	}
 
-	while (!feof(fp)) { /* the stream fp has NOT reached "End Of File" - eof. If eof - the loop ends */
+	countLetters = pickLetterCounter();
 
-		ch = fgetc(fp);
-		if ( (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')) { /* ch is an English letter - either small or capital */
-			countE = countE + 1;
+	if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+		/* a regular file can be cut into chunks, one per thread */
+		if (bench) {
+			int maxthreads = nthreads > 1 ? nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+			int t;
+			printf("%8s %10s %10s\n", "threads", "seconds", "MB/s");
+			for (t = 1; t <= maxthreads && t <= MAXTHREADS; t *= 2) {
+				double start = seconds(), elapsed;
+				long count;
+				if (countFile(fd, sb.st_size, t, &count) == 0 || (t > 1 && count != countE)) {
+					printf("Counting with %d threads failed!!!\n", t);
+					exit(1);
+				}
+				elapsed = seconds() - start;
+				countE = count;
+				printf("%8d %10.3f %10.0f\n", t, elapsed, sb.st_size / elapsed / 1e6);
+			}
+		} else if (countFile(fd, sb.st_size, nthreads, &countE) == 0) {
+			perror("read");
+			exit(1);
 		}
-
+	} else {
+		/* read() returns 0 at "End Of File", so unlike a feof() loop no extra character is counted at the end */
+		buf = malloc(BUFSIZE);
+		if (buf == NULL) {
+			printf("Out of memory!!!\n");
+			exit(1);
+		}
+		while ((n = read(fd, buf, BUFSIZE)) > 0) {
+			countE = countE + countLetters(buf, n);
+		}
+		if (n == -1) {
+			perror("read");
+			exit(1);
+		}
+		free(buf);
 	}
+	close(fd);
 
-	printf("The number of English letters in the file %s is %d.\n", argv[1], countE);
+	printf("The number of English letters in the file %s is %ld.\n", fname, countE);
+	return 0;
 }
@@ -1,66 +1,540 @@
-/* File: stream2.c ["./a.out abc.txt" would print number of characters, words, lines and sentences in the file abc.txt.] */
+/* File: stream2.c ["./a.out abc.txt" would print number of characters, words, lines and sentences in the file abc.txt.]
+   ["./a.out a.txt b.txt c.txt" counts each file and prints the totals, "./a.out -f list.txt" counts the files named
+    in list.txt (one per line), "./a.out" or "./a.out -" counts the standard input]
+   ["./a.out -j 8 abc.txt" counts with 8 threads, "./a.out -b abc.txt" times 1, 2, 4, ... threads] */
 #include <stdio.h>
 #include <stdlib.h> /* the manual for exit() function (used in this program) tells that this header file has to be included - "man 3 exit"*/
+#include <string.h> /* for strcmp(3) */
+#include <fcntl.h> /* for open(2) */
+#include <unistd.h> /* for read(2), pread(2), close(2), sysconf(3) */
+#include <pthread.h> /* for the parallel mode; compile with -pthread */
+#include <time.h> /* for clock_gettime(2) */
+#include <sys/stat.h> /* for fstat(2) */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> /* SSE2 and AVX2 intrinsics */
+#endif
 #define true 1
 #define false 0
-int main(int argc, char *argv[]) {
+#define BUFSIZE (1 << 20) /* the file is read 1 MiB at a time instead of one fgetc() per character */
+#define MAXTHREADS 256
+#define NBUFS 2 /* blocks in flight between the reading thread and the counting thread */
+
+/* the counts kept for a file */
+typedef struct counts {
+        long countC; /* to store the number of Characters in the file */
+        long countW; /* to store the number of Words in the file */
+        long countL; /* to store the number of Lines in the file */
+        long countS; /* to store the number of Sentences in the file */
+} Counts;
+
+/* Identifying a new word is a bit tricky comprared to identifying lines or sentences.
+   A non-white character (non-space and non-tab and non-new-line) after a sequence of white characters signifies starting of a new word.
+   That is, if the previous character is white, then a non-white character means starting of a word.
+   We shall keep track of this using a variable isPreviousWhite, which is carried from one block of the file to the next. */
+
+static void countBlockScalar(const unsigned char *p, size_t n, Counts *c, int *isPreviousWhite) {
+        /* counts one block a character at a time */
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+                unsigned char ch = p[i];
+                int white = (ch == ' ' || ch == '\t' || ch == '\n');
+                c->countL += (ch == '\n'); /* a new line is starting */
+                c->countS += (ch == '.'); /* this is the end of a new sentence */
+                c->countW += (!white && *isPreviousWhite); /* the previous character was white and the new one is not - a new word */
+                *isPreviousWhite = white;
+        }
+        c->countC += n;
+}
+
+/* The SSE2 and AVX2 versions compare 16 or 32 characters at a time and turn each
+   comparison into a bit mask, one bit per character. Lines and sentences are the
+   set bits of the '\n' and '.' masks. For words, the white-character mask is
+   shifted by one position (bringing in the last character of the previous group)
+   so that each bit tells whether the character before was white; a word starts
+   where a non-white bit meets a "previous was white" bit. */
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2,popcnt")))
+static void countBlockSSE2(const unsigned char *p, size_t n, Counts *c, int *isPreviousWhite) {
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i dot = _mm_set1_epi8('.');
+        unsigned carry = *isPreviousWhite ? 1 : 0;
+        size_t i;
+
+        for (i = 0; i + 16 <= n; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+                __m128i nl = _mm_cmpeq_epi8(v, newline);
+                unsigned ws = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                                                          _mm_cmpeq_epi8(v, tab)), nl));
+                unsigned prevWhite = ((ws << 1) | carry) & 0xffff;
+                c->countL += __builtin_popcount(_mm_movemask_epi8(nl));
+                c->countS += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, dot)));
+                c->countW += __builtin_popcount(~ws & prevWhite & 0xffff);
+                carry = ws >> 15;
+        }
+        c->countC += i;
+        *isPreviousWhite = carry;
+        countBlockScalar(p + i, n - i, c, isPreviousWhite);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void countBlockAVX2(const unsigned char *p, size_t n, Counts *c, int *isPreviousWhite) {
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i dot = _mm256_set1_epi8('.');
+        unsigned carry = *isPreviousWhite ? 1 : 0;
+        size_t i;
+
+        for (i = 0; i + 32 <= n; i += 32) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+                __m256i nl = _mm256_cmpeq_epi8(v, newline);
+                unsigned ws = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                                                                             _mm256_cmpeq_epi8(v, tab)), nl));
+                unsigned prevWhite = (ws << 1) | carry;
+                c->countL += __builtin_popcount((unsigned)_mm256_movemask_epi8(nl));
+                c->countS += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, dot)));
+                c->countW += __builtin_popcount(~ws & prevWhite);
+                carry = ws >> 31;
+        }
+        c->countC += i;
+        *isPreviousWhite = carry;
+        countBlockScalar(p + i, n - i, c, isPreviousWhite);
+}
+#endif
+
+typedef void (*BlockCounter)(const unsigned char *, size_t, Counts *, int *);
+
+static BlockCounter pickBlockCounter(void) {
+        /* chooses the fastest version this CPU can run */
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+                return countBlockAVX2;
+        }
+        if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt")) {
+                return countBlockSSE2;
+        }
+#endif
+        return countBlockScalar;
+}
+
+static BlockCounter countBlock; /* the version picked for this CPU */
+
+/* In the parallel mode the file is cut into one chunk per thread, and every thread
+   reads its own chunk with pread() and counts it. Characters, lines and sentences
+   of the chunks simply add up. A word, however, may be cut in two by a chunk
+   boundary; so each thread first reads the one character just before its chunk
+   and starts with isPreviousWhite set from it, exactly as if the whole file had been
+   read by one thread. Then the word counts also simply add up. */
+
+typedef struct job {
+        int fd; /* the file */
+        off_t start, end; /* the chunk of the file counted by this thread */
+        Counts c; /* the counts of the chunk */
+        int failed; /* set if a read failed */
+} Job;
+
+static void *countChunk(void *arg) {
+        Job *job = arg;
+        unsigned char *buf = malloc(BUFSIZE);
+        int isPreviousWhite = true;
+        off_t pos;
+        ssize_t n;
+
+        job->c = (Counts){0, 0, 0, 0};
+        job->failed = (buf == NULL);
+        if (!job->failed && job->start > 0 && job->start < job->end) {
+                unsigned char ch;
+                if (pread(job->fd, &ch, 1, job->start - 1) != 1) {
+                        job->failed = 1;
+                }
+                isPreviousWhite = (ch == ' ' || ch == '\t' || ch == '\n');
+        }
+        for (pos = job->start; pos < job->end && !job->failed; pos += n) {
+                size_t want = job->end - pos < BUFSIZE ? job->end - pos : BUFSIZE;
+                n = pread(job->fd, buf, want, pos);
+                if (n <= 0) {
+                        job->failed = 1;
+                        break;
+                }
+                countBlock(buf, n, &job->c, &isPreviousWhite);
+        }
+        free(buf);
+        return NULL;
+}
+
+static int countFile(int fd, off_t size, int nthreads, Counts *c) {
+        /* counts the first size bytes of fd with nthreads threads; returns 0 on failure */
+        pthread_t tids[MAXTHREADS];
+        Job jobs[MAXTHREADS];
+        off_t chunk;
+        int i, started, ok = 1;
+
+        chunk = (size / nthreads + 4095) & ~(off_t)4095; /* chunks start on page boundaries */
+        for (i = 0; i < nthreads; i++) {
+                jobs[i].fd = fd;
+                jobs[i].start = (off_t)i * chunk < size ? (off_t)i * chunk : size;
+                jobs[i].end = (off_t)(i + 1) * chunk < size ? (off_t)(i + 1) * chunk : size;
+        }
+        for (started = 1; started < nthreads; started++) {
+                if (pthread_create(&tids[started], NULL, countChunk, &jobs[started]) != 0) {
+                        break;
+                }
+        }
+        countChunk(&jobs[0]); /* the main thread counts the first chunk itself */
+        for (i = started; i < nthreads; i++) {
+                countChunk(&jobs[i]); /* a thread could not be started */
+        }
+
+        *c = (Counts){0, 0, 0, 0};
+        for (i = 0; i < nthreads; i++) {
+                if (i > 0 && i < started) {
+                        pthread_join(tids[i], NULL);
+                }
+                c->countC += jobs[i].c.countC;
+                c->countW += jobs[i].c.countW;
+                c->countL += jobs[i].c.countL;
+                c->countS += jobs[i].c.countS;
+                ok = ok && !jobs[i].failed;
+        }
+        return ok;
+}
+
+static double seconds(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Counting many files.
+   Counting a block takes far less time than reading it, so for a long list of files
+   a separate reading thread opens and reads the files one after another into NBUFS
+   buffers, while the main thread counts the buffers it has already filled. The two
+   threads take turns on the buffers (double buffering), so the next block - or the
+   next file - is being read while the current one is counted, and one process
+   handles the whole list. */
+
+typedef struct block {
+        unsigned char *data; /* the bytes read */
+        ssize_t n; /* how many bytes were read; 0 at the end of a file, -1 if the read failed */
+        int file; /* which file of the list they belong to */
+        int opened; /* 0 if the file could not be opened */
+} Block;
+
+typedef struct pipeline {
+        char **names; /* the files, "-" is the standard input */
+        int nfiles;
+        Block blocks[NBUFS]; /* filled by the reader at tail, counted at head */
+        int head, tail, count;
+        pthread_mutex_t mutex;
+        pthread_cond_t filled, emptied;
+} Pipeline;
+
+static Block *nextFree(Pipeline *pl) {
+        /* waits for a buffer that the counting thread has finished with */
+        Block *b;
+        pthread_mutex_lock(&pl->mutex);
+        while (pl->count == NBUFS) {
+                pthread_cond_wait(&pl->emptied, &pl->mutex);
+        }
+        b = &pl->blocks[pl->tail];
+        pthread_mutex_unlock(&pl->mutex);
+        return b;
+}
+
+static void post(Pipeline *pl) {
+        /* hands the buffer at tail to the counting thread */
+        pthread_mutex_lock(&pl->mutex);
+        pl->tail = (pl->tail + 1) % NBUFS;
+        pl->count++;
+        pthread_cond_signal(&pl->filled);
+        pthread_mutex_unlock(&pl->mutex);
+}
+
+static void *readFiles(void *arg) {
+        /* the reading thread: every file ends with a block of n = 0 (or -1 on an error) */
+        Pipeline *pl = arg;
+        int i, fd;
+
+        for (i = 0; i < pl->nfiles; i++) {
+                Block *b;
+                fd = strcmp(pl->names[i], "-") == 0 ? 0 : open(pl->names[i], O_RDONLY);
+                if (fd != -1) {
+                        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                }
+                do {
+                        b = nextFree(pl);
+                        b->file = i;
+                        b->opened = (fd != -1);
+                        b->n = fd == -1 ? -1 : read(fd, b->data, BUFSIZE);
+                        post(pl);
+                } while (b->n > 0);
+                if (fd > 0) {
+                        close(fd);
+                }
+        }
+        return NULL;
+}
 
-        FILE *fp; /* the variable to store the stream for the input file */
-        char ch; /* the contents of the file will be read in this variable one character by one character */
-        int countC=0; /* to store the number of Characters in the file */
-        int countW=0; /* to store the number of Words in the file */
-        int countL=0; /* to store the number of Lines in the file */
-        int countS=0; /* to store the number of Sentences in the file */
-        
-        /* Identifying a new word is a bit tricky comprared to identifying lines or sentences.
-           A non-white character (non-space and non-tab and non-new-line) after a sequence of white characters signifies starting of a new word.
-           That is, if the previous character is white, then a non-white character means starting of a word.
-           We shall keep track of this using a variable isPreviousWhte */
-        int isPreviousWhite = true; /* at the begining of the file, a non-white character (even if it is not 
+static int countFiles(char **names, int nfiles, Counts *total) {
+        /* counts and prints every file of the list, adding them to total; returns the number of files that failed */
+        Pipeline pl;
+        pthread_t reader;
+        Counts c = {0, 0, 0, 0};
+        int isPreviousWhite = true;
+        int i, failed = 0, done = 0;
+
+        pl.names = names;
+        pl.nfiles = nfiles;
+        pl.head = pl.tail = pl.count = 0;
+        pthread_mutex_init(&pl.mutex, NULL);
+        pthread_cond_init(&pl.filled, NULL);
+        pthread_cond_init(&pl.emptied, NULL);
+        for (i = 0; i < NBUFS; i++) {
+                pl.blocks[i].data = malloc(BUFSIZE);
+                if (pl.blocks[i].data == NULL) {
+                        printf("Out of memory!!!\n");
+                        exit(1);
+                }
+        }
+        if (pthread_create(&reader, NULL, readFiles, &pl) != 0) {
+                perror("pthread_create");
+                exit(1);
+        }
+
+        while (done < nfiles) {
+                Block *b;
+                pthread_mutex_lock(&pl.mutex);
+                while (pl.count == 0) {
+                        pthread_cond_wait(&pl.filled, &pl.mutex);
+                }
+                b = &pl.blocks[pl.head];
+                pthread_mutex_unlock(&pl.mutex);
+
+                if (b->n > 0) {
+                        countBlock(b->data, b->n, &c, &isPreviousWhite);
+                } else {
+                        /* the end of a file */
+                        if (!b->opened) {
+                                printf("The file %s cannot be opened for reading!!!\n", names[b->file]);
+                                failed++;
+                        } else if (b->n == -1) {
+                                printf("The file %s cannot be read!!!\n", names[b->file]);
+                                failed++;
+                        } else {
+                                printf("In the file %s the number of characters = %ld, number of word = %ld, number of lines = %ld, and the number of sentences = %ld.\n", names[b->file], c.countC, c.countW, c.countL, c.countS);
+                                total->countC += c.countC;
+                                total->countW += c.countW;
+                                total->countL += c.countL;
+                                total->countS += c.countS;
+                        }
+                        c = (Counts){0, 0, 0, 0};
+                        isPreviousWhite = true;
+                        done++;
+                }
+
+                pthread_mutex_lock(&pl.mutex);
+                pl.head = (pl.head + 1) % NBUFS;
+                pl.count--;
+                pthread_cond_signal(&pl.emptied);
+                pthread_mutex_unlock(&pl.mutex);
+        }
+
+        pthread_join(reader, NULL);
+        for (i = 0; i < NBUFS; i++) {
+                free(pl.blocks[i].data);
+        }
+        pthread_mutex_destroy(&pl.mutex);
+        pthread_cond_destroy(&pl.filled);
+        pthread_cond_destroy(&pl.emptied);
+        return failed;
+}
+
+static int countOne(char *fname, int nthreads, int bench, Counts *total) {
+        /* counts one file with nthreads threads (or runs the benchmark on it) and prints it; returns 0 on failure */
+        int fd; /* the file descriptor of the input file */
+        unsigned char *buf; /* the contents of the file will be read in this buffer one block at a time */
+        ssize_t n; /* how many bytes the last read() returned */
+        Counts c = {0, 0, 0, 0};
+        int isPreviousWhite = true; /* at the begining of the file, a non-white character (even if it is not
                                        preceded by white characters) means starting of a new word */
-        if (argc != 2) {
-                /* the program is invoked with wrong number of command line arguments.
-                   that is, it could have been called as "./a.out" where argc becomes 1 OR
-                   it could have been called as "./countL abc def ghi" where argc becomes 4, etc.
-                   So , print an error message and exit from the program
-                */
-                printf("Wrong arguments! Use as %s <filename>\n", argv[0]); /* argv[0] is the name of the executable program - Eg., a.out or countL in the above examples. */
-                exit(1); /* What does it do? Read manual by "man 3 exit" */
-    
-        }
-
-        fp = fopen(argv[1], "r"); /* argv[1] stores the name of the file from which to read. "r" stands for "read" mode. */
-                                  /* for details on fopen() read the online manual - "man 3 fopen" */
-
-        if (fp == NULL) { /* If for some reason fopen cannot "open" the file, it will return NULL) */
-                printf("The file %s cannot be opened for reading!!!\n", argv[1]); /* argv[1] is the name of the file the user has given as the command line argument! Eg., For example if the user has executed the program as "./a.out abc.txt", then argv[1] will contain "abc.txt" */
-                exit(1); /* what does it do? Read manual by "man 3 exit" */
-        }
-
-        while (!feof(fp)) { /* the stream fp has NOT reached "End Of File" - eof. If eof - the loop ends */
-
-                ch = fgetc(fp); /* read a nex character from the file */
-                
-                countC++; /* a new character is read */
-                
-                if (ch == '\n') { /* there is a new line to start now */
-                				countL++; /* a new line is starting */
-                }
-                
-                if (ch == '.') { /* this is the end of a new sentence */
-                				countS++; /* a new line is starting */
-                }
-                
-                if (ch == ' ' || ch == '\t' || ch == '\n') { /* the new character is a white character */
-                				isPreviousWhite = true;
-                } else { /* the new character is non-white */
-                				if ( isPreviousWhite == true ) { /* the previous character was white and 
-                        																		the new character is non-white - it is a new word then */
-                        					countW++;
-                                  isPreviousWhite = false;
+        struct stat sb;
+
+        fd = strcmp(fname, "-") == 0 ? 0 : open(fname, O_RDONLY); /* O_RDONLY stands for "read only". */
+                                  /* for details on open() read the online manual - "man 2 open" */
+
+        if (fd == -1) { /* If for some reason open cannot "open" the file, it will return -1) */
+                printf("The file %s cannot be opened for reading!!!\n", fname);
+                return 0;
+        }
+
+        if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+                /* a regular file can be cut into chunks, one per thread */
+                if (bench) {
+                        int maxthreads = nthreads > 1 ? nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+                        int t;
+                        printf("%8s %10s %10s\n", "threads", "seconds", "MB/s");
+                        for (t = 1; t <= maxthreads && t <= MAXTHREADS; t *= 2) {
+                                double start = seconds(), elapsed;
+                                Counts tc;
+                                if (countFile(fd, sb.st_size, t, &tc) == 0 ||
+                                    (t > 1 && (tc.countC != c.countC || tc.countW != c.countW ||
+                                               tc.countL != c.countL || tc.countS != c.countS))) {
+                                        printf("Counting with %d threads failed!!!\n", t);
+                                        exit(1);
+                                }
+                                elapsed = seconds() - start;
+                                c = tc;
+                                printf("%8d %10.3f %10.0f\n", t, elapsed, sb.st_size / elapsed / 1e6);
+                        }
+                } else if (countFile(fd, sb.st_size, nthreads, &c) == 0) {
+                        printf("The file %s cannot be read!!!\n", fname);
+                        close(fd);
+                        return 0;
+                }
+        } else {
+                buf = malloc(BUFSIZE);
+                if (buf == NULL) {
+                        printf("Out of memory!!!\n");
+                        exit(1);
+                }
+                /* read() returns 0 at "End Of File", so unlike a feof() loop no extra character is counted at the end */
+                while ((n = read(fd, buf, BUFSIZE)) > 0) {
+                        countBlock(buf, n, &c, &isPreviousWhite);
+                }
+                free(buf);
+                if (n == -1) {
+                        printf("The file %s cannot be read!!!\n", fname);
+                        close(fd);
+                        return 0;
+                }
+        }
+        if (fd > 0) {
+                close(fd);
+        }
+
+        printf("In the file %s the number of characters = %ld, number of word = %ld, number of lines = %ld, and the number of sentences = %ld.\n", fname, c.countC, c.countW, c.countL, c.countS);
+        total->countC += c.countC;
+        total->countW += c.countW;
+        total->countL += c.countL;
+        total->countS += c.countS;
+        return 1;
+}
+
+static int readList(char *listName, char ***names, int *nfiles, int *cap) {
+        /* appends the file names in listName, one per line, to names; returns 0 on failure */
+        FILE *fp = strcmp(listName, "-") == 0 ? stdin : fopen(listName, "r");
+        char *line = NULL;
+        size_t len = 0;
+        ssize_t got;
+
+        if (fp == NULL) {
+                printf("The file %s cannot be opened for reading!!!\n", listName);
+                return 0;
+        }
+        while ((got = getline(&line, &len, fp)) != -1) {
+                if (got > 0 && line[got - 1] == '\n') {
+                        line[--got] = '\0';
+                }
+                if (got == 0) {
+                        continue; /* empty lines are skipped */
+                }
+                if (*nfiles == *cap) {
+                        *cap = *cap ? *cap * 2 : 64;
+                        *names = realloc(*names, *cap * sizeof(char *));
+                        if (*names == NULL) {
+                                printf("Out of memory!!!\n");
+                                exit(1);
+                        }
+                }
+                (*names)[(*nfiles)++] = strdup(line);
+        }
+        free(line);
+        if (fp != stdin) {
+                fclose(fp);
+        }
+        return 1;
+}
+
+int main(int argc, char *argv[]) {
+
+        int nthreads = 1; /* threads used to count */
+        int bench = 0; /* time the count with 1, 2, 4, ... threads */
+        char **names = NULL; /* the files to count */
+        int nfiles = 0, cap = 0, failed = 0, i;
+        int listGiven = 0; /* a "-f" list was given, even an empty one */
+        static char *standardInput[] = {"-"};
+        Counts total = {0, 0, 0, 0};
+
+        /* options: "-j N" counts with N threads (0 means one per CPU), "-b" runs the benchmark,
+           "-f list" counts the files named in list ("-f -" reads the names from the standard input) */
+        while (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0') {
+                if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+                        nthreads = atoi(argv[2]);
+                        argv += 2;
+                        argc -= 2;
+                } else if (strcmp(argv[1], "-f") == 0 && argc > 2) {
+                        if (readList(argv[2], &names, &nfiles, &cap) == 0) {
+                                exit(1);
                         }
-                        	
+                        listGiven = 1;
+                        argv += 2;
+                        argc -= 2;
+                } else if (strcmp(argv[1], "-b") == 0) {
+                        bench = 1;
+                        argv++;
+                        argc--;
+                } else {
+                        /* an unknown option */
+                        printf("Wrong arguments! Use as %s [-j threads] [-b] [-f listfile] [filename ...]\n", argv[0]); /* argv[0] is the name of the executable program */
+                        exit(1); /* What does it do? Read manual by "man 3 exit" */
                 }
-        }           
-        printf("In the file %s the number of characters = %d, number of word = %d, number of lines = %d, and the number of sentences = %d.\n", argv[1], countC, countW, countL, countS);
+        }
+        if (nthreads <= 0) {
+                nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        if (nthreads < 1 || nthreads > MAXTHREADS) {
+                nthreads = nthreads < 1 ? 1 : MAXTHREADS;
+        }
+
+        for (i = 1; i < argc; i++) {
+                if (nfiles == cap) {
+                        cap = cap ? cap * 2 : 64;
+                        names = realloc(names, cap * sizeof(char *));
+                        if (names == NULL) {
+                                printf("Out of memory!!!\n");
+                                exit(1);
+                        }
+                }
+                names[nfiles++] = argv[i];
+        }
+        if (nfiles == 0) {
+                if (listGiven) {
+                        /* the lists named no files - there is nothing to count */
+                        return 0;
+                }
+                /* no files and no list - count the standard input */
+                names = standardInput;
+                nfiles = 1;
+        }
+
+        countBlock = pickBlockCounter();
+
+        if (nthreads > 1 || bench) {
+                /* big files: each one is cut into chunks counted in parallel */
+                for (i = 0; i < nfiles; i++) {
+                        failed += !countOne(names[i], nthreads, bench, &total);
+                }
+        } else {
+                /* many files: one thread reads ahead while the other counts */
+                failed = countFiles(names, nfiles, &total);
+        }
+        if (nfiles > 1) {
+                printf("In all the %d files the number of characters = %ld, number of word = %ld, number of lines = %ld, and the number of sentences = %ld.\n", nfiles, total.countC, total.countW, total.countL, total.countS);
+        }
+        return failed ? 1 : 0;
 }
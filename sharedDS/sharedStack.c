@@ -6,13 +6,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/sem.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 
 #define STACK_SIZE 10
+#define MAX_CAPACITY (1 << 24) // the most items a lock-free stack may hold
+#define MAX_PROCESSES 64
+#define SPIN_TRIES 100         // failed attempts before a lock-free push or pop sleeps on the futex
 
 /**
  * @struct SharedStack
@@ -23,6 +32,41 @@ typedef struct {
     int top;
 } SharedStack;
 
+/**
+ * @struct EventCount
+ * @brief Lets processes sleep until a condition may have changed. Waiters sleep on seq,
+ *        and a notifier only bumps it and wakes them when some process waits.
+ */
+typedef struct {
+    atomic_uint seq;
+    atomic_int waiters;
+} EventCount;
+
+/**
+ * @struct StackNode
+ * @brief A node of the lock-free stack; next is the index of the node below it.
+ */
+typedef struct {
+    int value;
+    atomic_uint next;
+} StackNode;
+
+/**
+ * @struct LockFreeStack
+ * @brief A lock-free stack that lives entirely in a shared memory segment.
+ *
+ * Nodes are referred to by their index in nodes[], never by address, because every
+ * process may attach the segment at a different address. Index 0 means "no node".
+ */
+typedef struct {
+    _Alignas(64) atomic_ullong top;     // tag << 32 | index of the top node
+    _Alignas(64) atomic_ullong freeTop; // the same for the stack of free nodes
+    _Alignas(64) EventCount notEmpty;
+    _Alignas(64) EventCount notFull;
+    unsigned capacity;
+    StackNode nodes[];                  // capacity + 1 nodes
+} LockFreeStack;
+
 /**
  * @brief Performs a wait operation on a semaphore.
  * @param semid The semaphore ID.
@@ -126,14 +170,340 @@ int pop(SharedStack *stack, int semid) {
     return value;
 }
 
+/*
+ * The lock-free stack.
+ *
+ * push() and pop() above make four semop() system calls per operation. The lock-free
+ * stack needs none unless it is empty or full: it is a Treiber stack whose top is an
+ * index into nodes[], changed with one compare-and-swap. The top word also holds a tag
+ * that every successful swap increments, so a process that read top, was delayed while
+ * that node was popped and pushed again, fails its swap instead of corrupting the stack
+ * (the ABA problem). The nodes that hold no item are kept on a second stack, freeTop;
+ * a push that finds no free node finds the stack full.
+ *
+ * A process that finds the stack empty or full spins briefly and then sleeps on a
+ * futex in the segment. These are shared (not FUTEX_PRIVATE) futexes, so they work
+ * across processes that attach the same segment.
+ */
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static unsigned wait_begin(EventCount *ec) {
+    atomic_fetch_add(&ec->waiters, 1);
+    return atomic_load(&ec->seq);
+}
+
+static void wait_commit(EventCount *ec, unsigned seq) {
+    syscall(SYS_futex, &ec->seq, FUTEX_WAIT, seq, NULL, NULL, 0);
+    atomic_fetch_sub(&ec->waiters, 1);
+}
+
+static void wait_cancel(EventCount *ec) {
+    atomic_fetch_sub(&ec->waiters, 1);
+}
+
+static void notify(EventCount *ec) {
+    atomic_thread_fence(memory_order_seq_cst); // order the stack update before reading waiters
+    if (atomic_load_explicit(&ec->waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&ec->seq, 1);
+        syscall(SYS_futex, &ec->seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+static unsigned long long next_top(unsigned long long old, unsigned index) {
+    return ((old >> 32) + 1) << 32 | index;
+}
+
+/**
+ * @brief Pushes node i onto the stack whose top word is top.
+ */
+static void push_index(LockFreeStack *stack, atomic_ullong *top, unsigned i) {
+    unsigned long long old = atomic_load_explicit(top, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&stack->nodes[i].next, (unsigned)old, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(top, &old, next_top(old, i),
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/**
+ * @brief Pops a node from the stack whose top word is top.
+ * @return Its index, or 0 if that stack is empty.
+ */
+static unsigned pop_index(LockFreeStack *stack, atomic_ullong *top) {
+    unsigned long long old = atomic_load_explicit(top, memory_order_acquire);
+    while ((unsigned)old != 0) {
+        unsigned i = (unsigned)old;
+        unsigned next = atomic_load_explicit(&stack->nodes[i].next, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(top, &old, next_top(old, next),
+                                                  memory_order_acquire, memory_order_acquire)) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Creates a shared memory segment holding an empty lock-free stack.
+ * @param shmid A pointer to the shared memory ID.
+ * @param capacity The most items the stack may hold.
+ * @return A pointer to the stack, attached in this process.
+ */
+LockFreeStack *create_lf_stack(int *shmid, unsigned capacity) {
+    if (capacity < 1 || capacity > MAX_CAPACITY) {
+        fprintf(stderr, "create_lf_stack: capacity must be 1 to %d\n", MAX_CAPACITY);
+        exit(EXIT_FAILURE);
+    }
+    *shmid = shmget(IPC_PRIVATE, sizeof(LockFreeStack) + (capacity + 1) * sizeof(StackNode), IPC_CREAT | 0666);
+    if (*shmid == -1) {
+        perror("shmget failed");
+        exit(EXIT_FAILURE);
+    }
+    LockFreeStack *stack = (LockFreeStack *)shmat(*shmid, NULL, 0);
+    if (stack == (void *)-1) {
+        perror("shmat failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // A new segment is zero-filled: both stacks are empty and nobody waits.
+    stack->capacity = capacity;
+    for (unsigned i = 1; i <= capacity; i++) {
+        push_index(stack, &stack->freeTop, i);
+    }
+    return stack;
+}
+
+/**
+ * @brief Attaches to an existing lock-free stack.
+ * @param shmid The shared memory ID.
+ * @return A pointer to the lock-free stack.
+ */
+LockFreeStack *get_lf_stack(int shmid) {
+    LockFreeStack *stack = (LockFreeStack *)shmat(shmid, NULL, 0);
+    if (stack == (void *)-1) {
+        perror("shmat failed");
+        exit(EXIT_FAILURE);
+    }
+    return stack;
+}
+
+/**
+ * @brief Pushes a value unless the lock-free stack is full.
+ * @return 1 if the value was pushed, 0 if the stack is full.
+ */
+int lf_try_push(LockFreeStack *stack, int value) {
+    unsigned i = pop_index(stack, &stack->freeTop);
+    if (i == 0) {
+        return 0;
+    }
+    stack->nodes[i].value = value;
+    push_index(stack, &stack->top, i);
+    return 1;
+}
+
+/**
+ * @brief Pops a value unless the lock-free stack is empty.
+ * @return 1 if a value was popped into *value, 0 if the stack is empty.
+ */
+int lf_try_pop(LockFreeStack *stack, int *value) {
+    unsigned i = pop_index(stack, &stack->top);
+    if (i == 0) {
+        return 0;
+    }
+    *value = stack->nodes[i].value;
+    push_index(stack, &stack->freeTop, i);
+    return 1;
+}
+
+/**
+ * @brief Pushes a value onto the lock-free stack, waiting while it is full.
+ * @param stack A pointer to the lock-free stack.
+ * @param value The value to push.
+ */
+void lf_push(LockFreeStack *stack, int value) {
+    for (int spins = 0; !lf_try_push(stack, value); spins++) {
+        if (spins < SPIN_TRIES) {
+            cpu_relax();
+            continue;
+        }
+        unsigned seq = wait_begin(&stack->notFull);
+        if (lf_try_push(stack, value)) {
+            wait_cancel(&stack->notFull);
+            break;
+        }
+        wait_commit(&stack->notFull, seq);
+    }
+    notify(&stack->notEmpty);
+}
+
+/**
+ * @brief Pops a value from the lock-free stack, waiting while it is empty.
+ * @param stack A pointer to the lock-free stack.
+ * @return The value popped from the stack.
+ */
+int lf_pop(LockFreeStack *stack) {
+    int value;
+    for (int spins = 0; !lf_try_pop(stack, &value); spins++) {
+        if (spins < SPIN_TRIES) {
+            cpu_relax();
+            continue;
+        }
+        unsigned seq = wait_begin(&stack->notEmpty);
+        if (lf_try_pop(stack, &value)) {
+            wait_cancel(&stack->notEmpty);
+            break;
+        }
+        wait_commit(&stack->notEmpty, seq);
+    }
+    notify(&stack->notFull);
+    return value;
+}
+
+/*
+ * Benchmark: half of the processes push items and the other half pop them, first through
+ * the semaphore stack and then through the lock-free stack. Each consumer adds up what it
+ * pops, so a lost or duplicated item shows up as a wrong total.
+ */
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Runs one stack with forked producer and consumer processes.
+ * @param stack The semaphore stack, or NULL to use lfStack.
+ * @param sums Shared memory where each consumer stores the sum of what it popped.
+ * @return Operations (pushes plus pops) per second.
+ */
+static double run_bench(SharedStack *stack, int semid, LockFreeStack *lfStack, int processes, long items, long long *sums, int *ok) {
+    int pairs = processes / 2;
+    long perProcess = items / pairs;
+    long long total = 0;
+
+    double start = seconds();
+    for (int p = 0; p < processes; p++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork failed");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            long long sum = 0;
+            for (long i = 0; i < perProcess; i++) {
+                if (p < pairs) {
+                    int value = (int)(p * perProcess + i);
+                    if (stack) {
+                        push(stack, semid, value);
+                    } else {
+                        lf_push(lfStack, value);
+                    }
+                } else {
+                    sum += stack ? pop(stack, semid) : lf_pop(lfStack);
+                }
+            }
+            sums[p] = sum;
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+    double elapsed = seconds() - start;
+
+    for (int p = pairs; p < processes; p++) {
+        total += sums[p];
+    }
+    long long n = perProcess * pairs;
+    *ok = *ok && total == n * (n - 1) / 2;
+    return 2.0 * n / elapsed;
+}
+
+/**
+ * @brief Compares the semaphore stack with the lock-free stack.
+ * @param processes The number of processes, half producers and half consumers.
+ * @param items The number of items pushed (and popped) in each run.
+ * @param capacity The capacity of the lock-free stack.
+ */
+static void bench_stacks(int processes, long items, unsigned capacity) {
+    int shmid, semid, lfShmid, sumShmid, ok = 1;
+
+    create_stack(&shmid, &semid);
+    SharedStack *stack = get_stack(shmid);
+    stack->top = 0;
+    LockFreeStack *lfStack = create_lf_stack(&lfShmid, capacity);
+    sumShmid = shmget(IPC_PRIVATE, MAX_PROCESSES * sizeof(long long), IPC_CREAT | 0666);
+    if (sumShmid == -1) {
+        perror("shmget failed");
+        exit(EXIT_FAILURE);
+    }
+    long long *sums = (long long *)shmat(sumShmid, NULL, 0);
+    if (sums == (void *)-1) {
+        perror("shmat failed");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%d processes, %ld items, semaphore stack of %d, lock-free stack of %u\n",
+           processes, items, STACK_SIZE, capacity);
+    double semRate = run_bench(stack, semid, NULL, processes, items, sums, &ok);
+    printf("%-12s %12.0f ops/s\n", "semaphores", semRate);
+    double lfRate = run_bench(NULL, 0, lfStack, processes, items, sums, &ok);
+    printf("%-12s %12.0f ops/s (%.1fx)\n", "lock-free", lfRate, lfRate / semRate);
+    if (!ok) {
+        printf("LOST OR DUPLICATED ITEMS\n");
+    }
+
+    shmdt(stack);
+    shmdt(lfStack);
+    shmdt(sums);
+    shmctl(shmid, IPC_RMID, NULL);
+    shmctl(lfShmid, IPC_RMID, NULL);
+    shmctl(sumShmid, IPC_RMID, NULL);
+    semctl(semid, 0, IPC_RMID, 0);
+}
+
 /**
  * @brief The main function. It creates a shared stack, pushes and pops some values, and then cleans up the shared memory and semaphores.
+ *        "lockfree [capacity]" does the same with the lock-free stack, and
+ *        "bench [processes [items [capacity]]]" compares the two stacks across processes.
  * @return 0 on success.
  */
-int main() {
+int main(int argc, char *argv[]) {
     int shmid, semid;
     SharedStack *stack;
 
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        int processes = argc > 2 ? atoi(argv[2]) : 2;
+        long items = argc > 3 ? atol(argv[3]) : 200000;
+        long capacity = argc > 4 ? atol(argv[4]) : 1024;
+        if (processes < 2 || processes > MAX_PROCESSES || processes % 2 != 0 || items < processes
+            || capacity < 1 || capacity > MAX_CAPACITY) {
+            fprintf(stderr, "Usage: %s bench [processes (even, 2 to %d) [items [capacity (1 to %d)]]]\n",
+                    argv[0], MAX_PROCESSES, MAX_CAPACITY);
+            return EXIT_FAILURE;
+        }
+        bench_stacks(processes, items, (unsigned)capacity);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "lockfree") == 0) {
+        long capacity = argc > 2 ? atol(argv[2]) : STACK_SIZE;
+        if (capacity < 2 || capacity > MAX_CAPACITY) { // the example pushes two values before popping
+            fprintf(stderr, "Usage: %s lockfree [capacity (2 to %d)]\n", argv[0], MAX_CAPACITY);
+            return EXIT_FAILURE;
+        }
+        LockFreeStack *lfStack = create_lf_stack(&shmid, (unsigned)capacity);
+        lf_push(lfStack, 10);
+        lf_push(lfStack, 20);
+        printf("Popped: %d\n", lf_pop(lfStack));
+        printf("Popped: %d\n", lf_pop(lfStack));
+        shmdt(lfStack);
+        shmctl(shmid, IPC_RMID, NULL);
+        return 0;
+    }
+
     // Create the shared stack and semaphores.
     create_stack(&shmid, &semid);
     stack = get_stack(shmid);